@@ -24,7 +24,7 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), shape_version_(0) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -73,6 +73,17 @@ class Blob {
   }
   inline int num_axes() const { return shape_.size(); }
   inline int count() const { return count_; }
+  /**
+   * @brief Returns a number that changes whenever Reshape changes the shape
+   *        or the memory behind data_ or diff_ is replaced.
+   *
+   * Versions are unique across all Blob%s, so a Blob found with the same
+   * version as before still has the same shape and memory, and Blob%s
+   * sharing its memory still see what it holds.
+   */
+  inline int64_t shape_version() const { return shape_version_; }
+  /// @brief The number of elements the blob can hold without reallocating.
+  inline int capacity() const { return capacity_; }
 
   /**
    * @brief Compute the volume of a slice; i.e., the product of dimensions
@@ -262,6 +273,40 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to a view of the count() elements of the
+   *        data_ of Blob other from offset on, keeping the current contents
+   *        -- so that writing this Blob writes into other, as Net arranges
+   *        for the bottoms of Concat and the tops of Slice.
+   *
+   * The view is of other's CPU memory. It ends when this Blob reallocates or
+   * shares memory again, and keeps other's memory alive until then.
+   */
+  void ShareDataRange(Blob* other, int offset);
+  /// @brief As ShareDataRange, for the diff_.
+  void ShareDiffRange(Blob* other, int offset);
+  /**
+   * @brief Release the memory holding data_ and diff_ while keeping the
+   *        shape; fresh (uninitialized) memory is allocated on next access.
+   *
+   * Memory shared with other Blob%s stays alive as long as they hold it.
+   */
+  void Release();
+  /**
+   * @brief Make room for count elements, so that Reshape does not reallocate
+   *        up to that count.
+   *
+   * Never shrinks. As when Reshape grows the blob, the contents are lost if
+   * memory is reallocated and sharing with other Blob%s ends.
+   */
+  void Reserve(int count);
+  /**
+   * @brief Reallocate the memory to hold exactly count() elements, keeping
+   *        the contents, if the blob has grown past it.
+   *
+   * Sharing with other Blob%s ends if memory is reallocated.
+   */
+  void ShrinkToFit();
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -272,6 +317,7 @@ class Blob {
   vector<int> shape_;
   int count_;
   int capacity_;
+  int64_t shape_version_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
@@ -158,6 +158,13 @@ class Caffe {
   inline static void set_solver_count(int val) { Get().solver_count_ = val; }
   inline static bool root_solver() { return Get().root_solver_; }
   inline static void set_root_solver(bool val) { Get().root_solver_ = val; }
+  // Whether SyncedMemory allocates host memory from the HostMemoryPool
+  // rather than directly with malloc. Unlike the mode, this setting is shared
+  // by all threads, as the pool is.
+  inline static bool host_memory_pool() { return host_memory_pool_; }
+  inline static void set_host_memory_pool(bool val) {
+    host_memory_pool_ = val;
+  }
 
  protected:
 #ifndef CPU_ONLY
@@ -169,6 +176,7 @@ class Caffe {
   Brew mode_;
   int solver_count_;
   bool root_solver_;
+  static bool host_memory_pool_;
 
  private:
   // The private constructor to avoid duplicate instantiation.
@@ -0,0 +1,141 @@
+#ifndef CAFFE_INFERENCE_ENGINE_HPP_
+#define CAFFE_INFERENCE_ENGINE_HPP_
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief Serves concurrent forward passes of one TEST net from a pool of
+ *        worker threads.
+ *
+ * The weights are held once by the root net; every worker owns a replica
+ * Net whose learnable blobs share their data with the root through
+ * Net::ShareTrainedLayersWith, so only the activations are duplicated per
+ * worker. Weights from a binary proto are loaded lazily (see
+ * Net::CopyTrainedLayersFromLazily), so the engine can take requests before
+ * the whole model is loaded.
+ *
+ * Predict() may be called from any number of threads. Requests are queued
+ * and served by the first idle worker; the calling thread blocks until its
+ * outputs are filled.
+ *
+ * With max_batch_size > 1 requests are batched dynamically: an idle worker
+ * concatenates queued requests along the first axis until the batch holds
+ * max_batch_size items or the oldest request has waited max_latency_us,
+ * reshapes the net to the batch, runs a single forward and splits the
+ * outputs back. Requests can only share a batch when their inputs agree on
+ * every axis but the first.
+ *
+ * With idle_release_ms > 0 a worker that has not served a request for that
+ * long releases the memory of its net's blobs (Net::ReleaseBlobs), so that
+ * memory grown for a burst of large requests is given back when traffic
+ * stops. It is allocated again on the next request.
+ *
+ * The engine must outlive all Predict() calls made on it.
+ */
+template <typename Dtype>
+class InferenceEngine {
+ public:
+  InferenceEngine(const string& param_file, const string& trained_file,
+      int num_workers, int max_batch_size = 1, int max_latency_us = 0,
+      int idle_release_ms = 0);
+  InferenceEngine(const NetParameter& param, int num_workers,
+      int max_batch_size = 1, int max_latency_us = 0,
+      int idle_release_ms = 0);
+  virtual ~InferenceEngine();
+
+  /**
+   * @brief Run the net on inputs and store the net outputs in outputs.
+   *
+   * inputs must match the net inputs in number; each is copied into the
+   * corresponding input blob, reshaping the net if needed. outputs are
+   * reshaped to the net outputs. When the request is batched with others,
+   * outputs whose first axis spans the batch are split between requests,
+   * any other output is copied to each of them. Thread-safe.
+   */
+  void Predict(const vector<Blob<Dtype>*>& inputs,
+      const vector<Blob<Dtype>*>& outputs);
+
+  /// @brief The root net holding the shared weights.
+  inline const shared_ptr<Net<Dtype> >& net() const { return nets_[0]; }
+  inline int num_workers() const { return workers_.size(); }
+  inline int max_batch_size() const { return max_batch_size_; }
+  inline int max_latency_us() const { return max_latency_us_; }
+  inline int idle_release_ms() const { return idle_release_ms_; }
+
+  /// @brief Latency of the requests served since the last ResetStats(),
+  ///        from the call to Predict() until the outputs are filled.
+  LatencyHistogram latency() const;
+  /// @brief Number of requests and forward passes since the last ResetStats().
+  int64_t num_requests() const;
+  int64_t num_batches() const;
+  void ResetStats();
+
+ protected:
+  struct Request {
+    const vector<Blob<Dtype>*>* inputs;
+    const vector<Blob<Dtype>*>* outputs;
+    // Items along the first axis, -1 if the request cannot be batched.
+    int num;
+    boost::posix_time::ptime arrival;
+    BlockingQueue<int> done;
+  };
+
+  class Worker : public InternalThread {
+   public:
+    Worker(InferenceEngine* engine, Net<Dtype>* net)
+        : engine_(engine), net_(net) {}
+    virtual ~Worker() { StopInternalThread(); }
+
+   protected:
+    virtual void InternalThreadEntry();
+    void Serve(const vector<Request*>& batch);
+
+    InferenceEngine* engine_;
+    Net<Dtype>* net_;
+  };
+
+  void Init(const NetParameter& param, int num_workers);
+  /// @brief Pop the next batch of requests to serve. Returns false if no
+  ///        request arrived within timeout_ms, unless it is negative.
+  bool Gather(vector<Request*>* batch, int timeout_ms);
+  bool Batchable(const Request& first, const Request& request) const;
+  void Served(const vector<Request*>& batch);
+
+  const int max_batch_size_;
+  const int max_latency_us_;
+  const int idle_release_ms_;
+  vector<shared_ptr<Net<Dtype> > > nets_;
+  vector<shared_ptr<Worker> > workers_;
+  BlockingQueue<Request*> requests_;
+  // Held by the worker gathering a batch, so that batches are formed one at
+  // a time rather than split between idle workers.
+  BlockingQueue<int> gather_token_;
+  // Popped while gathering but did not fit in the batch, served next.
+  Request* pending_;
+
+  shared_ptr<boost::mutex> stats_mutex_;
+  LatencyHistogram latency_;
+  int64_t num_requests_;
+  int64_t num_batches_;
+
+DISABLE_COPY_AND_ASSIGN(InferenceEngine);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INFERENCE_ENGINE_HPP_
@@ -294,6 +294,27 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether Forward may be run again during Backward to
+   *        recompute top blobs released by activation checkpointing.
+   *
+   * This method should be overridden to return false if Forward is random or
+   * changes the state of the layer, as the recomputed top blobs would then
+   * differ from those of the first pass.
+   */
+  virtual inline bool AllowRecompute() const { return true; }
+
+  /**
+   * @brief Return whether Reshape depends only on the shapes of the bottom
+   *        and top blobs.
+   *
+   * If so, Forward skips Reshape while the bottom and top blobs are the same
+   * and none of their shapes changed since the last call. This method should
+   * be overridden to return false if Reshape reads the contents of a blob or
+   * any other state that may change between forward passes.
+   */
+  virtual inline bool ReshapeDependsOnlyOnShapes() const { return true; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -316,6 +337,26 @@ class Layer {
     param_propagate_down_[param_id] = value;
   }
 
+  /**
+   * @brief Returns the indices of the rows, along the first axis, of the
+   *        param blob param_id whose diff Backward may have made nonzero
+   *        since the last ClearParamDiffRows(), or NULL if any row may be.
+   *
+   * Layers whose gradient touches few rows of a large param, like an
+   * EmbedLayer, track them so that the Net and the solvers can clear and
+   * update only those rows; the diff is zero in every other row.
+   */
+  virtual inline const vector<int>* param_diff_rows(const int param_id) const {
+    return NULL;
+  }
+  /// @brief Called once the param diffs are zeroed, to track rows afresh.
+  virtual void ClearParamDiffRows() {}
+  /**
+   * @brief Called once the param diffs may be nonzero in any row, after which
+   *        param_diff_rows() returns NULL until the next ClearParamDiffRows().
+   */
+  virtual void InvalidateParamDiffRows() {}
+
 
  protected:
   /** The protobuf that stores the layer parameters */
@@ -441,6 +482,17 @@ class Layer {
   /** Unlock forward_mutex_ if this layer is shared */
   void Unlock();
 
+  /** The bottom and top blobs of the last Reshape, and their shape versions */
+  vector<const Blob<Dtype>*> reshaped_blobs_;
+  vector<int64_t> reshaped_versions_;
+
+  /** Whether Forward must Reshape before running on bottom and top */
+  bool NeedsReshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const;
+  /** Record the blobs and shape versions Reshape was run with */
+  void RecordReshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
   DISABLE_COPY_AND_ASSIGN(Layer);
 };  // class Layer
 
@@ -453,7 +505,10 @@ inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
   // Lock during forward to ensure sequential forward
   Lock();
   Dtype loss = 0;
-  Reshape(bottom, top);
+  if (NeedsReshape(bottom, top)) {
+    Reshape(bottom, top);
+    RecordReshape(bottom, top);
+  }
   switch (Caffe::mode()) {
   case Caffe::CPU:
     Forward_cpu(bottom, top);
@@ -7,6 +7,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/sparse_matrix.hpp"
 
 namespace caffe {
 
@@ -31,15 +32,20 @@ class BaseConvolutionLayer : public Layer<Dtype> {
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
   // The last argument in forward_cpu_gemm is so that we can skip the im2col if
-  // we just called weight_cpu_gemm with the same input.
+  // we just called weight_cpu_gemm with the same input. With sparse_weights,
+  // the sparse form of weights is used instead.
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output, bool skip_im2col = false);
+      Dtype* output, bool skip_im2col = false,
+      const SparseMatrix<Dtype>* sparse_weights = NULL);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  /// @brief The weights in sparse form for forward_cpu_gemm: in the TEST
+  ///        phase when enough of them are zero, NULL otherwise.
+  const SparseMatrix<Dtype>* sparse_weights();
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -167,6 +173,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
+  SparseWeights<Dtype> sparse_weights_;
 };
 
 }  // namespace caffe
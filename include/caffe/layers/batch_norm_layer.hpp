@@ -27,11 +27,14 @@ namespace caffe {
  * param {lr_mult: 0} three times in the layer definition.
  *
  * Note that the original paper also included a per-channel learned bias and
- * scaling factor.  It is possible (though a bit cumbersome) to implement
- * this in caffe using a single-channel DummyDataLayer filled with zeros,
- * followed by a Convolution layer with output the same size as the current.
- * This produces a channel-specific value that can be added or multiplied by
- * the BatchNorm layer's output.
+ * scaling factor.  These are usually learned by a following Scale layer with
+ * bias_term, or by this layer itself with the scale_bias option, which
+ * applies them in the same pass.  They are then the fourth and fifth
+ * parameter blobs, and should be learned as usual.
+ *
+ * On the CPU, the statistics, normalization and its gradient are computed
+ * per channel in one or two passes, without full-size temporaries unless
+ * the layer is computed in place.
  *
  * [1] S. Ioffe and C. Szegedy, "Batch Normalization: Accelerating Deep Network
  *     Training by Reducing Internal Covariate Shift." arXiv preprint
@@ -52,6 +55,8 @@ class BatchNormLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "BatchNorm"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  // Recomputing would update the moving averages twice.
+  virtual inline bool AllowRecompute() const { return use_global_stats_; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -68,6 +73,7 @@ class BatchNormLayer : public Layer<Dtype> {
   Dtype moving_average_fraction_;
   int channels_;
   Dtype eps_;
+  bool scale_bias_;
 
   // extra temporarary variables is used to carry out sums/broadcasting
   // using BLAS
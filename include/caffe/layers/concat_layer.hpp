@@ -76,6 +76,16 @@ class ConcatLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /**
+   * @brief Give the bottoms that Net made ranges of the top (see
+   *        Net::ShareConcatRanges) but a reshape left elsewhere in it memory
+   *        of their own, so that the copies cannot overwrite them: their
+   *        data before the forward copies, their diff before the backward
+   *        ones.
+   */
+  void MoveMisplacedRanges(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top, bool diff);
+
   int count_;
   int num_concats_;
   int concat_input_size_;
@@ -39,6 +39,8 @@ class DropoutLayer : public NeuronLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Dropout"; }
+  // Recomputing would draw a different mask.
+  virtual inline bool AllowRecompute() const { return this->phase_ != TRAIN; }
 
  protected:
   /**
@@ -67,7 +69,11 @@ class DropoutLayer : public NeuronLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
   /// when divided by UINT_MAX, the randomly generated values @f$u\sim U(0,1)@f$
+  /// on the GPU
   Blob<unsigned int> rand_vec_;
+  /// on the CPU, the kept inputs, one bit each: input i is bit i % 32 of
+  /// word i / 32
+  Blob<unsigned int> mask_;
   /// the probability @f$ p @f$ of dropping any input
   Dtype threshold_;
   /// the scale for undropped inputs at train time @f$ 1 / (1 - p) @f$
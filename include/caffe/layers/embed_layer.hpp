@@ -20,7 +20,7 @@ template <typename Dtype>
 class EmbedLayer : public Layer<Dtype> {
  public:
   explicit EmbedLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), diff_rows_valid_(false) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -30,6 +30,14 @@ class EmbedLayer : public Layer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  /// With sparse_gradient, the weight diff rows of the inputs seen on the CPU.
+  virtual inline const vector<int>* param_diff_rows(const int param_id) const {
+    return (param_id == 0 && sparse_gradient_ && diff_rows_valid_) ?
+        &diff_rows_ : NULL;
+  }
+  virtual void ClearParamDiffRows();
+  virtual void InvalidateParamDiffRows() { diff_rows_valid_ = false; }
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -45,6 +53,12 @@ class EmbedLayer : public Layer<Dtype> {
   int N_;
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
+  bool sparse_gradient_;
+  // The rows of the weight diff Backward_cpu wrote, whether each row is one
+  // of them, and whether the diff is zero in the other rows.
+  vector<int> diff_rows_;
+  vector<bool> row_has_diff_;
+  bool diff_rows_valid_;
 };
 
 }  // namespace caffe
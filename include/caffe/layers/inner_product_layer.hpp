@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/sparse_matrix.hpp"
 
 namespace caffe {
 
@@ -45,6 +46,9 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  SparseWeights<Dtype> sparse_weights_;
+  /// The transposes MultiplyTransposedBy works on.
+  Blob<Dtype> sparse_buffer_;
 };
 
 }  // namespace caffe
@@ -56,6 +56,15 @@ class LRNLayer : public Layer<Dtype> {
   virtual void WithinChannelBackward(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // The CPU cross-channel passes over length positions of one image starting
+  // at offset, streamed through once channel by channel with a running sum
+  // over the window.
+  void CrossChannelForwardTile(int offset, int length, const Dtype* bottom_data,
+      Dtype* scale_data, Dtype* top_data);
+  void CrossChannelBackwardTile(int offset, int length, const Dtype* top_diff,
+      const Dtype* top_data, const Dtype* bottom_data, const Dtype* scale_data,
+      Dtype* bottom_diff);
+
   int size_;
   int pre_pad_;
   Dtype alpha_;
@@ -44,6 +44,23 @@ class PoolingLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // Max pools a plane of the bottom, storing the index of each max in mask
+  // or top_mask, whichever is not NULL.
+  void MaxPoolPlane(const Dtype* bottom, Dtype* top, int* mask,
+      Dtype* top_mask);
+  // Max, or average if average is set, pools num_planes planes of the
+  // bottom without a mask.
+  void ReducePlanes(int num_planes, const Dtype* bottom, bool average,
+      Dtype* top);
+  // Pools a plane for ReducePlanes: the rows of each window are reduced into
+  // col, of width_ values, a block of columns at a time, and then its columns.
+  void ReducePlane(const Dtype* bottom, bool average, Dtype* col, Dtype* top);
+  // Max pooling backward for a plane, finding the index of each max again
+  // when the forward pass stored no mask.
+  void MaxUnpoolPlane(const Dtype* top_diff, const int* mask,
+      const Dtype* top_mask, const Dtype* bottom, Dtype* bottom_diff);
+  void AveUnpoolPlane(const Dtype* top_diff, Dtype* bottom_diff);
+
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
   int pad_h_, pad_w_;
@@ -52,6 +69,8 @@ class PoolingLayer : public Layer<Dtype> {
   int pooled_height_, pooled_width_;
   bool global_pooling_;
   Blob<Dtype> rand_idx_;
+  // The index of each max, which max pooling leaves out on the CPU in the
+  // TEST phase unless it is output as top[1].
   Blob<int> max_idx_;
 };
 
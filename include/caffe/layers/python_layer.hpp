@@ -36,6 +36,8 @@ class PythonLayer : public Layer<Dtype> {
   virtual inline bool ShareInParallel() const {
     return this->layer_param_.python_param().share_in_parallel();
   }
+  // reshape() may depend on anything visible from Python.
+  virtual inline bool ReshapeDependsOnlyOnShapes() const { return false; }
 
   virtual inline const char* type() const { return "Python"; }
 
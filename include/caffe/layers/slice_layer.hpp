@@ -39,6 +39,16 @@ class SliceLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /**
+   * @brief Give the tops that Net made ranges of the bottom (see
+   *        Net::ShareConcatRanges) but a reshape left elsewhere in it memory
+   *        of their own, so that the copies cannot overwrite the bottom:
+   *        their data before the forward copies, their diff before the
+   *        backward ones.
+   */
+  void MoveMisplacedRanges(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top, bool diff);
+
   int count_;
   int num_slices_;
   int slice_size_;
@@ -14,6 +14,8 @@
 
 namespace caffe {
 
+template <typename Dtype> class WeightLoader;
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -23,7 +25,13 @@ namespace caffe {
 template <typename Dtype>
 class Net {
  public:
-  explicit Net(const NetParameter& param, const Net* root_net = NULL);
+  /**
+   * @brief Build a net from param. Layers named as in weights_net, if any,
+   *        share its params, which are then not filled, as replicas do
+   *        before ShareTrainedLayersWith().
+   */
+  explicit Net(const NetParameter& param, const Net* root_net = NULL,
+      const Net* weights_net = NULL);
   explicit Net(const string& param_file, Phase phase,
       const Net* root_net = NULL);
   virtual ~Net() {}
@@ -81,6 +89,24 @@ class Net {
    * a forward pass, e.g. to compute output feature size.
    */
   void Reshape();
+  /**
+   * @brief Allocate every blob for the given input shapes, so that later
+   *        inputs up to these shapes do not reallocate.
+   *
+   * The inputs are reshaped to max_input_shapes, the net is reshaped and the
+   * data of every blob, and in TRAIN its diff, are allocated; the inputs and
+   * the net are then reshaped back, keeping the capacity. Layers grow their
+   * internal buffers to the maximum shapes too, which are allocated on the
+   * next pass.
+   */
+  void Reserve(const vector<vector<int> >& max_input_shapes);
+  /**
+   * @brief Free the memory of the blobs between layers, keeping their shapes.
+   *
+   * The memory is allocated again, fitting the current shapes, on the next
+   * pass. Useful to give memory back while the net is idle.
+   */
+  void ReleaseBlobs();
 
   Dtype ForwardBackward() {
     Dtype loss;
@@ -91,6 +117,30 @@ class Net {
 
   /// @brief Updates the network weights based on the diff values computed.
   void Update();
+  /**
+   * @brief Collects the rows of each learnable param whose diff may be
+   *        nonzero, as tracked by the layers using it on the CPU (see
+   *        Layer::param_diff_rows), merging those of shared params.
+   *
+   * Called once the gradients are computed, e.g. by Solver::Step after the
+   * backward passes; the rows stay until the next ClearParamDiffs() or
+   * InvalidateParamDiffRows().
+   */
+  void GatherParamDiffRows();
+  /**
+   * @brief Returns the rows of the learnable param param_id gathered by
+   *        GatherParamDiffRows(), or NULL if any row may be nonzero.
+   *
+   * ClearParamDiffs() and Update() touch only these rows.
+   */
+  inline const vector<int>* learnable_param_diff_rows(int param_id) const {
+    return param_diff_rows_.empty() ? NULL : param_diff_rows_[param_id];
+  }
+  /**
+   * @brief Stops tracking the param diff rows until the next
+   *        ClearParamDiffs(), for solvers writing the diffs of every row.
+   */
+  void InvalidateParamDiffRows();
   /**
    * @brief Shares weight data of owner blobs with shared blobs.
    *
@@ -112,8 +162,37 @@ class Net {
    */
   void CopyTrainedLayersFrom(const NetParameter& param);
   void CopyTrainedLayersFrom(const string trained_filename);
+  /**
+   * @brief For an already initialized net, copies the trained layers from
+   *        another Net into this net's own parameter blobs.
+   */
+  void CopyTrainedLayersFrom(const Net* other);
+  /**
+   * @brief Decodes the layers of a trained binary proto on a thread per core
+   *        and copies them into the parameter blobs of the layers of the same
+   *        name.
+   */
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
+  /**
+   * @brief Like CopyTrainedLayersFrom(), but for a binary proto returns once
+   *        its layers are indexed.
+   *
+   * The layers are loaded in order by num_threads background threads, and
+   * Forward() waits for, or loads itself, those it reaches first, so that a
+   * net can serve while the tail of a large model is still being decoded.
+   * Nets sharing the layers through ShareTrainedLayersWith() wait alike.
+   * Call WaitForTrainedLayers() before reading the params otherwise.
+   */
+  void CopyTrainedLayersFromLazily(const string trained_filename,
+      int num_threads = 1);
+  /// @brief Return once the layers loaded lazily are all loaded.
+  void WaitForTrainedLayers() const;
   void CopyTrainedLayersFromHDF5(const string trained_filename);
+  /**
+   * @brief Points the parameter blobs at the params of a mapped WeightFile
+   *        instead of copying them, unless their type differs from Dtype.
+   */
+  void CopyTrainedLayersFromWeightFile(const string trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
@@ -135,6 +214,19 @@ class Net {
   }
   /// @brief returns the phase: TRAIN or TEST
   inline Phase phase() const { return phase_; }
+  /**
+   * @brief returns the account charged for the memory allocated while
+   *        setting up and running the net, and the accounts of each layer.
+   *
+   * A layer is charged for what it allocates during its SetUp, Reshape,
+   * Forward and Backward: its parameters, the top blobs it writes first, the
+   * parts of its bottom blobs it touches first (usually their diffs), and its
+   * internal buffers.
+   */
+  inline const shared_ptr<MemoryAccount>& memory() const { return memory_; }
+  inline const vector<shared_ptr<MemoryAccount> >& layer_memory() const {
+    return layer_memory_;
+  }
   /**
    * @brief returns the bottom vecs for each layer -- usually you won't
    *        need this unless you do per-layer checks such as gradients.
@@ -240,6 +332,29 @@ class Net {
   /// @brief Append a new parameter blob to the net.
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
+  /// @brief Find the recompute segments and the blobs internal to them.
+  void InitRecomputeSegments(const NetParameter& param);
+  /// @brief Release the blobs internal to a recompute segment.
+  void ReleaseRecomputeSegment(const int segment);
+  /**
+   * @brief On the CPU, make the bottoms of Concat layers ranges of their top,
+   *        and the tops of Slice layers ranges of their bottom, so that they
+   *        are computed in place rather than copied.
+   *
+   * This is done where the ranges are contiguous -- concatenated along the
+   * first axis of size above one -- and their memory is not otherwise
+   * shared: not for blobs whose memory another blob shares (e.g. the tops of
+   * Split), nor for blobs released for recomputation, nor where a layer
+   * computing in place would overwrite a range another layer still needs.
+   * Concat and Slice fall back to copying the ranges that a later reshape
+   * moved, until the next Reshape.
+   */
+  void ShareConcatRanges();
+  /// @brief Index a binary proto and set the params it loads, with the
+  ///        loader layer of each layer in layer_ids. NULL if the file must be
+  ///        upgraded as a whole.
+  shared_ptr<WeightLoader<Dtype> > IndexTrainedLayers(
+      const string& trained_filename, vector<int>* layer_ids);
 
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
@@ -295,18 +410,38 @@ class Net {
    * and learnable_params_[learnable_param_ids_[i]] gives its owner.
    */
   vector<int> learnable_param_ids_;
+  /// The diff rows of each learnable param, NULL for any row; empty when
+  /// not gathered since the last ClearParamDiffs().
+  vector<const vector<int>*> param_diff_rows_;
+  /// The diff rows of the learnable params used by several layers, merged.
+  vector<vector<int> > merged_param_diff_rows_;
   /// the learning rate multipliers for learnable_params_
   vector<float> params_lr_;
   vector<bool> has_params_lr_;
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// Activation checkpointing: the first and last layer ids of each recompute
+  /// segment, the ids of the blobs released after the Forward of each segment,
+  /// and the segment of each layer (-1 for layers that are not recomputed).
+  vector<pair<int, int> > recompute_segments_;
+  vector<vector<int> > recompute_blob_ids_;
+  vector<int> layer_recompute_segment_;
   /// The bytes of memory used by this net
   size_t memory_used_;
+  /// The memory charged to the net and to each layer.
+  shared_ptr<MemoryAccount> memory_;
+  vector<shared_ptr<MemoryAccount> > layer_memory_;
+  /// Loads the trained layers lazily, with the loader layer of each layer
+  /// (-1 once it is known to be loaded).
+  shared_ptr<WeightLoader<Dtype> > weight_loader_;
+  vector<int> weight_loader_layer_ids_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
+  /// The net whose params Init shares instead of filling new ones.
+  const Net* const weights_net_;
   DISABLE_COPY_AND_ASSIGN(Net);
 };
 
@@ -22,6 +22,9 @@ class SGDSolver : public Solver<Dtype> {
   virtual inline const char* type() const { return "SGD"; }
 
   const vector<shared_ptr<Blob<Dtype> > >& history() { return history_; }
+  const vector<shared_ptr<Blob<Dtype> > >& master_params() {
+    return master_params_;
+  }
 
  protected:
   void PreSolve();
@@ -31,6 +34,27 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
+  // Whether ComputeUpdateValue updates only the rows with gradient of the
+  // params whose layers track them, leaving the history of the other rows
+  // as it is. The solver updates every row otherwise.
+  virtual inline bool LazyRowUpdates() const { return true; }
+  // The rows of param param_id to update, of width values each: those with
+  // gradient if tracked, or else the whole param as a single row.
+  const vector<int>& UpdateRows(int param_id, int* width);
+  // Round the data (or diff, if diff is set) of src to the train_precision
+  // of the solver and store it in dst, which may be the same blob as src.
+  // The rounded values are still stored as Dtype: this emulates the
+  // precision, not the storage.
+  void RoundToTrainPrecision(const Blob<Dtype>& src, Blob<Dtype>* dst,
+      bool diff);
+  // Returns true if any gradient is inf or NaN.
+  bool GradientsOverflow();
+  // Halve the dynamic loss scale on overflow, or double it after
+  // loss_scale_window consecutive iterations without overflow.
+  void UpdateLossScale(bool overflow);
+  // Apply the update values in the param diffs to the master weights and
+  // round the result into the net's params.
+  void UpdateMasterParams();
   virtual void SnapshotSolverState(const string& model_filename);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
@@ -41,6 +65,13 @@ class SGDSolver : public Solver<Dtype> {
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  // master_params maintains full precision copies of the learnable params
+  // when training in reduced precision, and is empty otherwise.
+  vector<shared_ptr<Blob<Dtype> > > master_params_;
+  // The rows of a param updated as a whole, that is row 0.
+  vector<int> whole_param_;
+  // The number of consecutive iterations without gradient overflow.
+  int loss_scale_iters_;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
@@ -56,6 +87,7 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool LazyRowUpdates() const { return false; }
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -71,6 +103,7 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool LazyRowUpdates() const { return false; }
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -91,6 +124,7 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool LazyRowUpdates() const { return false; }
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -115,6 +149,7 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool LazyRowUpdates() const { return false; }
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -4,8 +4,10 @@
 #include <string>
 #include <vector>
 
+#include "caffe/internal_thread.hpp"
 #include "caffe/net.hpp"
 #include "caffe/solver_factory.hpp"
+#include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
 
@@ -31,6 +33,9 @@ namespace caffe {
  */
 typedef boost::function<SolverAction::Enum()> ActionCallback;
 
+template <typename Dtype>
+class AsyncTester;
+
 /**
  * @brief An interface for classes that perform optimization on Net%s.
  *
@@ -73,6 +78,8 @@ class Solver {
     return test_nets_;
   }
   int iter() { return iter_; }
+  /// @brief The factor the loss is currently multiplied by for backward.
+  Dtype loss_scale() const { return loss_scale_; }
 
   // Invoked at specific points during an iteration
   class Callback {
@@ -103,11 +110,18 @@ class Solver {
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
+  // Evaluate a test net with its current weights, reporting the results for
+  // iteration iter. Client requests are only handled if handle_requests.
+  void TestNet(const int test_net_id, const int iter,
+      const bool handle_requests);
   virtual void SnapshotSolverState(const string& model_filename) = 0;
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
   void DisplayOutputBlobs(const int net_id);
   void UpdateSmoothedLoss(Dtype loss, int start_iter, int average_loss);
+  // Set the loss weights of the train net to their configured values times
+  // scale, so that backward computes the gradient of the scaled loss.
+  void ScaleLossWeights(Dtype scale);
 
   SolverParameter param_;
   int iter_;
@@ -117,6 +131,7 @@ class Solver {
   vector<Callback*> callbacks_;
   vector<Dtype> losses_;
   Dtype smoothed_loss_;
+  Dtype loss_scale_;
 
   // The root solver that holds root nets (actually containing shared layers)
   // in data parallelism
@@ -129,9 +144,44 @@ class Solver {
   // True iff a request to stop early was received.
   bool requested_early_exit_;
 
+  // Evaluates the test nets in the background if test_async is set.
+  shared_ptr<AsyncTester<Dtype> > async_tester_;
+
+  friend class AsyncTester<Dtype>;
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
+/**
+ * @brief Evaluates the test nets of a Solver on a separate thread, against a
+ *        copy of the weights, so that testing does not block training.
+ */
+template <typename Dtype>
+class AsyncTester : public InternalThread {
+ public:
+  explicit AsyncTester(Solver<Dtype>* solver);
+  virtual ~AsyncTester();
+
+  /**
+   * @brief Copies the current weights of the train net into the test nets
+   *        and starts evaluating them. Returns false, skipping the test, if
+   *        the previous evaluation is still running.
+   */
+  bool TestAll();
+  /// @brief Blocks until the running evaluation, if any, is done.
+  void Wait();
+
+ protected:
+  virtual void InternalThreadEntry();
+
+  Solver<Dtype>* solver_;
+  // Holds a single token while the tester is idle.
+  BlockingQueue<int> idle_;
+  // The iterations whose weights are to be tested.
+  BlockingQueue<int> pending_;
+
+  DISABLE_COPY_AND_ASSIGN(AsyncTester);
+};
+
 /**
  * @brief Solver that only computes gradients, used as worker
  *        for multi-GPU training.
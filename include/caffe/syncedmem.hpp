@@ -1,9 +1,14 @@
 #ifndef CAFFE_SYNCEDMEM_HPP_
 #define CAFFE_SYNCEDMEM_HPP_
 
+#include <boost/enable_shared_from_this.hpp>
+
 #include <cstdlib>
 
 #include "caffe/common.hpp"
+#include "caffe/util/host_memory_pool.hpp"
+
+namespace boost { class mutex; }
 
 namespace caffe {
 
@@ -12,7 +17,11 @@ namespace caffe {
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
-inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
+// Otherwise, if Caffe::host_memory_pool() is enabled, host memory is taken
+// from the HostMemoryPool, which caches it for reuse once freed.
+inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda,
+    bool* use_pool) {
+  *use_pool = false;
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
     CUDA_CHECK(cudaMallocHost(ptr, size));
@@ -20,21 +29,97 @@ inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
     return;
   }
 #endif
-  *ptr = malloc(size);
   *use_cuda = false;
+  if (Caffe::host_memory_pool()) {
+    *ptr = HostMemoryPool::Get().Allocate(size);
+    *use_pool = true;
+    return;
+  }
+  *ptr = malloc(size);
   CHECK(*ptr) << "host allocation of size " << size << " failed";
 }
 
-inline void CaffeFreeHost(void* ptr, bool use_cuda) {
+inline void CaffeFreeHost(void* ptr, size_t size, bool use_cuda,
+    bool use_pool) {
 #ifndef CPU_ONLY
   if (use_cuda) {
     CUDA_CHECK(cudaFreeHost(ptr));
     return;
   }
 #endif
+  if (use_pool) {
+    HostMemoryPool::Get().Free(ptr, size);
+    return;
+  }
   free(ptr);
 }
 
+/// @brief Byte counts of the host or the device memory charged to a
+///        MemoryAccount.
+struct MemoryUsage {
+  MemoryUsage() : live(0), peak(0), allocated(0), allocations(0) {}
+  /// Bytes currently held.
+  size_t live;
+  /// Highest value of live since the account was created or ResetPeak().
+  size_t peak;
+  /// Bytes and number of allocations ever made.
+  size_t allocated;
+  int64_t allocations;
+};
+
+/**
+ * @brief Counts the memory allocated by SyncedMemory.
+ *
+ * Every allocation is charged to the account current on the allocating thread
+ * and to all its parents up to the Global() account, and is refunded to the
+ * same accounts when freed. A MemoryScope makes an account current, e.g. Net
+ * makes the account of a layer current while running it, so that its
+ * parameters, top blobs and internal buffers are charged to that layer.
+ *
+ * Accounts must be owned by a shared_ptr; memory still charged to an account
+ * keeps it alive.
+ */
+class MemoryAccount : public boost::enable_shared_from_this<MemoryAccount> {
+ public:
+  enum Side { HOST, DEVICE };
+
+  explicit MemoryAccount(const shared_ptr<MemoryAccount>& parent = Global());
+
+  MemoryUsage usage(Side side) const;
+  /// @brief Restart peak tracking from the bytes currently held.
+  void ResetPeak();
+  inline const shared_ptr<MemoryAccount>& parent() const { return parent_; }
+
+  /// @brief The root account, charged for every allocation.
+  static const shared_ptr<MemoryAccount>& Global();
+  /// @brief The account charged for allocations on the calling thread.
+  static shared_ptr<MemoryAccount> Current();
+
+ protected:
+  friend class SyncedMemory;
+  friend class MemoryScope;
+  void Charge(Side side, size_t size);
+  void Refund(Side side, size_t size);
+
+  shared_ptr<MemoryAccount> parent_;
+  shared_ptr<boost::mutex> mutex_;
+  MemoryUsage usage_[2];
+
+  DISABLE_COPY_AND_ASSIGN(MemoryAccount);
+};
+
+/// @brief Makes an account current on the calling thread for the lifetime of
+///        the scope.
+class MemoryScope {
+ public:
+  explicit MemoryScope(MemoryAccount* account);
+  ~MemoryScope();
+
+ private:
+  MemoryAccount* previous_;
+
+  DISABLE_COPY_AND_ASSIGN(MemoryScope);
+};
 
 /**
  * @brief Manages memory allocation and synchronization between the host (CPU)
@@ -46,15 +131,20 @@ class SyncedMemory {
  public:
   SyncedMemory()
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-        own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        own_cpu_data_(false), cpu_malloc_use_cuda_(false),
+        cpu_malloc_use_pool_(false), own_gpu_data_(false), gpu_device_(-1),
+        version_(0) {}
   explicit SyncedMemory(size_t size)
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-        own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        own_cpu_data_(false), cpu_malloc_use_cuda_(false),
+        cpu_malloc_use_pool_(false), own_gpu_data_(false), gpu_device_(-1),
+        version_(0) {}
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
+  /// @brief Use data that stays valid for as long as holder is kept, e.g.
+  ///        a mapped file; holder is released with the data.
+  void set_cpu_data(void* data, const shared_ptr<void>& holder);
   const void* gpu_data();
   void set_gpu_data(void* data);
   void* mutable_cpu_data();
@@ -62,6 +152,17 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
+  /// @brief Incremented whenever the data may be written: by the mutable
+  ///        accessors and when it is set.
+  inline int64_t version() const { return version_; }
+  /// @brief The accounts charged for the host and device memory owned by
+  ///        this SyncedMemory, NULL while it owns none.
+  inline const MemoryAccount* cpu_account() const {
+    return cpu_account_.get();
+  }
+  inline const MemoryAccount* gpu_account() const {
+    return gpu_account_.get();
+  }
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -70,14 +171,25 @@ class SyncedMemory {
  private:
   void to_cpu();
   void to_gpu();
+  void AllocateHost();
+  void FreeHost();
+#ifndef CPU_ONLY
+  void AllocateDevice();
+  void FreeDevice();
+#endif
   void* cpu_ptr_;
   void* gpu_ptr_;
   size_t size_;
   SyncedHead head_;
   bool own_cpu_data_;
   bool cpu_malloc_use_cuda_;
+  bool cpu_malloc_use_pool_;
   bool own_gpu_data_;
   int gpu_device_;
+  int64_t version_;
+  shared_ptr<MemoryAccount> cpu_account_;
+  shared_ptr<MemoryAccount> gpu_account_;
+  shared_ptr<void> cpu_data_holder_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
@@ -3,6 +3,10 @@
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
 #include "caffe/util/device_alternate.hpp"
 
 namespace caffe {
@@ -47,6 +51,41 @@ class CPUTimer : public Timer {
   virtual float MicroSeconds();
 };
 
+/**
+ * @brief Histogram of durations in microseconds.
+ *
+ * Buckets grow geometrically by 2^(1/8), so percentiles are reported within
+ * about 9% of the exact value while the memory stays constant however many
+ * samples are added. Not thread-safe.
+ */
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  void Add(float microseconds);
+  void Merge(const LatencyHistogram& other);
+  void Clear();
+
+  inline int64_t count() const { return count_; }
+  inline float min() const { return min_; }
+  inline float max() const { return max_; }
+  float Mean() const;
+  /// @brief The p-th percentile, p in [0, 100].
+  float Percentile(float p) const;
+  /// @brief One line summary: count, mean, p50, p95, p99 and max.
+  string ToString() const;
+
+ protected:
+  static int Bucket(float microseconds);
+  static float BucketUpperBound(int bucket);
+
+  vector<int64_t> buckets_;
+  int64_t count_;
+  double sum_;
+  float min_;
+  float max_;
+};
+
 }  // namespace caffe
 
 #endif   // CAFFE_UTIL_BENCHMARK_H_
@@ -0,0 +1,44 @@
+#ifndef CAFFE_UTIL_BLOB_COMPRESSION_HPP_
+#define CAFFE_UTIL_BLOB_COMPRESSION_HPP_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Store the data of a blob proto as a CompressedBlob if that is
+ *        smaller: sparse when the nonzero values with their indices take
+ *        less space than every value, quantized if the parameter asks so.
+ *
+ * Without quantization the values are kept exact, in the precision of the
+ * proto. Quantization is lossy, with a single precision codebook; the zeros
+ * of a sparse blob, e.g. pruned weights, are kept exact.
+ */
+void CompressBlobProto(const CompressionParameter& param, BlobProto* proto);
+/// @brief Compress the params of every layer of a trained net.
+void CompressNetParameter(const CompressionParameter& param,
+    NetParameter* net_param);
+/// @brief Restore the data of every compressed param of a trained net.
+void DecompressNetParameter(NetParameter* net_param);
+
+/// @brief Decompress the count values of a blob into data.
+template <typename Dtype>
+void DecompressBlobData(const CompressedBlob& compressed, int count,
+    Dtype* data);
+
+/**
+ * @brief Quantize values to a sorted codebook of at most num_codes values by
+ *        k-means, with codes the index in it of each value.
+ *
+ * The codebook is initialized uniformly between the smallest and largest
+ * value, which keeps the rare large weights well represented.
+ */
+void QuantizeValues(const std::vector<float>& values, int num_codes,
+    int iterations, std::vector<float>* codebook, std::vector<int>* codes);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_BLOB_COMPRESSION_HPP_
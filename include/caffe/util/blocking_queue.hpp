@@ -15,6 +15,9 @@ class BlockingQueue {
 
   bool try_pop(T* t);
 
+  // Waits up to timeout_us microseconds for an element to become available
+  bool try_pop(T* t, int timeout_us);
+
   // This logs a message if the threads needs to be blocked
   // useful for detecting e.g. when data feeding is too slow
   T pop(const string& log_on_wait = "");
@@ -13,6 +13,43 @@ inline std::string format_int(int n, int numberOfLeadingZeros = 0 ) {
   return s.str();
 }
 
+// Quote value as a JSON string, escaping quotes, backslashes and control
+// characters.
+inline std::string format_json_string(const std::string& value) {
+  std::ostringstream s;
+  s << '"';
+  for (size_t i = 0; i < value.size(); ++i) {
+    const unsigned char c = value[i];
+    if (c == '"' || c == '\\') {
+      s << '\\' << c;
+    } else if (c < 0x20) {
+      s << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+        << static_cast<int>(c) << std::dec;
+    } else {
+      s << c;
+    }
+  }
+  s << '"';
+  return s.str();
+}
+
+// Format value as a CSV field (RFC 4180): quoted, with quotes doubled, if it
+// holds a comma, a quote or a line break.
+inline std::string format_csv_field(const std::string& value) {
+  if (value.find_first_of(",\"\r\n") == std::string::npos) {
+    return value;
+  }
+  std::string s = "\"";
+  for (size_t i = 0; i < value.size(); ++i) {
+    if (value[i] == '"') {
+      s += '"';
+    }
+    s += value[i];
+  }
+  s += '"';
+  return s;
+}
+
 }
 
 #endif   // CAFFE_UTIL_FORMAT_H_
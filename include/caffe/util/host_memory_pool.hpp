@@ -0,0 +1,80 @@
+#ifndef CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
+#define CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief A process-wide cache of host memory blocks, used by SyncedMemory
+ *        when Caffe::host_memory_pool() is enabled.
+ *
+ * Requests are rounded up to size classes, four per power of two, so that a
+ * freed block can serve any later request of the same class; nets reshaped
+ * between batch sizes then reuse their buffers instead of returning them to
+ * the system. Blocks are aligned to kAlignment bytes for vectorized code.
+ * Blocks of kHugePageThreshold bytes or more are aligned to kHugePageSize
+ * and, on Linux, advised to be backed by transparent huge pages.
+ *
+ * Freed blocks are cached up to max_cached() bytes, kDefaultMaxCached
+ * unless set; beyond that they are returned to the system. Thread-safe.
+ */
+class HostMemoryPool {
+ public:
+  struct Stats {
+    Stats() : allocations(0), hits(0), system_allocations(0), in_use(0),
+        cached(0), peak(0) {}
+    /// Allocate() calls, and how many of them were served from the cache.
+    int64_t allocations;
+    int64_t hits;
+    /// Blocks requested from the system.
+    int64_t system_allocations;
+    /// Bytes of the blocks handed out and of the blocks cached.
+    size_t in_use;
+    size_t cached;
+    /// Highest in_use + cached.
+    size_t peak;
+  };
+
+  static const size_t kAlignment = 64;
+  static const size_t kHugePageSize = 2 << 20;
+  static const size_t kHugePageThreshold = 8 << 20;
+  /// Enough to keep the activations of most nets across reshapes.
+  static const size_t kDefaultMaxCached = static_cast<size_t>(1) << 30;
+
+  static HostMemoryPool& Get();
+
+  void* Allocate(size_t size);
+  /// @brief Return a block from Allocate(size) to the pool.
+  void Free(void* ptr, size_t size);
+  /// @brief Return all cached blocks to the system.
+  void Trim();
+
+  Stats stats() const;
+  size_t max_cached() const;
+  void set_max_cached(size_t bytes);
+
+  /// @brief The size of the blocks serving requests of size bytes.
+  static size_t SizeClass(size_t size);
+
+ private:
+  HostMemoryPool();
+
+  shared_ptr<boost::mutex> mutex_;
+  // Cached blocks by size class.
+  std::map<size_t, std::vector<void*> > free_blocks_;
+  size_t max_cached_;
+  Stats stats_;
+
+  DISABLE_COPY_AND_ASSIGN(HostMemoryPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
@@ -74,6 +74,10 @@ inline bool ReadProtoFromBinaryFile(const string& filename, Message* proto) {
   return ReadProtoFromBinaryFile(filename.c_str(), proto);
 }
 
+/// @brief Parse a proto serialized in memory, with the same size limit as
+///        ReadProtoFromBinaryFile().
+bool ReadProtoFromBinaryArray(const char* data, size_t size, Message* proto);
+
 inline void ReadProtoFromBinaryFileOrDie(const char* filename, Message* proto) {
   CHECK(ReadProtoFromBinaryFile(filename, proto));
 }
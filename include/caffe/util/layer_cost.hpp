@@ -0,0 +1,39 @@
+#ifndef CAFFE_UTIL_LAYER_COST_HPP_
+#define CAFFE_UTIL_LAYER_COST_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Estimated arithmetic and memory traffic of one pass of a layer.
+ *
+ * Multiply-adds count as two flops and transcendental functions as one.
+ * Bytes count every blob element read or written once, ignoring caches.
+ */
+struct LayerCost {
+  LayerCost()
+      : forward_flops(0), forward_bytes(0),
+        backward_flops(0), backward_bytes(0) {}
+
+  int64_t forward_flops;
+  int64_t forward_bytes;
+  int64_t backward_flops;
+  int64_t backward_bytes;
+};
+
+/**
+ * @brief Estimate the cost of a set up layer from its type, parameters and
+ *        blob shapes. Layers that only share their bottom data cost nothing,
+ *        unknown layers are treated as elementwise.
+ */
+template <typename Dtype>
+LayerCost EstimateLayerCost(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_LAYER_COST_HPP_
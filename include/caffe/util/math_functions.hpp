@@ -36,6 +36,13 @@ void caffe_cpu_axpby(const int N, const Dtype alpha, const Dtype* X,
 template <typename Dtype>
 void caffe_copy(const int N, const Dtype *X, Dtype *Y);
 
+// Whether the N elements at X and the M elements at Y overlap.
+template <typename Dtype>
+inline bool caffe_overlap(const int N, const Dtype* X, const int M,
+    const Dtype* Y) {
+  return X < Y + M && Y < X + N;
+}
+
 template <typename Dtype>
 void caffe_set(const int N, const Dtype alpha, Dtype *X);
 
@@ -85,12 +92,24 @@ void caffe_rng_bernoulli(const int n, const Dtype p, int* r);
 template <typename Dtype>
 void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r);
 
+// The draws caffe_rng_bernoulli would make, packed: draw i is bit i % 32 of
+// r[i / 32], and the bits past n are zero.
+template <typename Dtype>
+void caffe_rng_bernoulli_bits(const int n, const Dtype p, unsigned int* r);
+
 template <typename Dtype>
 void caffe_exp(const int n, const Dtype* a, Dtype* y);
 
 template <typename Dtype>
 void caffe_log(const int n, const Dtype* a, Dtype* y);
 
+template <typename Dtype>
+void caffe_tanh(const int n, const Dtype* a, Dtype* y);
+
+// y = 1 / (1 + exp(-a))
+template <typename Dtype>
+void caffe_sigmoid(const int n, const Dtype* a, Dtype* y);
+
 template <typename Dtype>
 void caffe_abs(const int n, const Dtype* a, Dtype* y);
 
@@ -142,6 +161,15 @@ DEFINE_CAFFE_CPU_UNARY_FUNC(fabs, y[i] = std::fabs(x[i]));
 template <typename Dtype>
 void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+// Round each element of x to the nearest (ties to even) value representable
+// in IEEE half precision or in bfloat16, emulating reduced-precision storage.
+// Values beyond the range of the format become +/-inf.
+template <typename Dtype>
+void caffe_cpu_round_half(const int n, const Dtype* x, Dtype* y);
+
+template <typename Dtype>
+void caffe_cpu_round_bfloat16(const int n, const Dtype* x, Dtype* y);
+
 #ifndef CPU_ONLY  // GPU
 
 // Decaf gpu gemm provides an interface that is almost the same as the cpu
@@ -246,6 +274,12 @@ void caffe_gpu_fabs(const int n, const Dtype* x, Dtype* y);
 template <typename Dtype>
 void caffe_gpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+template <typename Dtype>
+void caffe_gpu_round_half(const int n, const Dtype* x, Dtype* y);
+
+template <typename Dtype>
+void caffe_gpu_round_bfloat16(const int n, const Dtype* x, Dtype* y);
+
 #define DEFINE_AND_INSTANTIATE_GPU_UNARY_FUNC(name, operation) \
 template<typename Dtype> \
 __global__ void name##_kernel(const int n, const Dtype* x, Dtype* y) { \
@@ -0,0 +1,114 @@
+#ifndef CAFFE_UTIL_PHILOX_HPP_
+#define CAFFE_UTIL_PHILOX_HPP_
+
+#include <stdint.h>
+
+namespace caffe {
+
+/**
+ * @brief The Philox4x32-10 counter-based random number generator of Salmon
+ *        et al., "Parallel Random Numbers: As Easy as 1, 2, 3" (SC 2011).
+ *
+ * Each 64-bit counter gives a block of four 32-bit words under a 64-bit key.
+ * Blocks are computed independently of each other, so that a stream can be
+ * generated by any number of threads, or recomputed from any point, with
+ * the same result.
+ */
+class Philox {
+ public:
+  explicit Philox(uint64_t key)
+      : key0_(static_cast<uint32_t>(key)),
+        key1_(static_cast<uint32_t>(key >> 32)) {}
+
+  /// @brief The four words of the block at counter.
+  inline void Generate(uint64_t counter, uint32_t* words) const {
+    GenerateBlocks<1>(counter, words);
+  }
+
+  /// @brief The num_words words of the stream from the block at counter on.
+  inline void Fill(uint64_t counter, int num_words, uint32_t* words) const {
+    int i = 0;
+    for (; i + 4 * kLanes <= num_words; i += 4 * kLanes, counter += kLanes) {
+      GenerateBlocks<kLanes>(counter, words + i);
+    }
+    for (; i + 4 <= num_words; i += 4) {
+      Generate(counter++, words + i);
+    }
+    if (i < num_words) {
+      uint32_t block[4];
+      Generate(counter, block);
+      for (int j = 0; i < num_words; ++i, ++j) {
+        words[i] = block[j];
+      }
+    }
+  }
+
+ private:
+  // Blocks generated together, so that their multiplications overlap.
+  static const int kLanes = 8;
+
+  // The num_blocks blocks from counter on.
+  template <int num_blocks>
+  inline void GenerateBlocks(uint64_t counter, uint32_t* words) const {
+    uint32_t x0[num_blocks], x1[num_blocks], x2[num_blocks], x3[num_blocks];
+    for (int i = 0; i < num_blocks; ++i) {
+      x0[i] = static_cast<uint32_t>(counter + i);
+      x1[i] = static_cast<uint32_t>((counter + i) >> 32);
+      x2[i] = 0;
+      x3[i] = 0;
+    }
+    uint32_t k0 = key0_;
+    uint32_t k1 = key1_;
+    for (int round = 0; round < 10; ++round) {
+      for (int i = 0; i < num_blocks; ++i) {
+        const uint64_t product0 = static_cast<uint64_t>(0xD2511F53) * x0[i];
+        const uint64_t product1 = static_cast<uint64_t>(0xCD9E8D57) * x2[i];
+        x0[i] = static_cast<uint32_t>(product1 >> 32) ^ x1[i] ^ k0;
+        x1[i] = static_cast<uint32_t>(product1);
+        x2[i] = static_cast<uint32_t>(product0 >> 32) ^ x3[i] ^ k1;
+        x3[i] = static_cast<uint32_t>(product0);
+      }
+      k0 += 0x9E3779B9;
+      k1 += 0xBB67AE85;
+    }
+    for (int i = 0; i < num_blocks; ++i) {
+      words[4 * i] = x0[i];
+      words[4 * i + 1] = x1[i];
+      words[4 * i + 2] = x2[i];
+      words[4 * i + 3] = x3[i];
+    }
+  }
+
+  uint32_t key0_;
+  uint32_t key1_;
+};
+
+/**
+ * @brief A Philox stream read one word at a time, for the occasional draws
+ *        of e.g. the DataTransformer.
+ */
+class PhiloxStream {
+ public:
+  explicit PhiloxStream(uint64_t key)
+      : philox_(key), counter_(0), next_(kBlockWords) {}
+
+  inline uint32_t operator()() {
+    if (next_ == kBlockWords) {
+      philox_.Generate(counter_++, block_);
+      next_ = 0;
+    }
+    return block_[next_++];
+  }
+
+ private:
+  static const int kBlockWords = 4;
+
+  Philox philox_;
+  uint64_t counter_;
+  uint32_t block_[kBlockWords];
+  int next_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PHILOX_HPP_
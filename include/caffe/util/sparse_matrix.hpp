@@ -0,0 +1,82 @@
+#ifndef CAFFE_UTIL_SPARSE_MATRIX_HPP_
+#define CAFFE_UTIL_SPARSE_MATRIX_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A row-major matrix in compressed sparse row (CSR) form, with the
+ *        products by dense matrices the layers need.
+ *
+ * Dense matrices are row-major, and products overwrite their output.
+ */
+template <typename Dtype>
+class SparseMatrix {
+ public:
+  SparseMatrix() : rows_(0), cols_(0), row_start_(1, 0) {}
+
+  /// @brief Keep the nonzero values of a dense rows x cols matrix.
+  void FromDense(int rows, int cols, const Dtype* dense);
+  /// @brief Free the storage, leaving an empty matrix.
+  void Clear();
+
+  inline int rows() const { return rows_; }
+  inline int cols() const { return cols_; }
+  inline int nnz() const { return values_.size(); }
+
+  /// @brief C = A[row_begin:row_end] B, with B cols x n.
+  void MultiplyRows(int row_begin, int row_end, int n, const Dtype* B,
+      Dtype* C) const;
+  /// @brief C = B A^T, with B m x cols; for m > 1, buffer holds
+  ///        (rows + cols) m values.
+  void MultiplyTransposedBy(int m, const Dtype* B, Dtype* C,
+      Dtype* buffer) const;
+  /// @brief C = B A, with B m x rows.
+  void MultiplyBy(int m, const Dtype* B, Dtype* C) const;
+
+ private:
+  int rows_;
+  int cols_;
+  vector<int> row_start_;
+  vector<int> col_index_;
+  vector<Dtype> values_;
+};
+
+/**
+ * @brief The CSR form of a weight blob, for layers to multiply by it instead
+ *        of the dense weights when enough of them are zero, e.g. after
+ *        pruning.
+ *
+ * The CSR form is rebuilt only when the weights may have been written, as
+ * told by SyncedMemory::version(); writes through pointers obtained earlier
+ * are not seen. Layers whose weights share memory, like the replicas of an
+ * InferenceEngine, share one CSR form.
+ */
+template <typename Dtype>
+class SparseWeights {
+ public:
+  SparseWeights() : version_(0), threshold_(0) {}
+
+  /**
+   * @brief The weights as a rows x cols CSR matrix if at least threshold of
+   *        them are zero, NULL otherwise.
+   */
+  const SparseMatrix<Dtype>* Get(const Blob<Dtype>& weights, int rows,
+      int cols, float threshold);
+
+ private:
+  shared_ptr<SyncedMemory> source_;
+  int64_t version_;
+  float threshold_;
+  /// NULL while the weights are dense.
+  shared_ptr<const SparseMatrix<Dtype> > matrix_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SPARSE_MATRIX_HPP_
@@ -0,0 +1,96 @@
+#ifndef CAFFE_UTIL_TRACE_HPP_
+#define CAFFE_UTIL_TRACE_HPP_
+
+#include <boost/atomic.hpp>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/// @brief One timed span recorded by Trace, times in microseconds.
+struct TraceEvent {
+  string name;
+  const char* category;
+  int64_t start;
+  int64_t duration;
+  int thread;
+};
+
+/**
+ * @brief Records timed spans into per-thread ring buffers and exports them
+ *        in the Chrome trace-event format (chrome://tracing, Perfetto).
+ *
+ * Net records the forward and backward pass of every layer, data layers the
+ * prefetching of each batch and the time Forward waits for it, and Solver
+ * each iteration and parameter update. Recording is off by default; when
+ * disabled each instrumentation point costs a single branch. When enabled
+ * each thread keeps its last capacity events, so a trace can be left on in
+ * long runs and dumped at any time.
+ *
+ * Times are taken on the host: in GPU mode they measure kernel launches
+ * unless the layer synchronizes.
+ */
+class Trace {
+ public:
+  /**
+   * @brief Start recording, keeping up to capacity events per thread. The
+   *        capacity of a thread is fixed by its first event.
+   */
+  static void Enable(int capacity = 1 << 16);
+  /// @brief Stop recording, keeping the events recorded so far.
+  static void Disable();
+  inline static bool enabled() {
+    return enabled_.load(boost::memory_order_acquire);
+  }
+  /// @brief Drop all the events recorded so far.
+  static void Clear();
+
+  /// @brief Name the calling thread in the exported trace.
+  static void SetThreadName(const string& name);
+  /// @brief Microseconds since the trace was first enabled.
+  static int64_t Now();
+  static void Record(const char* category, const string& name,
+      int64_t start, int64_t end);
+
+  /// @brief All the recorded events, ordered by start time.
+  static void Events(vector<TraceEvent>* events);
+  static void WriteChromeTrace(const string& filename);
+
+ private:
+  // Read by every recording thread; set after the epoch and capacity, which
+  // it publishes.
+  static boost::atomic<bool> enabled_;
+};
+
+/**
+ * @brief Records the span of its own lifetime in the calling thread's trace
+ *        buffer, if tracing is enabled when it is constructed.
+ */
+class TraceScope {
+ public:
+  TraceScope(const char* category, const string& name)
+      : category_(Trace::enabled() ? category : NULL),
+        start_(category_ ? Trace::Now() : 0) {
+    if (category_) {
+      name_ = name;
+    }
+  }
+  ~TraceScope() {
+    if (category_) {
+      Trace::Record(category_, name_, start_, Trace::Now());
+    }
+  }
+
+ private:
+  const char* const category_;
+  const int64_t start_;
+  string name_;
+
+  DISABLE_COPY_AND_ASSIGN(TraceScope);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TRACE_HPP_
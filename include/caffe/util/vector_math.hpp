@@ -0,0 +1,31 @@
+#ifndef CAFFE_UTIL_VECTOR_MATH_HPP_
+#define CAFFE_UTIL_VECTOR_MATH_HPP_
+
+namespace caffe {
+
+// Single precision transcendental functions over arrays, computed a vector of
+// lanes at a time with branch-free polynomial approximations. On x86 the
+// widest of AVX-512, AVX2 with FMA and the SSE2 baseline the CPU supports is
+// picked at run time; elsewhere the compiler lowers the vectors to what the
+// target has. The results do not depend on the lane count, but may differ in
+// the last bit where FMA is used. They are serial; a and y may be the same.
+//
+// The error bounds are measured against libm in double precision over all
+// finite inputs. Special values follow libm: NaN gives NaN, and results round
+// to 0 and +-inf where they underflow and overflow.
+
+/// @brief y = exp(a), within 1 ulp, including subnormal results.
+void vector_exp(const int n, const float* a, float* y);
+
+/// @brief y = log(a), within 1 ulp. a = 0 gives -inf and a < 0 gives NaN.
+void vector_log(const int n, const float* a, float* y);
+
+/// @brief y = tanh(a), within 1 ulp.
+void vector_tanh(const int n, const float* a, float* y);
+
+/// @brief y = 1 / (1 + exp(-a)), within 2 ulp.
+void vector_sigmoid(const int n, const float* a, float* y);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_VECTOR_MATH_HPP_
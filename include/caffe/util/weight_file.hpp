@@ -0,0 +1,71 @@
+#ifndef CAFFE_UTIL_WEIGHT_FILE_HPP_
+#define CAFFE_UTIL_WEIGHT_FILE_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A flat file of trained weights that is memory mapped rather than
+ *        parsed, so that nets can point their parameter blobs straight into
+ *        the page cache.
+ *
+ * The file holds a magic string and version, an index of layers, each with
+ * the type, shape and file offset of its params, then the param data in
+ * host byte order, every param aligned to kAlignment bytes. Files ending in
+ * kExtension are loaded this way by Net::CopyTrainedLayersFrom(); use the
+ * caffemodel_to_weights tool to convert a .caffemodel.
+ *
+ * The mapping is private: pages are read on first use and shared with every
+ * other process mapping the same file until a param is written, e.g. by a
+ * solver update, at which point the written pages are copied.
+ */
+class WeightFile {
+ public:
+  enum Type { FLOAT = 0, DOUBLE = 1 };
+  struct Param {
+    Type type;
+    vector<int> shape;
+    size_t count;
+    /// Points into the mapping.
+    void* data;
+  };
+  struct Layer {
+    string name;
+    vector<Param> params;
+  };
+
+  static const char kMagic[8];
+  static const uint32_t kVersion = 1;
+  static const size_t kAlignment = 64;
+  static const char kExtension[];
+
+  /// @brief Map filename and parse its index; fails on a malformed file.
+  explicit WeightFile(const string& filename);
+
+  inline const vector<Layer>& layers() const { return layers_; }
+  /// @brief Keeps the file mapped for as long as a copy of it is held.
+  inline const shared_ptr<void>& mapping() const { return mapping_; }
+  inline size_t size() const { return size_; }
+
+  /// @brief Write the params of the layers of a trained NetParameter, e.g.
+  ///        a .caffemodel, to filename.
+  static void Write(const NetParameter& param, const string& filename);
+  /// @brief Whether filename ends in kExtension.
+  static bool IsWeightFile(const string& filename);
+
+ private:
+  shared_ptr<void> mapping_;
+  size_t size_;
+  vector<Layer> layers_;
+
+  DISABLE_COPY_AND_ASSIGN(WeightFile);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WEIGHT_FILE_HPP_
@@ -0,0 +1,88 @@
+#ifndef CAFFE_UTIL_WEIGHT_LOADER_HPP_
+#define CAFFE_UTIL_WEIGHT_LOADER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+
+namespace boost {
+class mutex;
+class condition_variable;
+class thread;
+}
+
+namespace caffe {
+
+/**
+ * @brief Loads the params of a trained binary NetParameter, e.g. a
+ *        .caffemodel, one layer at a time and from several threads.
+ *
+ * The file is read once and its layers are indexed without being decoded.
+ * A layer is decoded and copied into its target blobs by Load(), either on
+ * the calling thread or, when another thread is already loading it, by
+ * waiting for that thread. Start() loads the remaining layers in order on
+ * background threads, so that a net can run the layers it reaches first
+ * while the rest are still being decoded. Layers without targets are never
+ * decoded.
+ *
+ * Files with V0 or V1 layers must be upgraded as a whole and cannot be
+ * indexed; see indexed().
+ */
+template <typename Dtype>
+class WeightLoader {
+ public:
+  explicit WeightLoader(const string& filename);
+  ~WeightLoader();
+
+  /// @brief False if the file holds V0 or V1 layers and nothing was indexed.
+  inline bool indexed() const { return indexed_; }
+  inline int num_layers() const { return layers_.size(); }
+  inline const string& layer_name(int i) const { return layers_[i].name; }
+
+  /**
+   * @brief Set the blobs the params of layer i are copied to. A NULL target
+   *        skips its param. Must precede Start() and Load().
+   */
+  void SetTargets(int i, const vector<shared_ptr<Blob<Dtype> > >& blobs);
+  /// @brief Load the layers on num_threads background threads.
+  void Start(int num_threads);
+  /// @brief Return once layer i is loaded. Thread-safe.
+  void Load(int i);
+  /// @brief Return once every layer is loaded. Thread-safe.
+  void LoadAll();
+
+ private:
+  enum State { LOADED, PENDING, LOADING };
+  struct Layer {
+    string name;
+    // Bytes of the serialized LayerParameter within data_.
+    size_t offset;
+    size_t size;
+    vector<shared_ptr<Blob<Dtype> > > targets;
+    State state;
+  };
+
+  void Decode(const Layer& layer);
+  void ThreadEntry();
+
+  string filename_;
+  // The file, released once every layer is loaded.
+  string data_;
+  vector<Layer> layers_;
+  bool indexed_;
+  int num_pending_;
+  // The next layer for the background threads to load.
+  int next_;
+  bool stop_;
+  shared_ptr<boost::mutex> mutex_;
+  shared_ptr<boost::condition_variable> loaded_;
+  vector<shared_ptr<boost::thread> > threads_;
+
+  DISABLE_COPY_AND_ASSIGN(WeightLoader);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WEIGHT_LOADER_HPP_
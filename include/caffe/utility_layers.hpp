@@ -54,6 +54,8 @@ class UnifiedLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Unified"; }
+  // Reshape writes the label index top blob.
+  virtual inline bool ReshapeDependsOnlyOnShapes() const { return false; }
   virtual inline int MinBottomBlobs() const { return 1; }
   /**
   * UnifiedDataLayer need 2 top blobs: Data+Label_index
@@ -96,6 +98,8 @@ class DispatchLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Dispatch"; }
+  // Reshape reads the label index bottom blob.
+  virtual inline bool ReshapeDependsOnlyOnShapes() const { return false; }
   // Dispatch 1 bottom blob to N top blobs
   virtual inline int MinTopBlobs() const { return 1; }
   // here 2 bottom blobs contain: Data + Label_index
@@ -18,6 +18,7 @@
 #include "caffe/layers/memory_data_layer.hpp"
 #include "caffe/layers/python_layer.hpp"
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/util/math_functions.hpp"
 
 // Temporary solution for numpy < 1.7 versions: old macro, no promises.
 // You're strongly advised to upgrade to >= 1.7.
@@ -101,6 +102,18 @@ void Net_Save(const Net<Dtype>& net, string filename) {
   WriteProtoToBinaryFile(net_param, filename.c_str());
 }
 
+// Reserve takes one sequence of dimensions per net input.
+void Net_Reserve(Net<Dtype>* net, bp::object shapes_obj) {
+  vector<vector<int> > shapes(bp::len(shapes_obj));
+  for (int i = 0; i < shapes.size(); ++i) {
+    bp::object shape = shapes_obj[i];
+    for (int j = 0; j < bp::len(shape); ++j) {
+      shapes[i].push_back(bp::extract<int>(shape[j]));
+    }
+  }
+  net->Reserve(shapes);
+}
+
 void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
     bp::object labels_obj) {
   // check that this network has an input MemoryDataLayer
@@ -133,6 +146,76 @@ void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
       PyArray_DIMS(data_arr)[0]);
 }
 
+shared_ptr<InferenceEngine<Dtype> > InferenceEngine_Init_Idle(
+    string param_file, string pretrained_param_file, int num_workers,
+    int max_batch_size, int max_latency_us, int idle_release_ms) {
+  CheckFile(param_file);
+  CheckFile(pretrained_param_file);
+
+  shared_ptr<InferenceEngine<Dtype> > engine(new InferenceEngine<Dtype>(
+      param_file, pretrained_param_file, num_workers, max_batch_size,
+      max_latency_us, idle_release_ms));
+  return engine;
+}
+
+shared_ptr<InferenceEngine<Dtype> > InferenceEngine_Init(
+    string param_file, string pretrained_param_file, int num_workers,
+    int max_batch_size, int max_latency_us) {
+  return InferenceEngine_Init_Idle(param_file, pretrained_param_file,
+      num_workers, max_batch_size, max_latency_us, 0);
+}
+
+// Predict on a list of arrays, returning a list of arrays. The inputs and
+// outputs are copied so the GIL can be released while waiting, letting
+// requests from several Python threads be batched together.
+bp::list InferenceEngine_Predict(InferenceEngine<Dtype>* engine,
+    bp::list inputs_obj) {
+  const int num_inputs = bp::len(inputs_obj);
+  if (num_inputs != engine->net()->num_inputs()) {
+    throw std::runtime_error("predict takes one array per net input");
+  }
+  vector<shared_ptr<Blob<Dtype> > > inputs, outputs;
+  vector<Blob<Dtype>*> input_vec, output_vec;
+  for (int i = 0; i < num_inputs; ++i) {
+    bp::object input_obj = inputs_obj[i];
+    if (!PyArray_Check(input_obj.ptr())) {
+      throw std::runtime_error("predict inputs must be arrays");
+    }
+    PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(input_obj.ptr());
+    if (!(PyArray_FLAGS(arr) & NPY_ARRAY_C_CONTIGUOUS)) {
+      throw std::runtime_error("predict inputs must be C contiguous");
+    }
+    if (PyArray_TYPE(arr) != NPY_DTYPE) {
+      throw std::runtime_error("predict inputs must be float32");
+    }
+    vector<int> shape(PyArray_DIMS(arr),
+        PyArray_DIMS(arr) + PyArray_NDIM(arr));
+    inputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
+    caffe_copy(inputs[i]->count(), static_cast<Dtype*>(PyArray_DATA(arr)),
+        inputs[i]->mutable_cpu_data());
+    input_vec.push_back(inputs[i].get());
+  }
+  for (int i = 0; i < engine->net()->num_outputs(); ++i) {
+    outputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    output_vec.push_back(outputs[i].get());
+  }
+  Py_BEGIN_ALLOW_THREADS
+  engine->Predict(input_vec, output_vec);
+  Py_END_ALLOW_THREADS
+  bp::list outputs_obj;
+  for (int i = 0; i < outputs.size(); ++i) {
+    vector<npy_intp> dims(outputs[i]->shape().begin(),
+        outputs[i]->shape().end());
+    PyObject* arr_obj = PyArray_SimpleNew(dims.size(), dims.data(),
+        NPY_DTYPE);
+    caffe_copy(outputs[i]->count(), outputs[i]->cpu_data(),
+        static_cast<Dtype*>(PyArray_DATA(
+            reinterpret_cast<PyArrayObject*>(arr_obj))));
+    outputs_obj.append(bp::object(bp::handle<>(arr_obj)));
+  }
+  return outputs_obj;
+}
+
 Solver<Dtype>* GetSolverFromFile(const string& filename) {
   SolverParameter param;
   ReadSolverParamsFromTextFileOrDie(filename, &param);
@@ -219,6 +302,7 @@ BOOST_PYTHON_MODULE(_caffe) {
   bp::def("set_mode_cpu", &set_mode_cpu);
   bp::def("set_mode_gpu", &set_mode_gpu);
   bp::def("set_device", &Caffe::SetDevice);
+  bp::def("set_host_memory_pool", &Caffe::set_host_memory_pool);
 
   bp::def("layer_type_list", &LayerRegistry<Dtype>::LayerTypeList);
 
@@ -229,6 +313,8 @@ BOOST_PYTHON_MODULE(_caffe) {
     .def("_forward", &Net<Dtype>::ForwardFromTo)
     .def("_backward", &Net<Dtype>::BackwardFromTo)
     .def("reshape", &Net<Dtype>::Reshape)
+    .def("reserve", &Net_Reserve)
+    .def("release_blobs", &Net<Dtype>::ReleaseBlobs)
     // The cast is to select a particular overload.
     .def("copy_from", static_cast<void (Net<Dtype>::*)(const string)>(
         &Net<Dtype>::CopyTrainedLayersFrom))
@@ -286,6 +372,31 @@ BOOST_PYTHON_MODULE(_caffe) {
 
   bp::class_<LayerParameter>("LayerParameter", bp::no_init);
 
+  bp::class_<LatencyHistogram>("LatencyHistogram", bp::no_init)
+    .add_property("count", &LatencyHistogram::count)
+    .add_property("min", &LatencyHistogram::min)
+    .add_property("max", &LatencyHistogram::max)
+    .add_property("mean", &LatencyHistogram::Mean)
+    .def("percentile", &LatencyHistogram::Percentile)
+    .def("__str__", &LatencyHistogram::ToString);
+
+  bp::class_<InferenceEngine<Dtype>, shared_ptr<InferenceEngine<Dtype> >,
+    boost::noncopyable>("InferenceEngine", bp::no_init)
+    .def("__init__", bp::make_constructor(&InferenceEngine_Init))
+    .def("__init__", bp::make_constructor(&InferenceEngine_Init_Idle))
+    .def("predict", &InferenceEngine_Predict)
+    .add_property("net", bp::make_function(&InferenceEngine<Dtype>::net,
+        bp::return_value_policy<bp::copy_const_reference>()))
+    .add_property("num_workers", &InferenceEngine<Dtype>::num_workers)
+    .add_property("max_batch_size", &InferenceEngine<Dtype>::max_batch_size)
+    .add_property("max_latency_us", &InferenceEngine<Dtype>::max_latency_us)
+    .add_property("idle_release_ms",
+        &InferenceEngine<Dtype>::idle_release_ms)
+    .add_property("latency", &InferenceEngine<Dtype>::latency)
+    .add_property("num_requests", &InferenceEngine<Dtype>::num_requests)
+    .add_property("num_batches", &InferenceEngine<Dtype>::num_batches)
+    .def("reset_stats", &InferenceEngine<Dtype>::ResetStats);
+
   bp::class_<Solver<Dtype>, shared_ptr<Solver<Dtype> >, boost::noncopyable>(
     "Solver", bp::no_init)
     .add_property("net", &Solver<Dtype>::net)
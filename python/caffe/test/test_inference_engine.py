@@ -0,0 +1,78 @@
+import unittest
+import tempfile
+import threading
+import os
+import numpy as np
+
+import caffe
+
+
+def inference_net_file():
+    """Make a net prototxt with an Input layer, returning the name of the
+    (temporary) file."""
+
+    f = tempfile.NamedTemporaryFile(mode='w+', delete=False)
+    f.write("""name: 'inferencenet'
+    layer { type: 'Input' name: 'data' top: 'data'
+      input_param { shape { dim: 1 dim: 2 dim: 3 dim: 4 } } }
+    layer { type: 'Convolution' name: 'conv' bottom: 'data' top: 'conv'
+      convolution_param { num_output: 5 kernel_size: 2
+        weight_filler { type: 'gaussian' std: 1 }
+        bias_filler { type: 'constant' value: 2 } } }
+    layer { type: 'InnerProduct' name: 'ip' bottom: 'conv' top: 'ip'
+      inner_product_param { num_output: 7
+        weight_filler { type: 'gaussian' std: 1 } } }""")
+    f.close()
+    return f.name
+
+
+class TestInferenceEngine(unittest.TestCase):
+    def setUp(self):
+        self.net_file = inference_net_file()
+        self.net = caffe.Net(self.net_file, caffe.TEST)
+        f = tempfile.NamedTemporaryFile(mode='w+', delete=False)
+        f.close()
+        self.weights_file = f.name
+        self.net.save(self.weights_file)
+
+    def tearDown(self):
+        os.remove(self.net_file)
+        os.remove(self.weights_file)
+
+    def expected(self, data):
+        self.net.blobs['data'].reshape(*data.shape)
+        self.net.blobs['data'].data[...] = data
+        return self.net.forward()['ip'].copy()
+
+    def test_predict(self):
+        engine = caffe.InferenceEngine(self.net_file, self.weights_file,
+                                       1, 1, 0)
+        data = np.random.randn(3, 2, 3, 4).astype(np.float32)
+        outputs = engine.predict([data])
+        self.assertEqual(len(outputs), 1)
+        self.assertTrue(np.allclose(outputs[0], self.expected(data)))
+        self.assertEqual(engine.num_requests, 1)
+        self.assertEqual(engine.latency.count, 1)
+
+    def test_batched_predict(self):
+        num_threads = 4
+        engine = caffe.InferenceEngine(self.net_file, self.weights_file,
+                                       2, num_threads, 1000000)
+        data = [np.random.randn(1, 2, 3, 4).astype(np.float32)
+                for i in range(num_threads)]
+        outputs = [None] * num_threads
+
+        def predict(i):
+            outputs[i] = engine.predict([data[i]])[0]
+        threads = [threading.Thread(target=predict, args=(i,))
+                   for i in range(num_threads)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        for i in range(num_threads):
+            self.assertTrue(np.allclose(outputs[i], self.expected(data[i]),
+                                        atol=1e-5))
+        self.assertEqual(engine.num_requests, num_threads)
+        engine.reset_stats()
+        self.assertEqual(engine.num_requests, 0)
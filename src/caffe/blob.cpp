@@ -1,13 +1,24 @@
+#include <boost/thread.hpp>
 #include <climits>
+#include <cstring>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/blob_compression.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+static boost::mutex shape_version_mutex_;
+static int64_t last_shape_version_ = 0;
+
+static int64_t NextShapeVersion() {
+  boost::mutex::scoped_lock lock(shape_version_mutex_);
+  return ++last_shape_version_;
+}
+
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
     const int width) {
@@ -22,6 +33,8 @@ void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const vector<int>& shape) {
   CHECK_LE(shape.size(), kMaxBlobAxes);
+  if (shape_data_ && shape == shape_) { return; }
+  shape_version_ = NextShapeVersion();
   count_ = 1;
   shape_.resize(shape.size());
   if (!shape_data_ || shape_data_->size() < shape.size() * sizeof(int)) {
@@ -61,14 +74,14 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), shape_version_(0) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), shape_version_(0) {
   Reshape(shape);
 }
 
@@ -135,13 +148,104 @@ Dtype* Blob<Dtype>::mutable_gpu_diff() {
 template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
-  data_ = other.data();
+  if (data_ != other.data()) {
+    shape_version_ = NextShapeVersion();
+    data_ = other.data();
+  }
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
-  diff_ = other.diff();
+  if (diff_ != other.diff()) {
+    shape_version_ = NextShapeVersion();
+    diff_ = other.diff();
+  }
+}
+
+// A SyncedMemory using the size bytes at data, which holder keeps valid,
+// with the contents of memory copied in.
+static shared_ptr<SyncedMemory> MemoryView(void* data, size_t size,
+    const shared_ptr<SyncedMemory>& holder,
+    const shared_ptr<SyncedMemory>& memory) {
+  if (memory->head() != SyncedMemory::UNINITIALIZED) {
+    memcpy(data, memory->cpu_data(), size);
+  }
+  shared_ptr<SyncedMemory> view(new SyncedMemory(size));
+  view->set_cpu_data(data, holder);
+  return view;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDataRange(Blob* other, int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other->count());
+  // Growing past the view must reallocate.
+  capacity_ = count_;
+  shape_version_ = NextShapeVersion();
+  data_ = MemoryView(other->mutable_cpu_data() + offset,
+      count_ * sizeof(Dtype), other->data(), data_);
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDiffRange(Blob* other, int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other->count());
+  capacity_ = count_;
+  shape_version_ = NextShapeVersion();
+  diff_ = MemoryView(other->mutable_cpu_diff() + offset,
+      count_ * sizeof(Dtype), other->diff(), diff_);
+}
+
+template <typename Dtype>
+void Blob<Dtype>::Release() {
+  shape_version_ = NextShapeVersion();
+  data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+}
+
+template <typename Dtype>
+void Blob<Dtype>::Reserve(int count) {
+  CHECK_GE(count, 0);
+  if (count > capacity_) {
+    shape_version_ = NextShapeVersion();
+    capacity_ = count;
+    data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  }
+}
+
+// Copy the first size bytes of memory to a new SyncedMemory of that size,
+// on the side holding the latest copy.
+static shared_ptr<SyncedMemory> ShrinkMemory(
+    const shared_ptr<SyncedMemory>& memory, size_t size) {
+  shared_ptr<SyncedMemory> shrunk(new SyncedMemory(size));
+  switch (memory->head()) {
+  case SyncedMemory::UNINITIALIZED:
+    break;
+  case SyncedMemory::HEAD_AT_CPU:
+    memcpy(shrunk->mutable_cpu_data(), memory->cpu_data(), size);
+    break;
+  case SyncedMemory::HEAD_AT_GPU:
+  case SyncedMemory::SYNCED:
+#ifndef CPU_ONLY
+    caffe_gpu_memcpy(size, memory->gpu_data(), shrunk->mutable_gpu_data());
+#else
+    NO_GPU;
+#endif
+    break;
+  }
+  return shrunk;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShrinkToFit() {
+  if (capacity_ > count_) {
+    shape_version_ = NextShapeVersion();
+    capacity_ = count_;
+    data_ = ShrinkMemory(data_, capacity_ * sizeof(Dtype));
+    diff_ = ShrinkMemory(diff_, capacity_ * sizeof(Dtype));
+  }
 }
 
 // The "update" method is used for parameter blobs in a Net, which are stored
@@ -467,7 +571,9 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
   // copy data
   Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
+  if (proto.has_compressed_data()) {
+    DecompressBlobData(proto.compressed_data(), count_, data_vec);
+  } else if (proto.double_data_size() > 0) {
     CHECK_EQ(count_, proto.double_data_size());
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.double_data(i);
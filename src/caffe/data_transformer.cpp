@@ -8,7 +8,7 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
-#include "caffe/util/rng.hpp"
+#include "caffe/util/philox.hpp"
 
 namespace caffe {
 
@@ -524,8 +524,9 @@ void DataTransformer<Dtype>::InitRand() {
   const bool needs_rand = param_.mirror() ||
       (phase_ == TRAIN && param_.crop_size());
   if (needs_rand) {
-    const unsigned int rng_seed = caffe_rng_rand();
-    rng_.reset(new Caffe::RNG(rng_seed));
+    const uint64_t high = caffe_rng_rand();
+    const uint64_t low = caffe_rng_rand();
+    rng_.reset(new PhiloxStream(high << 32 | low));
   } else {
     rng_.reset();
   }
@@ -535,9 +536,7 @@ template <typename Dtype>
 int DataTransformer<Dtype>::Rand(int n) {
   CHECK(rng_);
   CHECK_GT(n, 0);
-  caffe::rng_t* rng =
-      static_cast<caffe::rng_t*>(rng_->generator());
-  return ((*rng)() % n);
+  return ((*rng_)() % n);
 }
 
 INSTANTIATE_CLASS(DataTransformer);
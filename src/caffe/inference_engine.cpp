@@ -0,0 +1,319 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "caffe/inference_engine.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/trace.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+namespace caffe {
+
+using boost::posix_time::microsec_clock;
+using boost::posix_time::microseconds;
+using boost::posix_time::ptime;
+
+template <typename Dtype>
+InferenceEngine<Dtype>::InferenceEngine(const string& param_file,
+    const string& trained_file, int num_workers, int max_batch_size,
+    int max_latency_us, int idle_release_ms)
+    : max_batch_size_(max_batch_size), max_latency_us_(max_latency_us),
+      idle_release_ms_(idle_release_ms) {
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(param_file, &param);
+  param.mutable_state()->set_phase(TEST);
+  nets_.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(param)));
+  // Serve while the tail of the model is still being loaded.
+  nets_[0]->CopyTrainedLayersFromLazily(trained_file,
+      std::max<int>(boost::thread::hardware_concurrency(), 1));
+  Init(param, num_workers);
+}
+
+template <typename Dtype>
+InferenceEngine<Dtype>::InferenceEngine(const NetParameter& param,
+    int num_workers, int max_batch_size, int max_latency_us,
+    int idle_release_ms)
+    : max_batch_size_(max_batch_size), max_latency_us_(max_latency_us),
+      idle_release_ms_(idle_release_ms) {
+  NetParameter test_param(param);
+  test_param.mutable_state()->set_phase(TEST);
+  nets_.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(test_param)));
+  Init(test_param, num_workers);
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::Init(const NetParameter& param,
+    int num_workers) {
+  CHECK_GT(num_workers, 0) << "InferenceEngine needs at least one worker.";
+  CHECK_GT(max_batch_size_, 0) << "max_batch_size must be positive.";
+  CHECK_GE(max_latency_us_, 0) << "max_latency_us must be non-negative.";
+  CHECK_GE(idle_release_ms_, 0) << "idle_release_ms must be non-negative.";
+  pending_ = NULL;
+  stats_mutex_.reset(new boost::mutex());
+  ResetStats();
+  gather_token_.push(0);
+  // Replicas share the root weights from the start, without filling their
+  // own.
+  for (int i = 1; i < num_workers; ++i) {
+    nets_.push_back(shared_ptr<Net<Dtype> >(
+        new Net<Dtype>(param, NULL, nets_[0].get())));
+    nets_[i]->ShareTrainedLayersWith(nets_[0].get());
+  }
+  // Synchronize the shared weights up front, workers would otherwise race
+  // on the head of the same SyncedMemory during their first forward.
+  const vector<shared_ptr<Blob<Dtype> > >& params = nets_[0]->params();
+  for (int i = 0; i < params.size(); ++i) {
+    switch (Caffe::mode()) {
+    case Caffe::CPU:
+      params[i]->cpu_data();
+      break;
+    case Caffe::GPU:
+      params[i]->gpu_data();
+      break;
+    }
+  }
+  for (int i = 0; i < num_workers; ++i) {
+    workers_.push_back(shared_ptr<Worker>(new Worker(this, nets_[i].get())));
+    workers_[i]->StartInternalThread();
+  }
+  LOG(INFO) << "InferenceEngine serving " << nets_[0]->name() << " with "
+      << num_workers << " workers, max batch size " << max_batch_size_
+      << ", max latency " << max_latency_us_ << " us";
+}
+
+template <typename Dtype>
+InferenceEngine<Dtype>::~InferenceEngine() {
+  // Stop the workers before the nets they run are destroyed.
+  workers_.clear();
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::Predict(const vector<Blob<Dtype>*>& inputs,
+    const vector<Blob<Dtype>*>& outputs) {
+  CHECK_EQ(inputs.size(), nets_[0]->num_inputs())
+      << "Predict takes one input blob per net input.";
+  CHECK_EQ(outputs.size(), nets_[0]->num_outputs())
+      << "Predict takes one output blob per net output.";
+  Request request;
+  request.inputs = &inputs;
+  request.outputs = &outputs;
+  request.num = -1;
+  if (inputs.size() > 0 && inputs[0]->num_axes() > 0) {
+    request.num = inputs[0]->shape(0);
+    for (int i = 1; i < inputs.size(); ++i) {
+      if (inputs[i]->num_axes() == 0 ||
+          inputs[i]->shape(0) != request.num) {
+        request.num = -1;
+      }
+    }
+  }
+  request.arrival = microsec_clock::universal_time();
+  requests_.push(&request);
+  request.done.pop();
+}
+
+template <typename Dtype>
+bool InferenceEngine<Dtype>::Batchable(const Request& first,
+    const Request& request) const {
+  if (first.num < 0 || request.num < 0) {
+    return false;
+  }
+  for (int i = 0; i < first.inputs->size(); ++i) {
+    const vector<int>& first_shape = (*first.inputs)[i]->shape();
+    const vector<int>& shape = (*request.inputs)[i]->shape();
+    if (shape.size() != first_shape.size() ||
+        !std::equal(shape.begin() + 1, shape.end(), first_shape.begin() + 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+bool InferenceEngine<Dtype>::Gather(vector<Request*>* batch,
+    int timeout_ms) {
+  int token;
+  if (timeout_ms < 0) {
+    gather_token_.pop();
+  } else if (!gather_token_.try_pop(&token, timeout_ms * 1000)) {
+    return false;
+  }
+  Request* request = pending_;
+  pending_ = NULL;
+  if (!request) {
+    if (timeout_ms < 0) {
+      request = requests_.pop();
+    } else if (!requests_.try_pop(&request, timeout_ms * 1000)) {
+      gather_token_.push(0);
+      return false;
+    }
+  }
+  batch->push_back(request);
+  int num = request->num;
+  const ptime deadline = request->arrival + microseconds(max_latency_us_);
+  while (num >= 0 && num < max_batch_size_) {
+    const int64_t remaining =
+        (deadline - microsec_clock::universal_time()).total_microseconds();
+    // Past the deadline only take what is already queued.
+    const bool popped = remaining > 0 ?
+        requests_.try_pop(&request, remaining) : requests_.try_pop(&request);
+    if (!popped) {
+      break;
+    }
+    if (num + request->num > max_batch_size_ ||
+        !Batchable(*batch->front(), *request)) {
+      pending_ = request;
+      break;
+    }
+    batch->push_back(request);
+    num += request->num;
+  }
+  gather_token_.push(0);
+  return true;
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::Served(const vector<Request*>& batch) {
+  const ptime now = microsec_clock::universal_time();
+  boost::mutex::scoped_lock lock(*stats_mutex_);
+  for (int i = 0; i < batch.size(); ++i) {
+    latency_.Add((now - batch[i]->arrival).total_microseconds());
+  }
+  num_requests_ += batch.size();
+  ++num_batches_;
+}
+
+template <typename Dtype>
+LatencyHistogram InferenceEngine<Dtype>::latency() const {
+  boost::mutex::scoped_lock lock(*stats_mutex_);
+  return latency_;
+}
+
+template <typename Dtype>
+int64_t InferenceEngine<Dtype>::num_requests() const {
+  boost::mutex::scoped_lock lock(*stats_mutex_);
+  return num_requests_;
+}
+
+template <typename Dtype>
+int64_t InferenceEngine<Dtype>::num_batches() const {
+  boost::mutex::scoped_lock lock(*stats_mutex_);
+  return num_batches_;
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::ResetStats() {
+  boost::mutex::scoped_lock lock(*stats_mutex_);
+  latency_.Clear();
+  num_requests_ = 0;
+  num_batches_ = 0;
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::Worker::InternalThreadEntry() {
+  Trace::SetThreadName("inference worker");
+  try {
+    // Whether the net is in use, i.e. has served a request since its memory
+    // was last released.
+    bool in_use = false;
+    while (!must_stop()) {
+      vector<Request*> batch;
+      const int idle_release_ms = engine_->idle_release_ms();
+      const int timeout_ms = in_use && idle_release_ms > 0 ?
+          idle_release_ms : -1;
+      if (!engine_->Gather(&batch, timeout_ms)) {
+        net_->ReleaseBlobs();
+        in_use = false;
+        continue;
+      }
+      Serve(batch);
+      in_use = true;
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+// Copy count items of src starting at src_offset into dst at dst_offset.
+template <typename Dtype>
+static void CopyItems(const Blob<Dtype>& src, int src_offset, int count,
+    Blob<Dtype>* dst, int dst_offset) {
+  switch (Caffe::mode()) {
+  case Caffe::CPU:
+    caffe_copy(count, src.cpu_data() + src_offset,
+        dst->mutable_cpu_data() + dst_offset);
+    break;
+  case Caffe::GPU:
+#ifndef CPU_ONLY
+    caffe_copy(count, src.gpu_data() + src_offset,
+        dst->mutable_gpu_data() + dst_offset);
+#else
+    NO_GPU;
+#endif
+    break;
+  }
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::Worker::Serve(const vector<Request*>& batch) {
+  const vector<Blob<Dtype>*>& net_inputs = net_->input_blobs();
+  const vector<Blob<Dtype>*>& net_outputs = net_->output_blobs();
+  if (batch.size() == 1) {
+    const vector<Blob<Dtype>*>& inputs = *batch[0]->inputs;
+    for (int i = 0; i < inputs.size(); ++i) {
+      net_inputs[i]->CopyFrom(*inputs[i], false, true);
+    }
+    net_->Forward();
+    const vector<Blob<Dtype>*>& outputs = *batch[0]->outputs;
+    for (int i = 0; i < outputs.size(); ++i) {
+      outputs[i]->CopyFrom(*net_outputs[i], false, true);
+    }
+  } else {
+    int num = 0;
+    for (int j = 0; j < batch.size(); ++j) {
+      num += batch[j]->num;
+    }
+    // Concatenate the requests along the first axis.
+    for (int i = 0; i < net_inputs.size(); ++i) {
+      vector<int> shape = (*batch[0]->inputs)[i]->shape();
+      shape[0] = num;
+      net_inputs[i]->Reshape(shape);
+      int offset = 0;
+      for (int j = 0; j < batch.size(); ++j) {
+        const Blob<Dtype>& input = *(*batch[j]->inputs)[i];
+        CopyItems(input, 0, input.count(), net_inputs[i], offset);
+        offset += input.count();
+      }
+    }
+    net_->Reshape();
+    net_->Forward();
+    // Scatter the outputs spanning the batch, broadcast the others.
+    for (int i = 0; i < net_outputs.size(); ++i) {
+      const Blob<Dtype>& net_output = *net_outputs[i];
+      if (net_output.num_axes() == 0 || net_output.shape(0) != num) {
+        for (int j = 0; j < batch.size(); ++j) {
+          (*batch[j]->outputs)[i]->CopyFrom(net_output, false, true);
+        }
+        continue;
+      }
+      vector<int> shape = net_output.shape();
+      int offset = 0;
+      for (int j = 0; j < batch.size(); ++j) {
+        Blob<Dtype>* output = (*batch[j]->outputs)[i];
+        shape[0] = batch[j]->num;
+        output->Reshape(shape);
+        CopyItems(net_output, offset, output->count(), output, 0);
+        offset += output->count();
+      }
+    }
+  }
+  engine_->Served(batch);
+  for (int j = 0; j < batch.size(); ++j) {
+    batch[j]->done.push(0);
+  }
+}
+
+INSTANTIATE_CLASS(InferenceEngine);
+
+}  // namespace caffe
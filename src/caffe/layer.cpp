@@ -22,6 +22,36 @@ void Layer<Dtype>::Unlock() {
   }
 }
 
+template <typename Dtype>
+bool Layer<Dtype>::NeedsReshape(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  if (!ReshapeDependsOnlyOnShapes() ||
+      reshaped_blobs_.size() != bottom.size() + top.size()) {
+    return true;
+  }
+  for (int i = 0; i < reshaped_blobs_.size(); ++i) {
+    const Blob<Dtype>* blob =
+        i < bottom.size() ? bottom[i] : top[i - bottom.size()];
+    if (blob != reshaped_blobs_[i] ||
+        blob->shape_version() != reshaped_versions_[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename Dtype>
+void Layer<Dtype>::RecordReshape(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  if (!ReshapeDependsOnlyOnShapes()) { return; }
+  reshaped_blobs_.assign(bottom.begin(), bottom.end());
+  reshaped_blobs_.insert(reshaped_blobs_.end(), top.begin(), top.end());
+  reshaped_versions_.resize(reshaped_blobs_.size());
+  for (int i = 0; i < reshaped_blobs_.size(); ++i) {
+    reshaped_versions_[i] = reshaped_blobs_[i]->shape_version();
+  }
+}
+
 INSTANTIATE_CLASS(Layer);
 
 }  // namespace caffe
@@ -1,5 +1,3 @@
-#include <functional>
-#include <utility>
 #include <vector>
 
 #include "caffe/layers/accuracy_layer.hpp"
@@ -52,42 +50,63 @@ void AccuracyLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_label = bottom[1]->cpu_data();
   const int dim = bottom[0]->count() / outer_num_;
   const int num_labels = bottom[0]->shape(label_axis_);
-  vector<Dtype> maxval(top_k_+1);
-  vector<int> max_id(top_k_+1);
+  Dtype* nums_data = NULL;
+  Dtype* per_class_data = NULL;
   if (top.size() > 1) {
-    caffe_set(nums_buffer_.count(), Dtype(0), nums_buffer_.mutable_cpu_data());
-    caffe_set(top[1]->count(), Dtype(0), top[1]->mutable_cpu_data());
+    nums_data = nums_buffer_.mutable_cpu_data();
+    per_class_data = top[1]->mutable_cpu_data();
+    caffe_set(nums_buffer_.count(), Dtype(0), nums_data);
+    caffe_set(top[1]->count(), Dtype(0), per_class_data);
   }
   int count = 0;
-  for (int i = 0; i < outer_num_; ++i) {
-    for (int j = 0; j < inner_num_; ++j) {
-      const int label_value =
-          static_cast<int>(bottom_label[i * inner_num_ + j]);
-      if (has_ignore_label_ && label_value == ignore_label_) {
-        continue;
+#ifdef _OPENMP
+  #pragma omp parallel for reduction(+: accuracy, count)
+#endif
+  for (int n = 0; n < outer_num_ * inner_num_; ++n) {
+    const int i = n / inner_num_;
+    const int j = n % inner_num_;
+    const int label_value = static_cast<int>(bottom_label[n]);
+    if (has_ignore_label_ && label_value == ignore_label_) {
+      continue;
+    }
+    DCHECK_GE(label_value, 0);
+    DCHECK_LT(label_value, num_labels);
+    if (nums_data) {
+#ifdef _OPENMP
+      #pragma omp atomic
+#endif
+      ++nums_data[label_value];
+    }
+    // Top-k accuracy: the true label is in the top k predictions if fewer
+    // than k labels rank before it, ties going to the larger label.
+    const Dtype* data = bottom_data + i * dim + j;
+    const Dtype label_score = data[label_value * inner_num_];
+    int rank = 0;
+    if (inner_num_ == 1) {
+      for (int k = 0; k < label_value; ++k) {
+        rank += data[k] > label_score;
+      }
+      for (int k = label_value + 1; k < num_labels; ++k) {
+        rank += data[k] >= label_score;
       }
-      if (top.size() > 1) ++nums_buffer_.mutable_cpu_data()[label_value];
-      DCHECK_GE(label_value, 0);
-      DCHECK_LT(label_value, num_labels);
-      // Top-k accuracy
-      std::vector<std::pair<Dtype, int> > bottom_data_vector;
-      for (int k = 0; k < num_labels; ++k) {
-        bottom_data_vector.push_back(std::make_pair(
-            bottom_data[i * dim + k * inner_num_ + j], k));
+    } else {
+      for (int k = 0; k < label_value; ++k) {
+        rank += data[k * inner_num_] > label_score;
       }
-      std::partial_sort(
-          bottom_data_vector.begin(), bottom_data_vector.begin() + top_k_,
-          bottom_data_vector.end(), std::greater<std::pair<Dtype, int> >());
-      // check if true label is in top k predictions
-      for (int k = 0; k < top_k_; k++) {
-        if (bottom_data_vector[k].second == label_value) {
-          ++accuracy;
-          if (top.size() > 1) ++top[1]->mutable_cpu_data()[label_value];
-          break;
-        }
+      for (int k = label_value + 1; k < num_labels; ++k) {
+        rank += data[k * inner_num_] >= label_score;
+      }
+    }
+    if (rank < top_k_) {
+      ++accuracy;
+      if (per_class_data) {
+#ifdef _OPENMP
+        #pragma omp atomic
+#endif
+        ++per_class_data[label_value];
       }
-      ++count;
     }
+    ++count;
   }
 
   // LOG(INFO) << "Accuracy: " << accuracy;
@@ -7,6 +7,106 @@
 
 namespace caffe {
 
+namespace {
+
+// The number of values the scans below rule out at once by their max.
+const int kBlockSize = 16;
+// The number of positions maximised at once along a strided axis.
+const int kTileSize = 256;
+
+// The index of the largest of n contiguous values, the last one on ties as
+// with std::greater on (value, index) pairs.
+template <typename Dtype>
+int argmax(int n, const Dtype* x) {
+  Dtype max = x[0];
+  int index = 0;
+  int j = 1;
+  for (; j + kBlockSize <= n; j += kBlockSize) {
+    Dtype block_max = x[j];
+    for (int b = 1; b < kBlockSize; ++b) {
+      block_max = std::max(block_max, x[j + b]);
+    }
+    if (block_max < max) {
+      continue;
+    }
+    for (int b = 0; b < kBlockSize; ++b) {
+      if (x[j + b] >= max) {
+        max = x[j + b];
+        index = j + b;
+      }
+    }
+  }
+  for (; j < n; ++j) {
+    if (x[j] >= max) {
+      max = x[j];
+      index = j;
+    }
+  }
+  return index;
+}
+
+// The max and argmax over n values stride apart, for length neighbouring
+// positions.
+template <typename Dtype>
+void argmax_tile(int n, int stride, int length, const Dtype* x,
+    Dtype* max_val, int* max_ind) {
+  std::copy(x, x + length, max_val);
+  std::fill(max_ind, max_ind + length, 0);
+  for (int j = 1; j < n; ++j) {
+    const Dtype* x_j = x + j * stride;
+    for (int p = 0; p < length; ++p) {
+      const bool larger = x_j[p] >= max_val[p];
+      max_val[p] = larger ? x_j[p] : max_val[p];
+      max_ind[p] = larger ? j : max_ind[p];
+    }
+  }
+}
+
+// The k largest of n values stride apart as (value, index) pairs in
+// decreasing order, as partial sorting them with std::greater would give,
+// kept in a heap of k pairs.
+template <typename Dtype>
+void select_top_k(int n, int stride, const Dtype* x, int k,
+    std::pair<Dtype, int>* top_k) {
+  typedef std::pair<Dtype, int> Pair;
+  const std::greater<Pair> greater;
+  for (int j = 0; j < k; ++j) {
+    top_k[j] = Pair(x[j * stride], j);
+  }
+  // The smallest pair kept is at the front; as indices grow, a value
+  // replaces it if it is at least as large.
+  std::make_heap(top_k, top_k + k, greater);
+  int j = k;
+  if (stride == 1) {
+    for (; j + kBlockSize <= n; j += kBlockSize) {
+      Dtype block_max = x[j];
+      for (int b = 1; b < kBlockSize; ++b) {
+        block_max = std::max(block_max, x[j + b]);
+      }
+      if (block_max < top_k[0].first) {
+        continue;
+      }
+      for (int b = 0; b < kBlockSize; ++b) {
+        if (x[j + b] >= top_k[0].first) {
+          std::pop_heap(top_k, top_k + k, greater);
+          top_k[k - 1] = Pair(x[j + b], j + b);
+          std::push_heap(top_k, top_k + k, greater);
+        }
+      }
+    }
+  }
+  for (; j < n; ++j) {
+    if (x[j * stride] >= top_k[0].first) {
+      std::pop_heap(top_k, top_k + k, greater);
+      top_k[k - 1] = Pair(x[j * stride], j);
+      std::push_heap(top_k, top_k + k, greater);
+    }
+  }
+  std::sort_heap(top_k, top_k + k, greater);
+}
+
+}  // namespace
+
 template <typename Dtype>
 void ArgMaxLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -66,30 +166,60 @@ void ArgMaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     axis_dist = 1;
   }
   int num = bottom[0]->count() / dim;
-  std::vector<std::pair<Dtype, int> > bottom_data_vector(dim);
-  for (int i = 0; i < num; ++i) {
-    for (int j = 0; j < dim; ++j) {
-      bottom_data_vector[j] = std::make_pair(
-        bottom_data[(i / axis_dist * dim + j) * axis_dist + i % axis_dist], j);
+  if (top_k_ == 1 && axis_dist > 1) {
+    // Maximise over the axis for a tile of neighbouring positions at once.
+    const int num_tiles = (axis_dist + kTileSize - 1) / kTileSize;
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int t = 0; t < num / axis_dist * num_tiles; ++t) {
+      const int begin = (t % num_tiles) * kTileSize;
+      const int offset = t / num_tiles * dim * axis_dist + begin;
+      const int length = std::min(kTileSize, axis_dist - begin);
+      Dtype max_val[kTileSize];
+      int max_ind[kTileSize];
+      argmax_tile(dim, axis_dist, length, bottom_data + offset, max_val,
+          max_ind);
+      Dtype* top = top_data + t / num_tiles * axis_dist + begin;
+      for (int p = 0; p < length; ++p) {
+        top[p] = out_max_val_ ? max_val[p] : max_ind[p];
+      }
     }
-    std::partial_sort(
-        bottom_data_vector.begin(), bottom_data_vector.begin() + top_k_,
-        bottom_data_vector.end(), std::greater<std::pair<Dtype, int> >());
-    for (int j = 0; j < top_k_; ++j) {
-      if (out_max_val_) {
-        if (has_axis_) {
-          // Produces max_val per axis
-          top_data[(i / axis_dist * top_k_ + j) * axis_dist + i % axis_dist]
-            = bottom_data_vector[j].first;
+    return;
+  }
+#ifdef _OPENMP
+  #pragma omp parallel
+#endif
+  {
+    std::vector<std::pair<Dtype, int> > top_k(top_k_);
+#ifdef _OPENMP
+    #pragma omp for
+#endif
+    for (int i = 0; i < num; ++i) {
+      const Dtype* data =
+          bottom_data + i / axis_dist * dim * axis_dist + i % axis_dist;
+      if (top_k_ == 1) {
+        top_k[0].second = argmax(dim, data);
+        top_k[0].first = data[top_k[0].second];
+      } else {
+        select_top_k(dim, axis_dist, data, top_k_, &top_k[0]);
+      }
+      for (int j = 0; j < top_k_; ++j) {
+        if (out_max_val_) {
+          if (has_axis_) {
+            // Produces max_val per axis
+            top_data[(i / axis_dist * top_k_ + j) * axis_dist + i % axis_dist]
+              = top_k[j].first;
+          } else {
+            // Produces max_ind and max_val
+            top_data[2 * i * top_k_ + j] = top_k[j].second;
+            top_data[2 * i * top_k_ + top_k_ + j] = top_k[j].first;
+          }
         } else {
-          // Produces max_ind and max_val
-          top_data[2 * i * top_k_ + j] = bottom_data_vector[j].second;
-          top_data[2 * i * top_k_ + top_k_ + j] = bottom_data_vector[j].first;
+          // Produces max_ind per axis
+          top_data[(i / axis_dist * top_k_ + j) * axis_dist + i % axis_dist]
+            = top_k[j].second;
         }
-      } else {
-        // Produces max_ind per axis
-        top_data[(i / axis_dist * top_k_ + j) * axis_dist + i % axis_dist]
-          = bottom_data_vector[j].second;
       }
     }
   }
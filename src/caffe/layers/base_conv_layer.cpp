@@ -253,9 +253,19 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+const SparseMatrix<Dtype>* BaseConvolutionLayer<Dtype>::sparse_weights() {
+  if (this->phase_ != TEST) {
+    return NULL;
+  }
+  return sparse_weights_.Get(*this->blobs_[0], conv_out_channels_,
+      kernel_dim_, this->layer_param_.convolution_param().sparse_threshold());
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
-    const Dtype* weights, Dtype* output, bool skip_im2col) {
+    const Dtype* weights, Dtype* output, bool skip_im2col,
+    const SparseMatrix<Dtype>* sparse_weights) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
     if (!skip_im2col) {
@@ -263,11 +273,18 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     }
     col_buff = col_buffer_.cpu_data();
   }
+  const int group_out_channels = conv_out_channels_ / group_;
   for (int g = 0; g < group_; ++g) {
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
-        group_, conv_out_spatial_dim_, kernel_dim_,
-        (Dtype)1., weights + weight_offset_ * g, col_buff + col_offset_ * g,
-        (Dtype)0., output + output_offset_ * g);
+    if (sparse_weights) {
+      sparse_weights->MultiplyRows(group_out_channels * g,
+          group_out_channels * (g + 1), conv_out_spatial_dim_,
+          col_buff + col_offset_ * g, output + output_offset_ * g);
+    } else {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, group_out_channels,
+          conv_out_spatial_dim_, kernel_dim_,
+          (Dtype)1., weights + weight_offset_ * g, col_buff + col_offset_ * g,
+          (Dtype)0., output + output_offset_ * g);
+    }
   }
 }
 
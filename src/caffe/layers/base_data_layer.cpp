@@ -8,6 +8,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/trace.hpp"
 
 namespace caffe {
 
@@ -81,16 +82,21 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
   }
 #endif
 
+  const string& name = this->layer_param_.name();
+  Trace::SetThreadName("prefetch " + name);
   try {
     while (!must_stop()) {
       Batch<Dtype>* batch = prefetch_free_.pop();
-      load_batch(batch);
+      {
+        TraceScope trace("prefetch", name);
+        load_batch(batch);
 #ifndef CPU_ONLY
-      if (Caffe::mode() == Caffe::GPU) {
-        batch->data_.data().get()->async_gpu_push(stream);
-        CUDA_CHECK(cudaStreamSynchronize(stream));
-      }
+        if (Caffe::mode() == Caffe::GPU) {
+          batch->data_.data().get()->async_gpu_push(stream);
+          CUDA_CHECK(cudaStreamSynchronize(stream));
+        }
 #endif
+      }
       prefetch_full_.push(batch);
     }
   } catch (boost::thread_interrupted&) {
@@ -106,7 +112,12 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch;
+  {
+    // Time spent waiting here is time the prefetch thread is behind.
+    TraceScope trace("data_wait", this->layer_param_.name());
+    batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  }
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data
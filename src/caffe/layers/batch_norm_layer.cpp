@@ -1,6 +1,8 @@
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
+#include "caffe/filler.hpp"
 #include "caffe/layers/batch_norm_layer.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -19,10 +21,13 @@ void BatchNormLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   else
     channels_ = bottom[0]->shape(1);
   eps_ = param.eps();
+  scale_bias_ = param.scale_bias();
   if (this->blobs_.size() > 0) {
     LOG(INFO) << "Skipping parameter initialization";
+    CHECK_EQ(this->blobs_.size(), scale_bias_ ? 5 : 3)
+        << "Parameter blobs do not match scale_bias";
   } else {
-    this->blobs_.resize(3);
+    this->blobs_.resize(scale_bias_ ? 5 : 3);
     vector<int> sz;
     sz.push_back(channels_);
     this->blobs_[0].reset(new Blob<Dtype>(sz));
@@ -33,7 +38,23 @@ void BatchNormLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       caffe_set(this->blobs_[i]->count(), Dtype(0),
                 this->blobs_[i]->mutable_cpu_data());
     }
+    if (scale_bias_) {
+      sz[0] = channels_;
+      this->blobs_[3].reset(new Blob<Dtype>(sz));
+      this->blobs_[4].reset(new Blob<Dtype>(sz));
+      FillerParameter scale_filler(param.scale_filler());
+      if (!param.has_scale_filler()) {
+        // Default to unit (1) filler for identity operation.
+        scale_filler.set_type("constant");
+        scale_filler.set_value(1);
+      }
+      shared_ptr<Filler<Dtype> > filler(GetFiller<Dtype>(scale_filler));
+      filler->Fill(this->blobs_[3].get());
+      filler.reset(GetFiller<Dtype>(param.bias_filler()));
+      filler->Fill(this->blobs_[4].get());
+    }
   }
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
 }
 
 template <typename Dtype>
@@ -71,56 +92,66 @@ void BatchNormLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+// The mean and (biased) variance of the num runs of spatial_dim values at
+// stride apart. Each block is summed twice while it is in cache, and the
+// blocks are merged with the parallel update of Welford's algorithm, so the
+// data is read from memory once.
+template <typename Dtype>
+static void channel_moments(const int num, const int spatial_dim,
+    const int stride, const Dtype* x, Dtype* mean, Dtype* variance) {
+  const int kBlock = 1024;
+  double count = 0, mu = 0, m2 = 0;
+  for (int n = 0; n < num; ++n) {
+    const Dtype* run = x + n * stride;
+    for (int begin = 0; begin < spatial_dim; begin += kBlock) {
+      const int size = std::min(kBlock, spatial_dim - begin);
+      Dtype sum = 0;
+      for (int i = 0; i < size; ++i) {
+        sum += run[begin + i];
+      }
+      const Dtype block_mu = sum / size;
+      Dtype block_m2 = 0;
+      for (int i = 0; i < size; ++i) {
+        const Dtype d = run[begin + i] - block_mu;
+        block_m2 += d * d;
+      }
+      const double delta = block_mu - mu;
+      const double total = count + size;
+      mu += delta * size / total;
+      m2 += block_m2 + delta * delta * count * size / total;
+      count = total;
+    }
+  }
+  *mean = mu;
+  *variance = count > 0 ? m2 / count : 0;
+}
+
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  int num = bottom[0]->shape(0);
-  int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
-
-  if (bottom[0] != top[0]) {
-    caffe_copy(bottom[0]->count(), bottom_data, top_data);
-  }
+  const int num = bottom[0]->shape(0);
+  const int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
+  Dtype* mean = mean_.mutable_cpu_data();
+  Dtype* variance = variance_.mutable_cpu_data();
 
   if (use_global_stats_) {
     // use the stored mean/variance estimates.
     const Dtype scale_factor = this->blobs_[2]->cpu_data()[0] == 0 ?
         0 : 1 / this->blobs_[2]->cpu_data()[0];
     caffe_cpu_scale(variance_.count(), scale_factor,
-        this->blobs_[0]->cpu_data(), mean_.mutable_cpu_data());
+        this->blobs_[0]->cpu_data(), mean);
     caffe_cpu_scale(variance_.count(), scale_factor,
-        this->blobs_[1]->cpu_data(), variance_.mutable_cpu_data());
+        this->blobs_[1]->cpu_data(), variance);
   } else {
-    // compute mean
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), bottom_data,
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        mean_.mutable_cpu_data());
-  }
-
-  // subtract mean
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), mean_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
-      spatial_dim, 1, -1, num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 1., top_data);
-
-  if (!use_global_stats_) {
-    // compute variance using var(X) = E((X-EX)^2)
-    caffe_powx(top[0]->count(), top_data, Dtype(2),
-        temp_.mutable_cpu_data());  // (X-EX)^2
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), temp_.cpu_data(),
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        variance_.mutable_cpu_data());  // E((X_EX)^2)
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int c = 0; c < channels_; ++c) {
+      channel_moments(num, spatial_dim, channels_ * spatial_dim,
+          bottom_data + c * spatial_dim, mean + c, variance + c);
+    }
 
     // compute and save moving average
     this->blobs_[2]->mutable_cpu_data()[0] *= moving_average_fraction_;
@@ -134,44 +165,45 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
         this->blobs_[1]->mutable_cpu_data());
   }
 
-  // normalize variance
-  caffe_add_scalar(variance_.count(), eps_, variance_.mutable_cpu_data());
-  caffe_powx(variance_.count(), variance_.cpu_data(), Dtype(0.5),
-             variance_.mutable_cpu_data());
-
-  // replicate variance to input size
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), variance_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
-      spatial_dim, 1, 1., num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 0., temp_.mutable_cpu_data());
-  caffe_div(temp_.count(), top_data, temp_.cpu_data(), top_data);
-  // TODO(cdoersch): The caching is only needed because later in-place layers
-  //                 might clobber the data.  Can we skip this if they won't?
-  caffe_copy(x_norm_.count(), top_data,
-      x_norm_.mutable_cpu_data());
+  // variance_ holds sqrt(var(X) + eps) from here on, for the backward pass.
+  for (int c = 0; c < channels_; ++c) {
+    variance[c] = std::sqrt(variance[c] + eps_);
+  }
+
+  // Backward cannot recompute X_hat from the bottom when it was overwritten,
+  // and later in-place layers may overwrite the top.
+  Dtype* x_norm = NULL;
+  if (bottom[0] == top[0] && (!use_global_stats_ || scale_bias_)) {
+    x_norm = x_norm_.mutable_cpu_data();
+  }
+  const Dtype* gamma = scale_bias_ ? this->blobs_[3]->cpu_data() : NULL;
+  const Dtype* beta = scale_bias_ ? this->blobs_[4]->cpu_data() : NULL;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int nc = 0; nc < num * channels_; ++nc) {
+    const int c = nc % channels_;
+    const int offset = nc * spatial_dim;
+    const Dtype inv_std = 1 / variance[c];
+    if (x_norm) {
+      for (int i = 0; i < spatial_dim; ++i) {
+        x_norm[offset + i] = (bottom_data[offset + i] - mean[c]) * inv_std;
+      }
+    }
+    // Y = a X + b, with X_hat = (X - mean) / std scaled and shifted by
+    // gamma and beta if learned.
+    const Dtype a = gamma ? gamma[c] * inv_std : inv_std;
+    const Dtype b = (beta ? beta[c] : Dtype(0)) - mean[c] * a;
+    for (int i = 0; i < spatial_dim; ++i) {
+      top_data[offset + i] = bottom_data[offset + i] * a + b;
+    }
+  }
 }
 
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  const Dtype* top_diff;
-  if (bottom[0] != top[0]) {
-    top_diff = top[0]->cpu_diff();
-  } else {
-    caffe_copy(x_norm_.count(), top[0]->cpu_diff(), x_norm_.mutable_cpu_diff());
-    top_diff = x_norm_.cpu_diff();
-  }
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  if (use_global_stats_) {
-    caffe_div(temp_.count(), top_diff, temp_.cpu_data(), bottom_diff);
-    return;
-  }
-  const Dtype* top_data = x_norm_.cpu_data();
-  int num = bottom[0]->shape()[0];
-  int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
   // if Y = (X-mean(X))/(sqrt(var(X)+eps)), then
   //
   // dE(Y)/dX =
@@ -180,53 +212,82 @@ void BatchNormLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   //
   // where \cdot and ./ are hadamard product and elementwise division,
   // respectively, dE/dY is the top diff, and mean/var/sum are all computed
-  // along all dimensions except the channels dimension.  In the above
-  // equation, the operations allow for expansion (i.e. broadcast) along all
-  // dimensions except the channels dimension where required.
-
-  // sum(dE/dY \cdot Y)
-  caffe_mul(temp_.count(), top_data, top_diff, bottom_diff);
-  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim, 1.,
-      bottom_diff, spatial_sum_multiplier_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-      mean_.mutable_cpu_data());
-
-  // reshape (broadcast) the above
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), mean_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
-      spatial_dim, 1, 1., num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 0., bottom_diff);
-
-  // sum(dE/dY \cdot Y) \cdot Y
-  caffe_mul(temp_.count(), top_data, bottom_diff, bottom_diff);
-
-  // sum(dE/dY)-sum(dE/dY \cdot Y) \cdot Y
-  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim, 1.,
-      top_diff, spatial_sum_multiplier_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-      mean_.mutable_cpu_data());
-  // reshape (broadcast) the above to make
-  // sum(dE/dY)-sum(dE/dY \cdot Y) \cdot Y
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), mean_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num * channels_,
-      spatial_dim, 1, 1., num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 1., bottom_diff);
-
-  // dE/dY - mean(dE/dY)-mean(dE/dY \cdot Y) \cdot Y
-  caffe_cpu_axpby(temp_.count(), Dtype(1), top_diff,
-      Dtype(-1. / (num * spatial_dim)), bottom_diff);
-
-  // note: temp_ still contains sqrt(var(X)+eps), computed during the forward
-  // pass.
-  caffe_div(temp_.count(), bottom_diff, temp_.cpu_data(), bottom_diff);
+  // along all dimensions except the channels dimension.  With a learned scale
+  // gamma, dE/dY is gamma times the top diff, and the two sums are also the
+  // gradients of gamma and beta. With the global stats, mean and var do not
+  // depend on X, and dE(Y)/dX = dE/dY ./ sqrt(var + eps).
+  //
+  // Each channel is done in two passes over its values, the sums and then
+  // the bottom diff, which may overwrite the top diff in place.
+  const bool scale_bias_down = scale_bias_ &&
+      (this->param_propagate_down(3) || this->param_propagate_down(4));
+  if (!propagate_down[0] && !scale_bias_down) {
+    return;
+  }
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = propagate_down[0] ? bottom[0]->mutable_cpu_diff() : NULL;
+  const bool in_place = bottom[0] == top[0];
+  const Dtype* bottom_data = in_place ? NULL : bottom[0]->cpu_data();
+  const Dtype* x_norm = in_place && (!use_global_stats_ || scale_bias_) ?
+      x_norm_.cpu_data() : NULL;
+  const Dtype* mean = mean_.cpu_data();
+  const Dtype* std = variance_.cpu_data();
+  const Dtype* gamma = scale_bias_ ? this->blobs_[3]->cpu_data() : NULL;
+  Dtype* gamma_diff = scale_bias_down ?
+      this->blobs_[3]->mutable_cpu_diff() : NULL;
+  Dtype* beta_diff = scale_bias_down ?
+      this->blobs_[4]->mutable_cpu_diff() : NULL;
+  const int num = bottom[0]->shape(0);
+  const int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
+  const int stride = channels_ * spatial_dim;
+  const Dtype m = num * spatial_dim;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int c = 0; c < channels_; ++c) {
+    const Dtype inv_std = 1 / std[c];
+    const Dtype scale = gamma ? gamma[c] : Dtype(1);
+    Dtype sum_dy = 0, sum_dy_x = 0;
+    if (!use_global_stats_ || scale_bias_down) {
+      for (int n = 0; n < num; ++n) {
+        const int offset = n * stride + c * spatial_dim;
+        for (int i = 0; i < spatial_dim; ++i) {
+          const Dtype x_hat = x_norm ? x_norm[offset + i] :
+              (bottom_data[offset + i] - mean[c]) * inv_std;
+          sum_dy += top_diff[offset + i];
+          sum_dy_x += top_diff[offset + i] * x_hat;
+        }
+      }
+    }
+    if (scale_bias_down) {
+      gamma_diff[c] += sum_dy_x;
+      beta_diff[c] += sum_dy;
+    }
+    if (!bottom_diff) {
+      continue;
+    }
+    const Dtype a = scale * inv_std;
+    if (use_global_stats_) {
+      for (int n = 0; n < num; ++n) {
+        const int offset = n * stride + c * spatial_dim;
+        for (int i = 0; i < spatial_dim; ++i) {
+          bottom_diff[offset + i] = top_diff[offset + i] * a;
+        }
+      }
+      continue;
+    }
+    const Dtype mean_dy = sum_dy / m;
+    const Dtype mean_dy_x = sum_dy_x / m;
+    for (int n = 0; n < num; ++n) {
+      const int offset = n * stride + c * spatial_dim;
+      for (int i = 0; i < spatial_dim; ++i) {
+        const Dtype x_hat = x_norm ? x_norm[offset + i] :
+            (bottom_data[offset + i] - mean[c]) * inv_std;
+        bottom_diff[offset + i] =
+            (top_diff[offset + i] - mean_dy - x_hat * mean_dy_x) * a;
+      }
+    }
+  }
 }
 
 
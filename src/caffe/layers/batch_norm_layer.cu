@@ -87,6 +87,24 @@ void BatchNormLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   //                 might clobber the data.  Can we skip this if they won't?
   caffe_copy(x_norm_.count(), top_data,
       x_norm_.mutable_gpu_data());
+
+  if (scale_bias_) {
+    // Y = gamma X_hat + beta, broadcast as above; the diff of x_norm_ is free
+    // until the backward pass.
+    caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
+        batch_sum_multiplier_.gpu_data(), this->blobs_[3]->gpu_data(), 0.,
+        num_by_chans_.mutable_gpu_data());
+    caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
+        spatial_dim, 1, 1., num_by_chans_.gpu_data(),
+        spatial_sum_multiplier_.gpu_data(), 0., x_norm_.mutable_gpu_diff());
+    caffe_gpu_mul(x_norm_.count(), top_data, x_norm_.gpu_diff(), top_data);
+    caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
+        batch_sum_multiplier_.gpu_data(), this->blobs_[4]->gpu_data(), 0.,
+        num_by_chans_.mutable_gpu_data());
+    caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
+        spatial_dim, 1, 1., num_by_chans_.gpu_data(),
+        spatial_sum_multiplier_.gpu_data(), 1., top_data);
+  }
 }
 
 template <typename Dtype>
@@ -101,13 +119,40 @@ void BatchNormLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     top_diff = x_norm_.gpu_diff();
   }
   Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
+  const Dtype* top_data = x_norm_.gpu_data();
+  int num = bottom[0]->shape()[0];
+  int spatial_dim = bottom[0]->count()/(channels_*bottom[0]->shape(0));
+  if (scale_bias_) {
+    // The gradients of gamma and beta are sum(dE/dY \cdot X_hat) and
+    // sum(dE/dY); the bottom diff is used as scratch until the end.
+    caffe_gpu_mul(temp_.count(), top_data, top_diff, bottom_diff);
+    caffe_gpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim, 1.,
+        bottom_diff, spatial_sum_multiplier_.gpu_data(), 0.,
+        num_by_chans_.mutable_gpu_data());
+    caffe_gpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
+        num_by_chans_.gpu_data(), batch_sum_multiplier_.gpu_data(), 1.,
+        this->blobs_[3]->mutable_gpu_diff());
+    caffe_gpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim, 1.,
+        top_diff, spatial_sum_multiplier_.gpu_data(), 0.,
+        num_by_chans_.mutable_gpu_data());
+    caffe_gpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
+        num_by_chans_.gpu_data(), batch_sum_multiplier_.gpu_data(), 1.,
+        this->blobs_[4]->mutable_gpu_diff());
+    // The rest is the gradient of X_hat, gamma dE/dY.
+    caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
+        batch_sum_multiplier_.gpu_data(), this->blobs_[3]->gpu_data(), 0.,
+        num_by_chans_.mutable_gpu_data());
+    caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
+        spatial_dim, 1, 1., num_by_chans_.gpu_data(),
+        spatial_sum_multiplier_.gpu_data(), 0., bottom_diff);
+    caffe_gpu_mul(temp_.count(), top_diff, bottom_diff,
+        x_norm_.mutable_gpu_diff());
+    top_diff = x_norm_.gpu_diff();
+  }
   if (use_global_stats_) {
     caffe_gpu_div(temp_.count(), top_diff, temp_.gpu_data(), bottom_diff);
     return;
   }
-  const Dtype* top_data = x_norm_.gpu_data();
-  int num = bottom[0]->shape()[0];
-  int spatial_dim = bottom[0]->count()/(channels_*bottom[0]->shape(0));
   // if Y = (X-mean(X))/(sqrt(var(X)+eps)), then
   //
   // dE(Y)/dX =
@@ -1,11 +1,18 @@
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/bnll_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
-const float kBNLL_THRESHOLD = 50.;
+namespace {
+
+// The elements transformed at once through a buffer on the stack.
+const int kTileSize = 1024;
+
+}  // namespace
 
 template <typename Dtype>
 void BNLLLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -13,10 +20,28 @@ void BNLLLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = bottom_data[i] > 0 ?
-        bottom_data[i] + log(1. + exp(-bottom_data[i])) :
-        log(1. + exp(bottom_data[i]));
+  // max(x, 0) + log(1 + exp(-|x|)), a tile at a time, so that exp and log
+  // run on whole vectors.
+  const int num_tiles = (count + kTileSize - 1) / kTileSize;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int t = 0; t < num_tiles; ++t) {
+    const int begin = t * kTileSize;
+    const int size = std::min(kTileSize, count - begin);
+    Dtype buffer[kTileSize];
+    for (int i = 0; i < size; ++i) {
+      buffer[i] = -std::abs(bottom_data[begin + i]);
+    }
+    caffe_exp(size, buffer, buffer);
+    for (int i = 0; i < size; ++i) {
+      buffer[i] += 1;
+    }
+    caffe_log(size, buffer, buffer);
+    for (int i = 0; i < size; ++i) {
+      top_data[begin + i] = std::max(bottom_data[begin + i], Dtype(0)) +
+          buffer[i];
+    }
   }
 }
 
@@ -29,11 +54,9 @@ void BNLLLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const Dtype* top_diff = top[0]->cpu_diff();
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     const int count = bottom[0]->count();
-    Dtype expval;
-    for (int i = 0; i < count; ++i) {
-      expval = exp(std::min(bottom_data[i], Dtype(kBNLL_THRESHOLD)));
-      bottom_diff[i] = top_diff[i] * expval / (expval + 1.);
-    }
+    // The derivative is the sigmoid.
+    caffe_sigmoid(count, bottom_data, bottom_diff);
+    caffe_mul(count, top_diff, bottom_diff, bottom_diff);
   }
 }
 
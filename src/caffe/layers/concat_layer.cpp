@@ -53,13 +53,40 @@ void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void ConcatLayer<Dtype>::MoveMisplacedRanges(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top,
+    bool diff) {
+  const Dtype* top_data = diff ? top[0]->cpu_diff() : top[0]->cpu_data();
+  int offset = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data =
+        diff ? bottom[i]->cpu_diff() : bottom[i]->cpu_data();
+    const bool in_place = num_concats_ == 1 && bottom_data == top_data +
+        offset;
+    offset += bottom[i]->count();
+    if (in_place || !caffe_overlap(bottom[i]->count(), bottom_data,
+        top[0]->count(), top_data)) {
+      continue;
+    }
+    Blob<Dtype> moved(bottom[i]->shape());
+    if (diff) {
+      bottom[i]->ShareDiff(moved);
+    } else {
+      caffe_copy(moved.count(), bottom_data, moved.mutable_cpu_data());
+      bottom[i]->ShareData(moved);
+    }
+  }
+}
+
 template <typename Dtype>
 void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   if (bottom.size() == 1) { return; }
   Dtype* top_data = top[0]->mutable_cpu_data();
-  int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
+  MoveMisplacedRanges(bottom, top, false);
+  int offset_concat_axis = 0;
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
@@ -78,6 +105,7 @@ void ConcatLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (bottom.size() == 1) { return; }
   const Dtype* top_diff = top[0]->cpu_diff();
+  MoveMisplacedRanges(bottom, top, true);
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
   for (int i = 0; i < bottom.size(); ++i) {
@@ -1,5 +1,6 @@
 // TODO (sergeyk): effect should not be dependent on phase. wasted memcpy.
 
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/dropout_layer.hpp"
@@ -25,6 +26,26 @@ void DropoutLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   // Set up the cache for random number generation
   // ReshapeLike does not work because rand_vec_ is of Dtype uint
   rand_vec_.Reshape(bottom[0]->shape());
+  mask_.Reshape(vector<int>(1, (bottom[0]->count() + 31) / 32));
+}
+
+// y = scale * x where the bit of the mask is set, 0 elsewhere.
+template <typename Dtype>
+static void apply_mask(const int count, const Dtype* x,
+    const unsigned int* mask, const Dtype scale, Dtype* y) {
+  const int num_words = (count + 31) / 32;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < num_words; ++i) {
+    const Dtype kept[2] = {0, scale};
+    const unsigned int bits = mask[i];
+    const int begin = i * 32;
+    const int size = std::min(32, count - begin);
+    for (int j = 0; j < size; ++j) {
+      y[begin + j] = x[begin + j] * kept[(bits >> j) & 1];
+    }
+  }
 }
 
 template <typename Dtype>
@@ -32,14 +53,11 @@ void DropoutLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  unsigned int* mask = rand_vec_.mutable_cpu_data();
   const int count = bottom[0]->count();
   if (this->phase_ == TRAIN) {
-    // Create random numbers
-    caffe_rng_bernoulli(count, 1. - threshold_, mask);
-    for (int i = 0; i < count; ++i) {
-      top_data[i] = bottom_data[i] * mask[i] * scale_;
-    }
+    unsigned int* mask = mask_.mutable_cpu_data();
+    caffe_rng_bernoulli_bits(count, 1. - threshold_, mask);
+    apply_mask(count, bottom_data, mask, scale_, top_data);
   } else {
     caffe_copy(bottom[0]->count(), bottom_data, top_data);
   }
@@ -53,11 +71,8 @@ void DropoutLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const Dtype* top_diff = top[0]->cpu_diff();
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     if (this->phase_ == TRAIN) {
-      const unsigned int* mask = rand_vec_.cpu_data();
-      const int count = bottom[0]->count();
-      for (int i = 0; i < count; ++i) {
-        bottom_diff[i] = top_diff[i] * mask[i] * scale_;
-      }
+      apply_mask(bottom[0]->count(), top_diff, mask_.cpu_data(), scale_,
+          bottom_diff);
     } else {
       caffe_copy(top[0]->count(), top_diff, bottom_diff);
     }
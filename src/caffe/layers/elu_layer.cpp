@@ -2,9 +2,17 @@
 #include <vector>
 
 #include "caffe/layers/elu_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+namespace {
+
+// The elements transformed at once through a buffer on the stack.
+const int kTileSize = 1024;
+
+}  // namespace
+
 template <typename Dtype>
 void ELULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -12,9 +20,24 @@ void ELULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
   Dtype alpha = this->layer_param_.elu_param().alpha();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + alpha * (exp(std::min(bottom_data[i], Dtype(0))) - Dtype(1));
+  // A tile at a time, so that exp runs on whole vectors and the layer may
+  // compute in place.
+  const int num_tiles = (count + kTileSize - 1) / kTileSize;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int t = 0; t < num_tiles; ++t) {
+    const int begin = t * kTileSize;
+    const int size = std::min(kTileSize, count - begin);
+    Dtype exp_x[kTileSize];
+    for (int i = 0; i < size; ++i) {
+      exp_x[i] = std::min(bottom_data[begin + i], Dtype(0));
+    }
+    caffe_exp(size, exp_x, exp_x);
+    for (int i = 0; i < size; ++i) {
+      top_data[begin + i] = std::max(bottom_data[begin + i], Dtype(0))
+          + alpha * (exp_x[i] - Dtype(1));
+    }
   }
 }
 
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -14,6 +15,12 @@ void EmbedLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   K_ = this->layer_param_.embed_param().input_dim();
   CHECK_GT(K_, 0) << "EmbedLayer input_dim must be positive.";
   bias_term_ = this->layer_param_.embed_param().bias_term();
+  sparse_gradient_ = this->layer_param_.embed_param().sparse_gradient();
+  if (sparse_gradient_) {
+    row_has_diff_.assign(K_, false);
+    diff_rows_.clear();
+    diff_rows_valid_ = false;
+  }
   // Check if we need to set up the weights
   if (this->blobs_.size() > 0) {
     LOG(INFO) << "Skipping parameter initialization";
@@ -67,13 +74,15 @@ void EmbedLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  int index;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
   for (int n = 0; n < M_; ++n) {
-    index = static_cast<int>(bottom_data[n]);
+    const int index = static_cast<int>(bottom_data[n]);
     DCHECK_GE(index, 0);
     DCHECK_LT(index, K_);
     DCHECK_EQ(static_cast<Dtype>(index), bottom_data[n]) << "non-integer input";
-    caffe_copy(N_, weight + index * N_, top_data + n * N_);
+    memcpy(top_data + n * N_, weight + index * N_, sizeof(Dtype) * N_);
   }
   if (bias_term_) {
     const Dtype* bias = this->blobs_[1]->cpu_data();
@@ -99,6 +108,10 @@ void EmbedLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       DCHECK_EQ(static_cast<Dtype>(index), bottom_data[n])
           << "non-integer input";
       caffe_axpy(N_, Dtype(1), top_diff + n * N_, weight_diff + index * N_);
+      if (sparse_gradient_ && !row_has_diff_[index]) {
+        row_has_diff_[index] = true;
+        diff_rows_.push_back(index);
+      }
     }
   }
   if (bias_term_ && this->param_propagate_down_[1]) {
@@ -109,6 +122,16 @@ void EmbedLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
 }
 
+template <typename Dtype>
+void EmbedLayer<Dtype>::ClearParamDiffRows() {
+  if (!sparse_gradient_) { return; }
+  for (int i = 0; i < diff_rows_.size(); ++i) {
+    row_has_diff_[diff_rows_[i]] = false;
+  }
+  diff_rows_.clear();
+  diff_rows_valid_ = true;
+}
+
 #ifdef CPU_ONLY
 STUB_GPU(EmbedLayer);
 #endif
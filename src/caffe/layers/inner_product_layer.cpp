@@ -78,6 +78,11 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     bias_multiplier_.Reshape(bias_shape);
     caffe_set(M_, Dtype(1), bias_multiplier_.mutable_cpu_data());
   }
+  // Only allocated once used, by a sparse Forward_cpu.
+  if (this->phase_ == TEST && !transpose_ && M_ > 1 &&
+      this->layer_param_.inner_product_param().sparse_threshold() <= 1) {
+    sparse_buffer_.Reshape(vector<int>(1, M_ * (N_ + K_)));
+  }
 }
 
 template <typename Dtype>
@@ -86,9 +91,20 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  const SparseMatrix<Dtype>* sparse_weight = this->phase_ != TEST ? NULL :
+      sparse_weights_.Get(*this->blobs_[0], transpose_ ? K_ : N_,
+          transpose_ ? N_ : K_,
+          this->layer_param_.inner_product_param().sparse_threshold());
+  if (sparse_weight && transpose_) {
+    sparse_weight->MultiplyBy(M_, bottom_data, top_data);
+  } else if (sparse_weight) {
+    sparse_weight->MultiplyTransposedBy(M_, bottom_data, top_data,
+        M_ > 1 ? sparse_buffer_.mutable_cpu_data() : NULL);
+  } else {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+        M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/lrn_layer.hpp"
@@ -5,6 +7,29 @@
 
 namespace caffe {
 
+namespace {
+
+// The number of positions the CPU cross-channel passes stream through at
+// once; the running sums of a tile stay in L1.
+const int kTileSize = 256;
+
+// y = s^-beta, without pow for the common beta of 0.75.
+template <typename Dtype>
+void lrn_negative_power(int n, const Dtype* s, Dtype beta, Dtype* y) {
+  if (beta == Dtype(0.75)) {
+    for (int i = 0; i < n; ++i) {
+      const Dtype root = std::sqrt(s[i]);
+      y[i] = Dtype(1) / (root * std::sqrt(root));
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      y[i] = std::pow(s[i], -beta);
+    }
+  }
+}
+
+}  // namespace
+
 template <typename Dtype>
 void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -110,45 +135,59 @@ void LRNLayer<Dtype>::CrossChannelForward_cpu(
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   Dtype* scale_data = scale_.mutable_cpu_data();
-  // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
-    scale_data[i] = k_;
+  const int spatial_dim = height_ * width_;
+  const int num_tiles = (spatial_dim + kTileSize - 1) / kTileSize;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < num_ * num_tiles; ++i) {
+    const int begin = (i % num_tiles) * kTileSize;
+    CrossChannelForwardTile(scale_.offset(i / num_tiles) + begin,
+        std::min(kTileSize, spatial_dim - begin), bottom_data, scale_data,
+        top_data);
+  }
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::CrossChannelForwardTile(int offset, int length,
+    const Dtype* bottom_data, Dtype* scale_data, Dtype* top_data) {
+  const int spatial_dim = height_ * width_;
+  const Dtype alpha_over_size = alpha_ / size_;
+  Dtype accum[kTileSize];
+  Dtype power[kTileSize];
+  std::fill(accum, accum + length, Dtype(0));
+  for (int c = 0; c < std::min(pre_pad_, channels_); ++c) {
+    const Dtype* head = bottom_data + offset + c * spatial_dim;
+    for (int i = 0; i < length; ++i) {
+      accum[i] += head[i] * head[i];
+    }
   }
-  Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
-  Dtype* padded_square_data = padded_square.mutable_cpu_data();
-  caffe_set(padded_square.count(), Dtype(0), padded_square_data);
-  Dtype alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < num_; ++n) {
-    // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
-        padded_square_data + padded_square.offset(0, pre_pad_));
-    // Create the first channel scale
-    for (int c = 0; c < size_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c),
-          scale_data + scale_.offset(n, 0));
+  for (int c = 0; c < channels_; ++c) {
+    const int channel_offset = offset + c * spatial_dim;
+    // The window of channel c is [c - pre_pad_, c + pre_pad_].
+    if (c + pre_pad_ < channels_) {
+      const Dtype* head = bottom_data + channel_offset + pre_pad_ * spatial_dim;
+      for (int i = 0; i < length; ++i) {
+        accum[i] += head[i] * head[i];
+      }
+    }
+    Dtype* scale = scale_data + channel_offset;
+    for (int i = 0; i < length; ++i) {
+      scale[i] = k_ + alpha_over_size * accum[i];
+    }
+    lrn_negative_power(length, scale, beta_, power);
+    const Dtype* bottom = bottom_data + channel_offset;
+    Dtype* top = top_data + channel_offset;
+    for (int i = 0; i < length; ++i) {
+      top[i] = bottom[i] * power[i];
     }
-    for (int c = 1; c < channels_; ++c) {
-      // copy previous scale
-      caffe_copy<Dtype>(height_ * width_,
-          scale_data + scale_.offset(n, c - 1),
-          scale_data + scale_.offset(n, c));
-      // add head
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c + size_ - 1),
-          scale_data + scale_.offset(n, c));
-      // subtract tail
-      caffe_axpy<Dtype>(height_ * width_, -alpha_over_size,
-          padded_square_data + padded_square.offset(0, c - 1),
-          scale_data + scale_.offset(n, c));
+    if (c - pre_pad_ >= 0) {
+      const Dtype* tail = bottom_data + channel_offset - pre_pad_ * spatial_dim;
+      for (int i = 0; i < length; ++i) {
+        accum[i] -= tail[i] * tail[i];
+      }
     }
   }
-
-  // In the end, compute output
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
 }
 
 template <typename Dtype>
@@ -185,48 +224,58 @@ void LRNLayer<Dtype>::CrossChannelBackward_cpu(
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* scale_data = scale_.cpu_data();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  Blob<Dtype> padded_ratio(1, channels_ + size_ - 1, height_, width_);
-  Blob<Dtype> accum_ratio(1, 1, height_, width_);
-  Dtype* padded_ratio_data = padded_ratio.mutable_cpu_data();
-  Dtype* accum_ratio_data = accum_ratio.mutable_cpu_data();
-  // We hack a little bit by using the diff() to store an additional result
-  Dtype* accum_ratio_times_bottom = accum_ratio.mutable_cpu_diff();
-  caffe_set(padded_ratio.count(), Dtype(0), padded_ratio_data);
-  Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
-
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, bottom_diff);
-  caffe_mul<Dtype>(scale_.count(), top_diff, bottom_diff, bottom_diff);
+  const int spatial_dim = height_ * width_;
+  const int num_tiles = (spatial_dim + kTileSize - 1) / kTileSize;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < num_ * num_tiles; ++i) {
+    const int begin = (i % num_tiles) * kTileSize;
+    CrossChannelBackwardTile(scale_.offset(i / num_tiles) + begin,
+        std::min(kTileSize, spatial_dim - begin), top_diff, top_data,
+        bottom_data, scale_data, bottom_diff);
+  }
+}
 
-  // go through individual data
-  int inverse_pre_pad = size_ - (size_ + 1) / 2;
-  for (int n = 0; n < num_; ++n) {
-    int block_offset = scale_.offset(n);
-    // first, compute diff_i * y_i / s_i
-    caffe_mul<Dtype>(channels_ * height_ * width_,
-        top_diff + block_offset, top_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    caffe_div<Dtype>(channels_ * height_ * width_,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad),
-        scale_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    // Now, compute the accumulated ratios and the bottom diff
-    caffe_set(accum_ratio.count(), Dtype(0), accum_ratio_data);
-    for (int c = 0; c < size_ - 1; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
+template <typename Dtype>
+void LRNLayer<Dtype>::CrossChannelBackwardTile(int offset, int length,
+    const Dtype* top_diff, const Dtype* top_data, const Dtype* bottom_data,
+    const Dtype* scale_data, Dtype* bottom_diff) {
+  const int spatial_dim = height_ * width_;
+  const Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
+  // accum sums diff_j * y_j / s_j over the window; the ratio of a channel is
+  // computed again when it leaves the window rather than stored.
+  Dtype accum[kTileSize];
+  Dtype power[kTileSize];
+  std::fill(accum, accum + length, Dtype(0));
+  for (int c = 0; c < std::min(pre_pad_, channels_); ++c) {
+    const int head = offset + c * spatial_dim;
+    for (int i = 0; i < length; ++i) {
+      accum[i] += top_diff[head + i] * top_data[head + i] /
+          scale_data[head + i];
+    }
+  }
+  for (int c = 0; c < channels_; ++c) {
+    const int channel_offset = offset + c * spatial_dim;
+    if (c + pre_pad_ < channels_) {
+      const int head = channel_offset + pre_pad_ * spatial_dim;
+      for (int i = 0; i < length; ++i) {
+        accum[i] += top_diff[head + i] * top_data[head + i] /
+            scale_data[head + i];
+      }
+    }
+    lrn_negative_power(length, scale_data + channel_offset, beta_, power);
+    for (int i = 0; i < length; ++i) {
+      const int j = channel_offset + i;
+      bottom_diff[j] = top_diff[j] * power[i] -
+          cache_ratio_value * bottom_data[j] * accum[i];
     }
-    for (int c = 0; c < channels_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c + size_ - 1),
-          accum_ratio_data);
-      // compute bottom diff
-      caffe_mul<Dtype>(height_ * width_,
-          bottom_data + top[0]->offset(n, c),
-          accum_ratio_data, accum_ratio_times_bottom);
-      caffe_axpy<Dtype>(height_ * width_, -cache_ratio_value,
-          accum_ratio_times_bottom, bottom_diff + top[0]->offset(n, c));
-      caffe_axpy<Dtype>(height_ * width_, -1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
+    if (c - pre_pad_ >= 0) {
+      const int tail = channel_offset - pre_pad_ * spatial_dim;
+      for (int i = 0; i < length; ++i) {
+        accum[i] -= top_diff[tail + i] * top_data[tail + i] /
+            scale_data[tail + i];
+      }
     }
   }
 }
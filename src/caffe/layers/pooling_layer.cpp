@@ -10,6 +10,68 @@ namespace caffe {
 using std::min;
 using std::max;
 
+namespace {
+
+// The number of adjacent columns reduced together, so that the loops over
+// them vectorize.
+const int kColumnBlock = 16;
+
+// The max, or the sum if sum is set, of two values. A NaN x is ignored.
+template <typename Dtype, bool sum>
+inline Dtype reduce(Dtype x, Dtype y) {
+  return sum ? x + y : (x > y ? x : y);
+}
+
+// Reduces the rows [hstart, hend) of a plane of the given width into col.
+template <typename Dtype, bool sum>
+void reduce_rows(int width, int hstart, int hend, const Dtype* plane,
+    Dtype* col) {
+  const Dtype initial = sum ? Dtype(0) : Dtype(-FLT_MAX);
+  int w = 0;
+  for (; w + kColumnBlock <= width; w += kColumnBlock) {
+    Dtype block[kColumnBlock];
+    for (int j = 0; j < kColumnBlock; ++j) {
+      block[j] = initial;
+    }
+    for (int h = hstart; h < hend; ++h) {
+      const Dtype* row = plane + h * width + w;
+      for (int j = 0; j < kColumnBlock; ++j) {
+        block[j] = reduce<Dtype, sum>(row[j], block[j]);
+      }
+    }
+    for (int j = 0; j < kColumnBlock; ++j) {
+      col[w + j] = block[j];
+    }
+  }
+  for (; w < width; ++w) {
+    Dtype value = initial;
+    for (int h = hstart; h < hend; ++h) {
+      value = reduce<Dtype, sum>(plane[h * width + w], value);
+    }
+    col[w] = value;
+  }
+}
+
+// Reduces windows of kernel columns of col, stride apart, into a block of
+// outputs whose windows all lie within col.
+template <typename Dtype, bool sum, int stride>
+void reduce_columns(int kernel, const Dtype* col, Dtype* out) {
+  Dtype block[kColumnBlock];
+  for (int j = 0; j < kColumnBlock; ++j) {
+    block[j] = col[j * stride];
+  }
+  for (int k = 1; k < kernel; ++k) {
+    for (int j = 0; j < kColumnBlock; ++j) {
+      block[j] = reduce<Dtype, sum>(col[j * stride + k], block[j]);
+    }
+  }
+  for (int j = 0; j < kColumnBlock; ++j) {
+    out[j] = block[j];
+  }
+}
+
+}  // namespace
+
 template <typename Dtype>
 void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -122,101 +184,151 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
-// TODO(Yangqing): Is there a faster way to do pooling in the channel-first
-// case?
+template <typename Dtype>
+void PoolingLayer<Dtype>::MaxPoolPlane(const Dtype* bottom, Dtype* top,
+    int* mask, Dtype* top_mask) {
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    int hstart = ph * stride_h_ - pad_h_;
+    const int hend = min(hstart + kernel_h_, height_);
+    hstart = max(hstart, 0);
+    for (int pw = 0; pw < pooled_width_; ++pw) {
+      int wstart = pw * stride_w_ - pad_w_;
+      const int wend = min(wstart + kernel_w_, width_);
+      wstart = max(wstart, 0);
+      Dtype value = -FLT_MAX;
+      int max_index = -1;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          const int index = h * width_ + w;
+          if (bottom[index] > value) {
+            value = bottom[index];
+            max_index = index;
+          }
+        }
+      }
+      const int pool_index = ph * pooled_width_ + pw;
+      top[pool_index] = value;
+      if (mask) {
+        mask[pool_index] = max_index;
+      } else {
+        top_mask[pool_index] = max_index;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::ReducePlane(const Dtype* bottom, bool average,
+    Dtype* col, Dtype* top) {
+  // The outputs [pw_begin, pw_end) have windows within the columns.
+  const int pw_begin = min((pad_w_ + stride_w_ - 1) / stride_w_,
+      pooled_width_);
+  const int pw_end = (width_ + pad_w_ < kernel_w_) ? pw_begin :
+      max(pw_begin, min(pooled_width_,
+          (width_ + pad_w_ - kernel_w_) / stride_w_ + 1));
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    int hstart = ph * stride_h_ - pad_h_;
+    int hend = min(hstart + kernel_h_, height_ + pad_h_);
+    const int pool_height = hend - hstart;
+    hstart = max(hstart, 0);
+    hend = min(hend, height_);
+    if (average) {
+      reduce_rows<Dtype, true>(width_, hstart, hend, bottom, col);
+    } else {
+      reduce_rows<Dtype, false>(width_, hstart, hend, bottom, col);
+    }
+    Dtype* out = top + ph * pooled_width_;
+    int pw = pw_begin;
+    if (stride_w_ <= 2) {
+      for (; pw + kColumnBlock <= pw_end; pw += kColumnBlock) {
+        const Dtype* window = col + pw * stride_w_ - pad_w_;
+        if (average && stride_w_ == 1) {
+          reduce_columns<Dtype, true, 1>(kernel_w_, window, out + pw);
+        } else if (average) {
+          reduce_columns<Dtype, true, 2>(kernel_w_, window, out + pw);
+        } else if (stride_w_ == 1) {
+          reduce_columns<Dtype, false, 1>(kernel_w_, window, out + pw);
+        } else {
+          reduce_columns<Dtype, false, 2>(kernel_w_, window, out + pw);
+        }
+        if (average) {
+          const Dtype pool_size = pool_height * kernel_w_;
+          for (int j = 0; j < kColumnBlock; ++j) {
+            out[pw + j] /= pool_size;
+          }
+        }
+      }
+    }
+    // The other outputs, including those whose windows are clipped.
+    const int ranges[2][2] = {{0, pw_begin}, {pw, pooled_width_}};
+    for (int r = 0; r < 2; ++r) {
+      for (int p = ranges[r][0]; p < ranges[r][1]; ++p) {
+        int wstart = p * stride_w_ - pad_w_;
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        const int pool_size = pool_height * (wend - wstart);
+        wstart = max(wstart, 0);
+        wend = min(wend, width_);
+        Dtype value = average ? Dtype(0) : Dtype(-FLT_MAX);
+        for (int w = wstart; w < wend; ++w) {
+          value = average ? value + col[w] :
+              reduce<Dtype, false>(col[w], value);
+        }
+        out[p] = average ? value / pool_size : value;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::ReducePlanes(int num_planes, const Dtype* bottom,
+    bool average, Dtype* top) {
+  const int plane_size = height_ * width_;
+  const int pooled_size = pooled_height_ * pooled_width_;
+#ifdef _OPENMP
+  #pragma omp parallel
+#endif
+  {
+    vector<Dtype> col(width_);
+#ifdef _OPENMP
+    #pragma omp for
+#endif
+    for (int i = 0; i < num_planes; ++i) {
+      ReducePlane(bottom + i * plane_size, average, &col[0],
+          top + i * pooled_size);
+    }
+  }
+}
+
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const int top_count = top[0]->count();
+  const int num_planes = bottom[0]->num() * channels_;
+  const int plane_size = height_ * width_;
+  const int pooled_size = pooled_height_ * pooled_width_;
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
-  int* mask = NULL;  // suppress warnings about uninitalized variables
-  Dtype* top_mask = NULL;
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // Initialize
-    if (use_top_mask) {
-      top_mask = top[1]->mutable_cpu_data();
-      caffe_set(top_count, Dtype(-1), top_mask);
-    } else {
-      mask = max_idx_.mutable_cpu_data();
-      caffe_set(top_count, -1, mask);
-    }
-    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
+    // Without backward in the TEST phase, the max is kept without its index.
+    if (use_top_mask || this->phase_ == TRAIN) {
+      int* mask = use_top_mask ? NULL : max_idx_.mutable_cpu_data();
+      Dtype* top_mask = use_top_mask ? top[1]->mutable_cpu_data() : NULL;
+#ifdef _OPENMP
+      #pragma omp parallel for
+#endif
+      for (int i = 0; i < num_planes; ++i) {
+        MaxPoolPlane(bottom_data + i * plane_size, top_data + i * pooled_size,
+            mask ? mask + i * pooled_size : NULL,
+            top_mask ? top_mask + i * pooled_size : NULL);
       }
+    } else {
+      ReducePlanes(num_planes, bottom_data, false, top_data);
     }
     break;
   case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
-            }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-      }
-    }
+    ReducePlanes(num_planes, bottom_data, true, top_data);
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
     NOT_IMPLEMENTED;
@@ -226,6 +338,67 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void PoolingLayer<Dtype>::MaxUnpoolPlane(const Dtype* top_diff,
+    const int* mask, const Dtype* top_mask, const Dtype* bottom,
+    Dtype* bottom_diff) {
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    for (int pw = 0; pw < pooled_width_; ++pw) {
+      const int index = ph * pooled_width_ + pw;
+      int bottom_index;
+      if (mask) {
+        bottom_index = mask[index];
+      } else if (top_mask) {
+        bottom_index = top_mask[index];
+      } else {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        const int hend = min(hstart + kernel_h_, height_);
+        const int wend = min(wstart + kernel_w_, width_);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        Dtype max_value = -FLT_MAX;
+        bottom_index = -1;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            if (bottom[h * width_ + w] > max_value) {
+              max_value = bottom[h * width_ + w];
+              bottom_index = h * width_ + w;
+            }
+          }
+        }
+      }
+      if (bottom_index >= 0) {
+        bottom_diff[bottom_index] += top_diff[index];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::AveUnpoolPlane(const Dtype* top_diff,
+    Dtype* bottom_diff) {
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    for (int pw = 0; pw < pooled_width_; ++pw) {
+      int hstart = ph * stride_h_ - pad_h_;
+      int wstart = pw * stride_w_ - pad_w_;
+      int hend = min(hstart + kernel_h_, height_ + pad_h_);
+      int wend = min(wstart + kernel_w_, width_ + pad_w_);
+      int pool_size = (hend - hstart) * (wend - wstart);
+      hstart = max(hstart, 0);
+      wstart = max(wstart, 0);
+      hend = min(hend, height_);
+      wend = min(wend, width_);
+      const Dtype diff = top_diff[ph * pooled_width_ + pw] / pool_size;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          bottom_diff[h * width_ + w] += diff;
+        }
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
@@ -234,68 +407,38 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
   const Dtype* top_diff = top[0]->cpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more codes.
+  const int num_planes = top[0]->num() * channels_;
+  const int plane_size = height_ * width_;
+  const int pooled_size = pooled_height_ * pooled_width_;
   caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
-  const int* mask = NULL;  // suppress warnings about uninitialized variables
-  const Dtype* top_mask = NULL;
   switch (this->layer_param_.pooling_param().pool()) {
-  case PoolingParameter_PoolMethod_MAX:
-    // The main loop
-    if (use_top_mask) {
-      top_mask = top[1]->cpu_data();
-    } else {
-      mask = max_idx_.cpu_data();
-    }
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            const int index = ph * pooled_width_ + pw;
-            const int bottom_index =
-                use_top_mask ? top_mask[index] : mask[index];
-            bottom_diff[bottom_index] += top_diff[index];
-          }
-        }
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
-      }
+  case PoolingParameter_PoolMethod_MAX: {
+    // In the TEST phase the maxima are found again, without a mask.
+    const int* mask = (use_top_mask || this->phase_ != TRAIN) ? NULL :
+        max_idx_.cpu_data();
+    const Dtype* top_mask = use_top_mask ? top[1]->cpu_data() : NULL;
+    const Dtype* bottom_data = (mask || top_mask) ? NULL :
+        bottom[0]->cpu_data();
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < num_planes; ++i) {
+      MaxUnpoolPlane(top_diff + i * pooled_size,
+          mask ? mask + i * pooled_size : NULL,
+          top_mask ? top_mask + i * pooled_size : NULL,
+          bottom_data ? bottom_data + i * plane_size : NULL,
+          bottom_diff + i * plane_size);
     }
     break;
+  }
   case PoolingParameter_PoolMethod_AVE:
-    // The main loop
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                bottom_diff[h * width_ + w] +=
-                  top_diff[ph * pooled_width_ + pw] / pool_size;
-              }
-            }
-          }
-        }
-        // offset
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
-      }
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < num_planes; ++i) {
+      AveUnpoolPlane(top_diff + i * pooled_size, bottom_diff + i * plane_size);
     }
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
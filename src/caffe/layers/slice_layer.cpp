@@ -72,10 +72,37 @@ void SliceLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void SliceLayer<Dtype>::MoveMisplacedRanges(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top,
+    bool diff) {
+  const Dtype* bottom_data =
+      diff ? bottom[0]->cpu_diff() : bottom[0]->cpu_data();
+  int offset = 0;
+  for (int i = 0; i < top.size(); ++i) {
+    const Dtype* top_data = diff ? top[i]->cpu_diff() : top[i]->cpu_data();
+    const bool in_place = num_slices_ == 1 && top_data == bottom_data +
+        offset;
+    offset += top[i]->count();
+    if (in_place || !caffe_overlap(top[i]->count(), top_data,
+        bottom[0]->count(), bottom_data)) {
+      continue;
+    }
+    Blob<Dtype> moved(top[i]->shape());
+    if (diff) {
+      caffe_copy(moved.count(), top_data, moved.mutable_cpu_diff());
+      top[i]->ShareDiff(moved);
+    } else {
+      top[i]->ShareData(moved);
+    }
+  }
+}
+
 template <typename Dtype>
 void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   if (top.size() == 1) { return; }
+  MoveMisplacedRanges(bottom, top, false);
   int offset_slice_axis = 0;
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
@@ -97,6 +124,7 @@ template <typename Dtype>
 void SliceLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0] || top.size() == 1) { return; }
+  MoveMisplacedRanges(bottom, top, true);
   int offset_slice_axis = 0;
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
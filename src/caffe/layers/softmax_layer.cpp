@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <vector>
 
 #include "caffe/layers/softmax_layer.hpp"
@@ -6,16 +8,120 @@
 
 namespace caffe {
 
+namespace {
+
+// The number of positions of the inner dimensions, or of values of a row
+// when there are none, processed at once; a tile stays in cache between its
+// passes.
+const int kTileSize = 256;
+// Rows are split into at most this many blocks.
+const int kMaxBlocks = 64;
+
+// y = softmax(x) over n contiguous values, reading x once: each block is
+// exponentiated against the running max as it is read, and the blocks are
+// rescaled to the final max and sum at the end.
+template <typename Dtype>
+void softmax_row(int n, const Dtype* x, Dtype* y) {
+  const int block_size = std::max(kTileSize, (n + kMaxBlocks - 1) / kMaxBlocks);
+  Dtype block_max[kMaxBlocks];
+  Dtype max = -std::numeric_limits<Dtype>::infinity();
+  Dtype sum = 0;
+  for (int b = 0, begin = 0; begin < n; ++b, begin += block_size) {
+    const int length = std::min(block_size, n - begin);
+    const Dtype* x_block = x + begin;
+    Dtype* y_block = y + begin;
+    Dtype new_max = max;
+    for (int i = 0; i < length; ++i) {
+      new_max = std::max(new_max, x_block[i]);
+    }
+    if (new_max > max) {
+      sum *= std::exp(max - new_max);
+      max = new_max;
+    }
+    block_max[b] = max;
+    for (int i = 0; i < length; ++i) {
+      y_block[i] = x_block[i] - max;
+    }
+    caffe_exp<Dtype>(length, y_block, y_block);
+    for (int i = 0; i < length; ++i) {
+      sum += y_block[i];
+    }
+  }
+  for (int b = 0, begin = 0; begin < n; ++b, begin += block_size) {
+    const int length = std::min(block_size, n - begin);
+    caffe_scal<Dtype>(length, std::exp(block_max[b] - max) / sum, y + begin);
+  }
+}
+
+// y = softmax(x) over channels for length positions, with the channels
+// stride apart.
+template <typename Dtype>
+void softmax_tile(int channels, int stride, int length, const Dtype* x,
+    Dtype* y) {
+  Dtype max[kTileSize];
+  Dtype sum[kTileSize];
+  std::copy(x, x + length, max);
+  for (int c = 1; c < channels; ++c) {
+    const Dtype* x_c = x + c * stride;
+    for (int i = 0; i < length; ++i) {
+      max[i] = std::max(max[i], x_c[i]);
+    }
+  }
+  std::fill(sum, sum + length, Dtype(0));
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* x_c = x + c * stride;
+    Dtype* y_c = y + c * stride;
+    for (int i = 0; i < length; ++i) {
+      y_c[i] = x_c[i] - max[i];
+    }
+    caffe_exp<Dtype>(length, y_c, y_c);
+    for (int i = 0; i < length; ++i) {
+      sum[i] += y_c[i];
+    }
+  }
+  for (int i = 0; i < length; ++i) {
+    sum[i] = Dtype(1) / sum[i];
+  }
+  for (int c = 0; c < channels; ++c) {
+    Dtype* y_c = y + c * stride;
+    for (int i = 0; i < length; ++i) {
+      y_c[i] *= sum[i];
+    }
+  }
+}
+
+// dx = (dy - dot(dy, y)) * y over channels for length positions, with the
+// channels stride apart.
+template <typename Dtype>
+void softmax_backward_tile(int channels, int stride, int length,
+    const Dtype* y, const Dtype* dy, Dtype* dx) {
+  Dtype dot[kTileSize];
+  std::fill(dot, dot + length, Dtype(0));
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* y_c = y + c * stride;
+    const Dtype* dy_c = dy + c * stride;
+    for (int i = 0; i < length; ++i) {
+      dot[i] += dy_c[i] * y_c[i];
+    }
+  }
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* y_c = y + c * stride;
+    const Dtype* dy_c = dy + c * stride;
+    Dtype* dx_c = dx + c * stride;
+    for (int i = 0; i < length; ++i) {
+      dx_c[i] = (dy_c[i] - dot[i]) * y_c[i];
+    }
+  }
+}
+
+}  // namespace
+
 template <typename Dtype>
 void SoftmaxLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   softmax_axis_ =
       bottom[0]->CanonicalAxisIndex(this->layer_param_.softmax_param().axis());
   top[0]->ReshapeLike(*bottom[0]);
-  vector<int> mult_dims(1, bottom[0]->shape(softmax_axis_));
-  sum_multiplier_.Reshape(mult_dims);
-  Dtype* multiplier_data = sum_multiplier_.mutable_cpu_data();
-  caffe_set(sum_multiplier_.count(), Dtype(1), multiplier_data);
   outer_num_ = bottom[0]->count(0, softmax_axis_);
   inner_num_ = bottom[0]->count(softmax_axis_ + 1);
   vector<int> scale_dims = bottom[0]->shape();
@@ -28,34 +134,26 @@ void SoftmaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  int channels = bottom[0]->shape(softmax_axis_);
-  int dim = bottom[0]->count() / outer_num_;
-  caffe_copy(bottom[0]->count(), bottom_data, top_data);
-  // We need to subtract the max to avoid numerical issues, compute the exp,
-  // and then normalize.
-  for (int i = 0; i < outer_num_; ++i) {
-    // initialize scale_data to the first plane
-    caffe_copy(inner_num_, bottom_data + i * dim, scale_data);
-    for (int j = 0; j < channels; j++) {
-      for (int k = 0; k < inner_num_; k++) {
-        scale_data[k] = std::max(scale_data[k],
-            bottom_data[i * dim + j * inner_num_ + k]);
-      }
-    }
-    // subtraction
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, inner_num_,
-        1, -1., sum_multiplier_.cpu_data(), scale_data, 1., top_data);
-    // exponentiation
-    caffe_exp<Dtype>(dim, top_data, top_data);
-    // sum after exp
-    caffe_cpu_gemv<Dtype>(CblasTrans, channels, inner_num_, 1.,
-        top_data, sum_multiplier_.cpu_data(), 0., scale_data);
-    // division
-    for (int j = 0; j < channels; j++) {
-      caffe_div(inner_num_, top_data, scale_data, top_data);
-      top_data += inner_num_;
+  const int channels = bottom[0]->shape(softmax_axis_);
+  const int dim = channels * inner_num_;
+  if (inner_num_ == 1) {
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < outer_num_; ++i) {
+      softmax_row(channels, bottom_data + i * dim, top_data + i * dim);
     }
+    return;
+  }
+  const int num_tiles = (inner_num_ + kTileSize - 1) / kTileSize;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int t = 0; t < outer_num_ * num_tiles; ++t) {
+    const int begin = (t % num_tiles) * kTileSize;
+    const int offset = t / num_tiles * dim + begin;
+    softmax_tile(channels, inner_num_, std::min(kTileSize, inner_num_ - begin),
+        bottom_data + offset, top_data + offset);
   }
 }
 
@@ -66,26 +164,36 @@ void SoftmaxLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const Dtype* top_diff = top[0]->cpu_diff();
   const Dtype* top_data = top[0]->cpu_data();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  int channels = top[0]->shape(softmax_axis_);
-  int dim = top[0]->count() / outer_num_;
-  caffe_copy(top[0]->count(), top_diff, bottom_diff);
-  for (int i = 0; i < outer_num_; ++i) {
-    // compute dot(top_diff, top_data) and subtract them from the bottom diff
-    for (int k = 0; k < inner_num_; ++k) {
-      scale_data[k] = caffe_cpu_strided_dot<Dtype>(channels,
-          bottom_diff + i * dim + k, inner_num_,
-          top_data + i * dim + k, inner_num_);
+  const int channels = top[0]->shape(softmax_axis_);
+  const int dim = channels * inner_num_;
+  if (inner_num_ == 1) {
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < outer_num_; ++i) {
+      const Dtype* y = top_data + i * dim;
+      const Dtype* dy = top_diff + i * dim;
+      Dtype* dx = bottom_diff + i * dim;
+      const Dtype dot = caffe_cpu_dot(channels, dy, y);
+      for (int c = 0; c < channels; ++c) {
+        dx[c] = (dy[c] - dot) * y[c];
+      }
     }
-    // subtraction
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, inner_num_, 1,
-        -1., sum_multiplier_.cpu_data(), scale_data, 1., bottom_diff + i * dim);
+    return;
+  }
+  const int num_tiles = (inner_num_ + kTileSize - 1) / kTileSize;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int t = 0; t < outer_num_ * num_tiles; ++t) {
+    const int begin = (t % num_tiles) * kTileSize;
+    const int offset = t / num_tiles * dim + begin;
+    softmax_backward_tile(channels, inner_num_,
+        std::min(kTileSize, inner_num_ - begin), top_data + offset,
+        top_diff + offset, bottom_diff + offset);
   }
-  // elementwise multiplication
-  caffe_mul(top[0]->count(), bottom_diff, top_data, bottom_diff);
 }
 
-
 #ifdef CPU_ONLY
 STUB_GPU(SoftmaxLayer);
 #endif
@@ -95,18 +95,21 @@ void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
   int dim = prob_.count() / outer_num_;
   int count = 0;
   Dtype loss = 0;
-  for (int i = 0; i < outer_num_; ++i) {
-    for (int j = 0; j < inner_num_; j++) {
-      const int label_value = static_cast<int>(label[i * inner_num_ + j]);
-      if (has_ignore_label_ && label_value == ignore_label_) {
-        continue;
-      }
-      DCHECK_GE(label_value, 0);
-      DCHECK_LT(label_value, prob_.shape(softmax_axis_));
-      loss -= log(std::max(prob_data[i * dim + label_value * inner_num_ + j],
-                           Dtype(FLT_MIN)));
-      ++count;
+#ifdef _OPENMP
+  #pragma omp parallel for reduction(+: loss, count)
+#endif
+  for (int n = 0; n < outer_num_ * inner_num_; ++n) {
+    const int i = n / inner_num_;
+    const int j = n % inner_num_;
+    const int label_value = static_cast<int>(label[n]);
+    if (has_ignore_label_ && label_value == ignore_label_) {
+      continue;
     }
+    DCHECK_GE(label_value, 0);
+    DCHECK_LT(label_value, prob_.shape(softmax_axis_));
+    loss -= log(std::max(prob_data[i * dim + label_value * inner_num_ + j],
+                         Dtype(FLT_MIN)));
+    ++count;
   }
   top[0]->mutable_cpu_data()[0] = loss / get_normalizer(normalization_, count);
   if (top.size() == 2) {
@@ -1,3 +1,5 @@
+#include <boost/thread.hpp>
+
 #include <algorithm>
 #include <map>
 #include <set>
@@ -15,21 +17,30 @@
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/trace.hpp"
 #include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/weight_loader.hpp"
+#include "caffe/util/weight_file.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
 namespace caffe {
 
+static bool IsHDF5Filename(const string& filename) {
+  return filename.size() >= 3 &&
+      filename.compare(filename.size() - 3, 3, ".h5") == 0;
+}
+
 template <typename Dtype>
-Net<Dtype>::Net(const NetParameter& param, const Net* root_net)
-    : root_net_(root_net) {
+Net<Dtype>::Net(const NetParameter& param, const Net* root_net,
+    const Net* weights_net)
+    : root_net_(root_net), weights_net_(weights_net) {
   Init(param);
 }
 
 template <typename Dtype>
 Net<Dtype>::Net(const string& param_file, Phase phase, const Net* root_net)
-    : root_net_(root_net) {
+    : root_net_(root_net), weights_net_(NULL) {
   NetParameter param;
   ReadNetParamsFromTextFileOrDie(param_file, &param);
   param.mutable_state()->set_phase(phase);
@@ -57,6 +68,8 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   map<string, int> blob_name_to_idx;
   set<string> available_blobs;
   memory_used_ = 0;
+  memory_.reset(new MemoryAccount(MemoryAccount::Current()));
+  MemoryScope net_scope(memory_.get());
   // For each layer, set up its input and output
   bottom_vecs_.resize(param.layer_size());
   top_vecs_.resize(param.layer_size());
@@ -88,6 +101,9 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       layers_.push_back(LayerRegistry<Dtype>::CreateLayer(layer_param));
     }
     layer_names_.push_back(layer_param.name());
+    layer_memory_.push_back(
+        shared_ptr<MemoryAccount>(new MemoryAccount(memory_)));
+    MemoryScope layer_scope(layer_memory_[layer_id].get());
     LOG_IF(INFO, Caffe::root_solver())
         << "Creating Layer " << layer_param.name();
     bool need_backward = false;
@@ -136,6 +152,18 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
             << layer_param.name();
       }
     } else {
+      if (weights_net_ && layer->blobs().empty() &&
+          weights_net_->has_layer(layer_param.name())) {
+        // With params already set, SetUp skips their fillers.
+        const vector<shared_ptr<Blob<Dtype> > >& source_blobs =
+            weights_net_->layer_by_name(layer_param.name())->blobs();
+        for (int i = 0; i < source_blobs.size(); ++i) {
+          shared_ptr<Blob<Dtype> > blob(
+              new Blob<Dtype>(source_blobs[i]->shape()));
+          blob->ShareData(*source_blobs[i]);
+          layer->blobs().push_back(blob);
+        }
+      }
       layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
     }
     LOG_IF(INFO, Caffe::root_solver())
@@ -270,6 +298,8 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  InitRecomputeSegments(param);
+  ShareConcatRanges();
   debug_info_ = param.debug_info();
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
@@ -532,6 +562,167 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::InitRecomputeSegments(const NetParameter& param) {
+  recompute_segments_.clear();
+  recompute_blob_ids_.clear();
+  layer_recompute_segment_.assign(layers_.size(), -1);
+  // The layer that first computes each blob, and the last layer using it.
+  vector<int> blob_producer(blobs_.size(), -1);
+  vector<int> blob_last_consumer(blobs_.size(), -1);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      blob_last_consumer[bottom_id_vecs_[layer_id][i]] = layer_id;
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = top_id_vecs_[layer_id][i];
+      if (blob_producer[blob_id] < 0) { blob_producer[blob_id] = layer_id; }
+    }
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (!param.layer(layer_id).recompute()) { continue; }
+    CHECK_GT(bottom_vecs_[layer_id].size(), 0) << "Layer "
+        << layer_names_[layer_id] << " has no bottom to be recomputed from.";
+    CHECK(layers_[layer_id]->AllowRecompute()) << "Layer "
+        << layer_names_[layer_id] << " of type " << layers_[layer_id]->type()
+        << " cannot be recomputed.";
+    if (layer_id == 0 || layer_recompute_segment_[layer_id - 1] < 0) {
+      recompute_segments_.push_back(make_pair(layer_id, layer_id));
+    }
+    recompute_segments_.back().second = layer_id;
+    layer_recompute_segment_[layer_id] = recompute_segments_.size() - 1;
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = top_id_vecs_[layer_id][i];
+      CHECK_GE(blob_producer[blob_id], recompute_segments_.back().first)
+          << "Layer " << layer_names_[layer_id] << " cannot be recomputed "
+          << "in place on blob " << blob_names_[blob_id]
+          << " computed outside of its recompute segment.";
+    }
+  }
+  // Blobs computed inside a segment and not used after it are released.
+  recompute_blob_ids_.resize(recompute_segments_.size());
+  set<int> output_blob_ids(net_output_blob_indices_.begin(),
+      net_output_blob_indices_.end());
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blob_producer[blob_id] < 0) { continue; }
+    const int segment = layer_recompute_segment_[blob_producer[blob_id]];
+    if (segment < 0 ||
+        blob_last_consumer[blob_id] > recompute_segments_[segment].second ||
+        blob_loss_weights_[blob_id] != Dtype(0) ||
+        output_blob_ids.count(blob_id)) {
+      continue;
+    }
+    recompute_blob_ids_[segment].push_back(blob_id);
+  }
+  for (int i = 0; i < recompute_segments_.size(); ++i) {
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Recomputing layers " << layer_names_[recompute_segments_[i].first]
+        << " to " << layer_names_[recompute_segments_[i].second]
+        << " in backward, releasing " << recompute_blob_ids_[i].size()
+        << " blobs after forward.";
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ReleaseRecomputeSegment(const int segment) {
+  const vector<int>& blob_ids = recompute_blob_ids_[segment];
+  // Memory also held by a blob that is kept, such as the top of a Reshape
+  // layer used after the segment, must stay: recomputing into new memory
+  // would leave that blob with the old data and its gradient unseen.
+  map<const SyncedMemory*, int> holders;
+  for (int i = 0; i < blob_ids.size(); ++i) {
+    ++holders[blobs_[blob_ids[i]]->data().get()];
+    ++holders[blobs_[blob_ids[i]]->diff().get()];
+  }
+  vector<Blob<Dtype>*> released;
+  for (int i = 0; i < blob_ids.size(); ++i) {
+    Blob<Dtype>* blob = blobs_[blob_ids[i]].get();
+    if (holders[blob->data().get()] == blob->data().use_count() &&
+        holders[blob->diff().get()] == blob->diff().use_count()) {
+      released.push_back(blob);
+    }
+  }
+  for (int i = 0; i < released.size(); ++i) {
+    released[i]->Release();
+  }
+}
+
+// Whether blobs of the shape of ranges, concatenated in order, lie one after
+// the other in base: when the axes before the one they are concatenated
+// along have size one.
+template <typename Dtype>
+static bool ContiguousRanges(const vector<Blob<Dtype>*>& ranges,
+    const Blob<Dtype>& base) {
+  int axis = 0;
+  while (axis < base.num_axes() &&
+         ranges[0]->shape(axis) == base.shape(axis)) {
+    ++axis;
+  }
+  return axis == base.num_axes() || base.count(0, axis) == 1;
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareConcatRanges() {
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  // Blobs that a layer overwrites in place, and those released between
+  // passes, keep their own memory.
+  vector<bool> written_in_place(blobs_.size(), false);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    for (int i = 0; i < top_ids.size(); ++i) {
+      if (std::find(bottom_ids.begin(), bottom_ids.end(), top_ids[i]) !=
+          bottom_ids.end()) {
+        written_in_place[top_ids[i]] = true;
+      }
+    }
+  }
+  vector<bool> released(blobs_.size(), false);
+  for (int i = 0; i < recompute_blob_ids_.size(); ++i) {
+    for (int j = 0; j < recompute_blob_ids_[i].size(); ++j) {
+      released[recompute_blob_ids_[i][j]] = true;
+    }
+  }
+  // From the top, so that the ranges of a concatenation that is itself a
+  // range end up in the outermost blob.
+  for (int layer_id = layers_.size() - 1; layer_id >= 0; --layer_id) {
+    const string type = layers_[layer_id]->type();
+    const bool concat = (type == "Concat");
+    if (!concat && type != "Slice") { continue; }
+    // A Concat top written in place would overwrite its bottoms, and a Slice
+    // top written in place its bottom, while the layers computing them may
+    // still need them in backward.
+    const vector<int>& range_ids =
+        concat ? bottom_id_vecs_[layer_id] : top_id_vecs_[layer_id];
+    const vector<Blob<Dtype>*>& ranges =
+        concat ? bottom_vecs_[layer_id] : top_vecs_[layer_id];
+    const int base_id =
+        concat ? top_id_vecs_[layer_id][0] : bottom_id_vecs_[layer_id][0];
+    Blob<Dtype>* base = blobs_[base_id].get();
+    if (ranges.size() < 2 || base->count() == 0 || released[base_id] ||
+        (concat && written_in_place[base_id]) ||
+        !ContiguousRanges(ranges, *base)) {
+      continue;
+    }
+    // The diffs are shared too where there is a backward pass through them.
+    const bool share_diff = blob_need_backward_[base_id];
+    bool shareable = true;
+    for (int i = 0; i < ranges.size() && shareable; ++i) {
+      shareable = !released[range_ids[i]] &&
+          (concat || !written_in_place[range_ids[i]]) &&
+          ranges[i]->data().use_count() == 1 &&
+          (!share_diff || ranges[i]->diff().use_count() == 1);
+    }
+    if (!shareable) { continue; }
+    int offset = 0;
+    for (int i = 0; i < ranges.size(); ++i) {
+      ranges[i]->ShareDataRange(base, offset);
+      if (share_diff) { ranges[i]->ShareDiffRange(base, offset); }
+      offset += ranges[i]->count();
+    }
+  }
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
@@ -539,9 +730,20 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
-    Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
-    loss += layer_loss;
+    {
+      TraceScope trace("forward", layer_names_[i]);
+      if (weight_loader_ && weight_loader_layer_ids_[i] >= 0) {
+        weight_loader_->Load(weight_loader_layer_ids_[i]);
+        weight_loader_layer_ids_[i] = -1;
+      }
+      MemoryScope memory_scope(layer_memory_[i].get());
+      loss += layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    }
     if (debug_info_) { ForwardDebugInfo(i); }
+    const int segment = layer_recompute_segment_[i];
+    if (segment >= 0 && i == recompute_segments_[segment].second) {
+      ReleaseRecomputeSegment(segment);
+    }
   }
   return loss;
 }
@@ -582,12 +784,31 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  int recomputed_segment = -1;
   for (int i = start; i >= end; --i) {
+    const int segment = layer_recompute_segment_[i];
     if (layer_need_backward_[i]) {
-      layers_[i]->Backward(
-          top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      if (segment >= 0 && segment != recomputed_segment) {
+        // Recompute the activations released after the segment's Forward.
+        for (int j = recompute_segments_[segment].first;
+             j <= recompute_segments_[segment].second; ++j) {
+          TraceScope trace("recompute", layer_names_[j]);
+          MemoryScope memory_scope(layer_memory_[j].get());
+          layers_[j]->Forward(bottom_vecs_[j], top_vecs_[j]);
+        }
+        recomputed_segment = segment;
+      }
+      {
+        TraceScope trace("backward", layer_names_[i]);
+        MemoryScope memory_scope(layer_memory_[i].get());
+        layers_[i]->Backward(
+            top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      }
       if (debug_info_) { BackwardDebugInfo(i); }
     }
+    if (segment >= 0 && (i == end || i == recompute_segments_[segment].first)) {
+      ReleaseRecomputeSegment(segment);
+    }
   }
 }
 
@@ -672,6 +893,9 @@ void Net<Dtype>::UpdateDebugInfo(const int param_id) {
 
 template <typename Dtype>
 void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
+  WaitForTrainedLayers();
+  weight_loader_ = other->weight_loader_;
+  weight_loader_layer_ids_.assign(layers_.size(), -1);
   int num_source_layers = other->layers().size();
   for (int i = 0; i < num_source_layers; ++i) {
     Layer<Dtype>* source_layer = other->layers()[i].get();
@@ -699,6 +923,44 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
           << target_blobs[j]->shape_string();
       target_blobs[j]->ShareData(*source_blob);
     }
+    if (weight_loader_) {
+      weight_loader_layer_ids_[target_layer_id] =
+          other->weight_loader_layer_ids_[i];
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFrom(const Net* other) {
+  WaitForTrainedLayers();
+  other->WaitForTrainedLayers();
+  int num_source_layers = other->layers().size();
+  for (int i = 0; i < num_source_layers; ++i) {
+    Layer<Dtype>* source_layer = other->layers()[i].get();
+    const string& source_layer_name = other->layer_names()[i];
+    int target_layer_id = 0;
+    while (target_layer_id != layer_names_.size() &&
+        layer_names_[target_layer_id] != source_layer_name) {
+      ++target_layer_id;
+    }
+    if (target_layer_id == layer_names_.size()) {
+      DLOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    DLOG(INFO) << "Copying source layer " << source_layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    CHECK_EQ(target_blobs.size(), source_layer->blobs().size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      Blob<Dtype>* source_blob = source_layer->blobs()[j].get();
+      CHECK(target_blobs[j]->shape() == source_blob->shape())
+          << "Cannot copy param " << j << " weights from layer '"
+          << source_layer_name << "'; shape mismatch.  Source param shape is "
+          << source_blob->shape_string() << "; target param shape is "
+          << target_blobs[j]->shape_string();
+      target_blobs[j]->CopyFrom(*source_blob);
+    }
   }
 }
 
@@ -734,12 +996,52 @@ void Net<Dtype>::Backward() {
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
+    MemoryScope memory_scope(layer_memory_[i].get());
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  ShareConcatRanges();
+}
+
+template <typename Dtype>
+void Net<Dtype>::Reserve(const vector<vector<int> >& max_input_shapes) {
+  CHECK_EQ(max_input_shapes.size(), net_input_blobs_.size())
+      << "Reserve takes one shape per net input.";
+  MemoryScope net_scope(memory_.get());
+  vector<vector<int> > input_shapes(net_input_blobs_.size());
+  for (int i = 0; i < net_input_blobs_.size(); ++i) {
+    input_shapes[i] = net_input_blobs_[i]->shape();
+    net_input_blobs_[i]->Reshape(max_input_shapes[i]);
+  }
+  Reshape();
+  for (int i = 0; i < blobs_.size(); ++i) {
+    switch (Caffe::mode()) {
+    case Caffe::CPU:
+      blobs_[i]->mutable_cpu_data();
+      if (phase_ == TRAIN) { blobs_[i]->mutable_cpu_diff(); }
+      break;
+    case Caffe::GPU:
+      blobs_[i]->mutable_gpu_data();
+      if (phase_ == TRAIN) { blobs_[i]->mutable_gpu_diff(); }
+      break;
+    }
+  }
+  for (int i = 0; i < net_input_blobs_.size(); ++i) {
+    net_input_blobs_[i]->Reshape(input_shapes[i]);
+  }
+  Reshape();
+}
+
+template <typename Dtype>
+void Net<Dtype>::ReleaseBlobs() {
+  for (int i = 0; i < blobs_.size(); ++i) {
+    blobs_[i]->Release();
+    blobs_[i]->ShrinkToFit();
+  }
 }
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
+  WaitForTrainedLayers();
   int num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
     const LayerParameter& source_layer = param.layer(i);
@@ -778,24 +1080,176 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
-  if (trained_filename.size() >= 3 &&
-      trained_filename.compare(trained_filename.size() - 3, 3, ".h5") == 0) {
+  if (IsHDF5Filename(trained_filename)) {
     CopyTrainedLayersFromHDF5(trained_filename);
+  } else if (WeightFile::IsWeightFile(trained_filename)) {
+    CopyTrainedLayersFromWeightFile(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
   }
 }
 
+// Whether a param of the given shape in a weight file fits target. Params
+// saved with the deprecated 4-D shape (num, channels, height, width) fit a
+// target of up to four axes padded with leading ones, as in
+// Blob::ShapeEquals.
+template <typename Dtype>
+static bool LegacyShapeEquals(const vector<int>& shape,
+    const Blob<Dtype>& target) {
+  if (shape == target.shape()) { return true; }
+  if (shape.size() != 4 || target.num_axes() > 4) { return false; }
+  for (int i = 0; i < 4; ++i) {
+    if (shape[i] != target.LegacyShape(i - 4)) { return false; }
+  }
+  return true;
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromWeightFile(
+    const string trained_filename) {
+  WaitForTrainedLayers();
+  WeightFile file(trained_filename);
+  const vector<WeightFile::Layer>& source_layers = file.layers();
+  for (int i = 0; i < source_layers.size(); ++i) {
+    const WeightFile::Layer& source_layer = source_layers[i];
+    int target_layer_id = 0;
+    while (target_layer_id != layer_names_.size() &&
+        layer_names_[target_layer_id] != source_layer.name) {
+      ++target_layer_id;
+    }
+    if (target_layer_id == layer_names_.size()) {
+      LOG(INFO) << "Ignoring source layer " << source_layer.name;
+      continue;
+    }
+    DLOG(INFO) << "Mapping source layer " << source_layer.name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    CHECK_EQ(target_blobs.size(), source_layer.params.size())
+        << "Incompatible number of blobs for layer " << source_layer.name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      const WeightFile::Param& source = source_layer.params[j];
+      Blob<Dtype>* target = target_blobs[j].get();
+      if (!LegacyShapeEquals(source.shape, *target)) {
+        LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
+            << source_layer.name << "'; shape mismatch.  Source param shape is "
+            << Blob<Dtype>(source.shape).shape_string()
+            << "; target param shape is " << target->shape_string() << ". "
+            << "To learn this layer's parameters from scratch rather than "
+            << "copying from a saved net, rename the layer.";
+      }
+      CHECK_EQ(source.count, target->count());
+      const bool same_type = (source.type == WeightFile::DOUBLE) ==
+          (sizeof(Dtype) == sizeof(double));
+      if (same_type &&
+          target->data()->size() == target->count() * sizeof(Dtype)) {
+        // Shared params share the SyncedMemory, so all of them follow.
+        target->data()->set_cpu_data(source.data, file.mapping());
+      } else if (source.type == WeightFile::DOUBLE) {
+        const double* source_data = static_cast<const double*>(source.data);
+        Dtype* target_data = target->mutable_cpu_data();
+        for (int k = 0; k < target->count(); ++k) {
+          target_data[k] = source_data[k];
+        }
+      } else {
+        const float* source_data = static_cast<const float*>(source.data);
+        Dtype* target_data = target->mutable_cpu_data();
+        for (int k = 0; k < target->count(); ++k) {
+          target_data[k] = source_data[k];
+        }
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
     const string trained_filename) {
-  NetParameter param;
-  ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
-  CopyTrainedLayersFrom(param);
+  vector<int> layer_ids;
+  shared_ptr<WeightLoader<Dtype> > loader =
+      IndexTrainedLayers(trained_filename, &layer_ids);
+  if (!loader) {
+    NetParameter param;
+    ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
+    CopyTrainedLayersFrom(param);
+    return;
+  }
+  // The calling thread loads layers too.
+  loader->Start(std::max<int>(boost::thread::hardware_concurrency(), 1) - 1);
+  loader->LoadAll();
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromLazily(const string trained_filename,
+    int num_threads) {
+  if (IsHDF5Filename(trained_filename) ||
+      WeightFile::IsWeightFile(trained_filename)) {
+    CopyTrainedLayersFrom(trained_filename);
+    return;
+  }
+  vector<int> layer_ids;
+  shared_ptr<WeightLoader<Dtype> > loader =
+      IndexTrainedLayers(trained_filename, &layer_ids);
+  if (!loader) {
+    NetParameter param;
+    ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
+    CopyTrainedLayersFrom(param);
+    return;
+  }
+  loader->Start(num_threads);
+  weight_loader_ = loader;
+  weight_loader_layer_ids_ = layer_ids;
+}
+
+template <typename Dtype>
+void Net<Dtype>::WaitForTrainedLayers() const {
+  if (weight_loader_) {
+    weight_loader_->LoadAll();
+  }
+}
+
+template <typename Dtype>
+shared_ptr<WeightLoader<Dtype> > Net<Dtype>::IndexTrainedLayers(
+    const string& trained_filename, vector<int>* layer_ids) {
+  WaitForTrainedLayers();
+  weight_loader_.reset();
+  weight_loader_layer_ids_.clear();
+  shared_ptr<WeightLoader<Dtype> > loader(
+      new WeightLoader<Dtype>(trained_filename));
+  if (!loader->indexed()) {
+    return shared_ptr<WeightLoader<Dtype> >();
+  }
+  layer_ids->assign(layers_.size(), -1);
+  for (int i = 0; i < loader->num_layers(); ++i) {
+    const string& source_layer_name = loader->layer_name(i);
+    if (layer_names_index_.find(source_layer_name) ==
+        layer_names_index_.end()) {
+      LOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    (*layer_ids)[layer_names_index_[source_layer_name]] = i;
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if ((*layer_ids)[layer_id] < 0) {
+      continue;
+    }
+    // Shared params are loaded once, by the layer owning them if it is
+    // loaded, as the loading threads would otherwise race on them.
+    vector<shared_ptr<Blob<Dtype> > > targets = layers_[layer_id]->blobs();
+    for (int j = 0; j < targets.size(); ++j) {
+      const int owner = param_owners_[param_id_vecs_[layer_id][j]];
+      if (owner >= 0 &&
+          (*layer_ids)[param_layer_indices_[owner].first] >= 0) {
+        targets[j].reset();
+      }
+    }
+    loader->SetTargets((*layer_ids)[layer_id], targets);
+  }
+  return loader;
 }
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
+  WaitForTrainedLayers();
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
                            H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
@@ -846,6 +1300,7 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
 
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
+  WaitForTrainedLayers();
   param->Clear();
   param->set_name(name_);
   // Add bottom and top
@@ -858,6 +1313,7 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  WaitForTrainedLayers();
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -915,8 +1371,69 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::Update() {
+  WaitForTrainedLayers();
   for (int i = 0; i < learnable_params_.size(); ++i) {
-    learnable_params_[i]->Update();
+    const vector<int>* rows = learnable_param_diff_rows(i);
+    if (!rows) {
+      learnable_params_[i]->Update();
+      continue;
+    }
+    Blob<Dtype>* blob = learnable_params_[i];
+    const int width = blob->count(1);
+    const Dtype* diff = blob->cpu_diff();
+    Dtype* data = blob->mutable_cpu_data();
+    for (int j = 0; j < rows->size(); ++j) {
+      const int offset = (*rows)[j] * width;
+      caffe_axpy(width, Dtype(-1), diff + offset, data + offset);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::GatherParamDiffRows() {
+  param_diff_rows_.clear();
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  const int num_params = learnable_params_.size();
+  param_diff_rows_.resize(num_params, NULL);
+  merged_param_diff_rows_.resize(num_params);
+  vector<int> num_layers(num_params, 0);
+  vector<bool> any_row(num_params, false);
+  for (int i = 0; i < params_.size(); ++i) {
+    const int param_id = learnable_param_ids_[i];
+    if (any_row[param_id]) { continue; }
+    const pair<int, int>& index = param_layer_indices_[i];
+    const vector<int>* layer_rows =
+        layers_[index.first]->param_diff_rows(index.second);
+    if (!layer_rows) {
+      any_row[param_id] = true;
+      param_diff_rows_[param_id] = NULL;
+      continue;
+    }
+    if (++num_layers[param_id] == 1) {
+      param_diff_rows_[param_id] = layer_rows;
+      continue;
+    }
+    // A shared param: merge the rows of every layer using it.
+    vector<int>& merged = merged_param_diff_rows_[param_id];
+    if (num_layers[param_id] == 2) {
+      merged = *param_diff_rows_[param_id];
+      param_diff_rows_[param_id] = &merged;
+    }
+    merged.insert(merged.end(), layer_rows->begin(), layer_rows->end());
+  }
+  for (int param_id = 0; param_id < num_params; ++param_id) {
+    if (any_row[param_id] || num_layers[param_id] < 2) { continue; }
+    vector<int>& merged = merged_param_diff_rows_[param_id];
+    std::sort(merged.begin(), merged.end());
+    merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::InvalidateParamDiffRows() {
+  param_diff_rows_.clear();
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->InvalidateParamDiffRows();
   }
 }
 
@@ -925,10 +1442,20 @@ void Net<Dtype>::ClearParamDiffs() {
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
-    case Caffe::CPU:
-      caffe_set(blob->count(), static_cast<Dtype>(0),
-                blob->mutable_cpu_diff());
+    case Caffe::CPU: {
+      const vector<int>* rows = learnable_param_diff_rows(i);
+      if (!rows) {
+        caffe_set(blob->count(), static_cast<Dtype>(0),
+                  blob->mutable_cpu_diff());
+        break;
+      }
+      const int width = blob->count(1);
+      Dtype* diff = blob->mutable_cpu_diff();
+      for (int j = 0; j < rows->size(); ++j) {
+        caffe_set(width, static_cast<Dtype>(0), diff + (*rows)[j] * width);
+      }
       break;
+    }
     case Caffe::GPU:
 #ifndef CPU_ONLY
       caffe_gpu_set(blob->count(), static_cast<Dtype>(0),
@@ -939,6 +1466,10 @@ void Net<Dtype>::ClearParamDiffs() {
       break;
     }
   }
+  param_diff_rows_.clear();
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->ClearParamDiffRows();
+  }
 }
 
 template <typename Dtype>
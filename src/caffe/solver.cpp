@@ -1,12 +1,16 @@
+#include <boost/thread.hpp>
 #include <cstdio>
 
 #include <string>
 #include <vector>
 
 #include "caffe/solver.hpp"
+#include "caffe/util/blob_compression.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/trace.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -49,6 +53,9 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
     << std::endl << param.DebugString();
   param_ = param;
   CHECK_GE(param_.average_loss(), 1) << "average_loss should be non-negative.";
+  CHECK_GT(param_.loss_scale(), 0) << "loss_scale should be positive.";
+  CHECK_GE(param_.loss_scale_window(), 1)
+      << "loss_scale_window should be positive.";
   CheckSnapshotWritePermissions();
   if (Caffe::root_solver() && param_.random_seed() >= 0) {
     Caffe::set_random_seed(param_.random_seed());
@@ -57,10 +64,14 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   InitTrainNet();
   if (Caffe::root_solver()) {
     InitTestNets();
+    if (param_.test_async() && test_nets_.size()) {
+      async_tester_.reset(new AsyncTester<Dtype>(this));
+    }
     LOG(INFO) << "Solver scaffolding done.";
   }
   iter_ = 0;
   current_step_ = 0;
+  loss_scale_ = param_.loss_scale();
 }
 
 template <typename Dtype>
@@ -211,17 +222,33 @@ void Solver<Dtype>::Step(int iters) {
       }
     }
 
+    TraceScope iteration_trace("solver", "iteration");
     for (int i = 0; i < callbacks_.size(); ++i) {
       callbacks_[i]->on_start();
     }
+    // The root solver adjusts a dynamic loss scale in ApplyUpdate; once
+    // on_start has received its updated weights, it is not changed until
+    // the gradients of this iteration are in.
+    if (root_solver_) {
+      loss_scale_ = root_solver_->loss_scale_;
+    }
     const bool display = param_.display() && iter_ % param_.display() == 0;
     net_->set_debug_info(display && param_.debug_info());
-    // accumulate the loss and gradient
+    // accumulate the loss and gradient, backpropagating the scaled loss so
+    // that small gradients survive reduced precision storage
+    const Dtype loss_scale = loss_scale_;
+    if (loss_scale != Dtype(1)) {
+      ScaleLossWeights(loss_scale);
+    }
     Dtype loss = 0;
     for (int i = 0; i < param_.iter_size(); ++i) {
       loss += net_->ForwardBackward();
     }
-    loss /= param_.iter_size();
+    if (loss_scale != Dtype(1)) {
+      ScaleLossWeights(Dtype(1));
+    }
+    net_->GatherParamDiffRows();
+    loss /= param_.iter_size() * loss_scale;
     // average the loss across iterations for smoothed reporting
     UpdateSmoothedLoss(loss, start_iter, average_loss);
     if (display) {
@@ -250,7 +277,10 @@ void Solver<Dtype>::Step(int iters) {
     for (int i = 0; i < callbacks_.size(); ++i) {
       callbacks_[i]->on_gradients_ready();
     }
-    ApplyUpdate();
+    {
+      TraceScope trace("solver", "update");
+      ApplyUpdate();
+    }
 
     // Increment the internal iter_ counter -- its value should always indicate
     // the number of times the weights have been updated.
@@ -317,13 +347,24 @@ void Solver<Dtype>::Solve(const char* resume_file) {
     LOG(INFO) << "Iteration " << iter_ << ", loss = " << smoothed_loss_;
   }
   if (param_.test_interval() && iter_ % param_.test_interval() == 0) {
+    if (async_tester_) {
+      // Do not skip the final test.
+      async_tester_->Wait();
+    }
     TestAll();
   }
+  if (async_tester_) {
+    async_tester_->Wait();
+  }
   LOG(INFO) << "Optimization Done.";
 }
 
 template <typename Dtype>
 void Solver<Dtype>::TestAll() {
+  if (async_tester_) {
+    async_tester_->TestAll();
+    return;
+  }
   for (int test_net_id = 0;
        test_net_id < test_nets_.size() && !requested_early_exit_;
        ++test_net_id) {
@@ -334,28 +375,38 @@ void Solver<Dtype>::TestAll() {
 template <typename Dtype>
 void Solver<Dtype>::Test(const int test_net_id) {
   CHECK(Caffe::root_solver());
-  LOG(INFO) << "Iteration " << iter_
-            << ", Testing net (#" << test_net_id << ")";
   CHECK_NOTNULL(test_nets_[test_net_id].get())->
       ShareTrainedLayersWith(net_.get());
+  TestNet(test_net_id, iter_, true);
+}
+
+template <typename Dtype>
+void Solver<Dtype>::TestNet(const int test_net_id, const int iter,
+    const bool handle_requests) {
+  TraceScope trace("test",
+      Trace::enabled() ? "test net " + format_int(test_net_id) : string());
+  LOG(INFO) << "Iteration " << iter
+            << ", Testing net (#" << test_net_id << ")";
   vector<Dtype> test_score;
   vector<int> test_score_output_id;
   const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
   Dtype loss = 0;
   for (int i = 0; i < param_.test_iter(test_net_id); ++i) {
-    SolverAction::Enum request = GetRequestedAction();
-    // Check to see if stoppage of testing/training has been requested.
-    while (request != SolverAction::NONE) {
-        if (SolverAction::SNAPSHOT == request) {
-          Snapshot();
-        } else if (SolverAction::STOP == request) {
-          requested_early_exit_ = true;
-        }
-        request = GetRequestedAction();
-    }
-    if (requested_early_exit_) {
-      // break out of test loop.
-      break;
+    if (handle_requests) {
+      SolverAction::Enum request = GetRequestedAction();
+      // Check to see if stoppage of testing/training has been requested.
+      while (request != SolverAction::NONE) {
+          if (SolverAction::SNAPSHOT == request) {
+            Snapshot();
+          } else if (SolverAction::STOP == request) {
+            requested_early_exit_ = true;
+          }
+          request = GetRequestedAction();
+      }
+      if (requested_early_exit_) {
+        // break out of test loop.
+        break;
+      }
     }
 
     Dtype iter_loss;
@@ -382,7 +433,7 @@ void Solver<Dtype>::Test(const int test_net_id) {
       }
     }
   }
-  if (requested_early_exit_) {
+  if (handle_requests && requested_early_exit_) {
     LOG(INFO)     << "Test interrupted.";
     return;
   }
@@ -454,6 +505,9 @@ string Solver<Dtype>::SnapshotToBinaryProto() {
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
   NetParameter net_param;
   net_->ToProto(&net_param, param_.snapshot_diff());
+  if (param_.has_snapshot_compression()) {
+    CompressNetParameter(param_.snapshot_compression(), &net_param);
+  }
   WriteProtoToBinaryFile(net_param, model_filename);
   return model_filename;
 }
@@ -492,6 +546,86 @@ void Solver<Dtype>::UpdateSmoothedLoss(Dtype loss, int start_iter,
   }
 }
 
+template <typename Dtype>
+void Solver<Dtype>::ScaleLossWeights(Dtype scale) {
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+  for (int i = 0; i < layers.size(); ++i) {
+    const vector<Blob<Dtype>*>& top = net_->top_vecs()[i];
+    for (int top_id = 0; top_id < top.size(); ++top_id) {
+      const Dtype loss_weight = layers[i]->loss(top_id);
+      if (loss_weight == Dtype(0)) { continue; }
+      switch (Caffe::mode()) {
+      case Caffe::CPU:
+        caffe_set(top[top_id]->count(), loss_weight * scale,
+            top[top_id]->mutable_cpu_diff());
+        break;
+      case Caffe::GPU:
+#ifndef CPU_ONLY
+        caffe_gpu_set(top[top_id]->count(), loss_weight * scale,
+            top[top_id]->mutable_gpu_diff());
+#else
+        NO_GPU;
+#endif
+        break;
+      default:
+        LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
+      }
+    }
+  }
+}
+
 INSTANTIATE_CLASS(Solver);
 
+template <typename Dtype>
+AsyncTester<Dtype>::AsyncTester(Solver<Dtype>* solver)
+    : solver_(solver) {
+  idle_.push(0);
+  StartInternalThread();
+}
+
+template <typename Dtype>
+AsyncTester<Dtype>::~AsyncTester() {
+  StopInternalThread();
+}
+
+template <typename Dtype>
+bool AsyncTester<Dtype>::TestAll() {
+  int token;
+  if (!idle_.try_pop(&token)) {
+    LOG(INFO) << "Iteration " << solver_->iter_
+        << ", skipping test as the previous one is still running";
+    return false;
+  }
+  // The test nets keep their own copy of the weights so that training can
+  // update the train net while they are evaluated.
+  for (int i = 0; i < solver_->test_nets_.size(); ++i) {
+    solver_->test_nets_[i]->CopyTrainedLayersFrom(solver_->net_.get());
+  }
+  pending_.push(solver_->iter_);
+  return true;
+}
+
+template <typename Dtype>
+void AsyncTester<Dtype>::Wait() {
+  idle_.push(idle_.pop());
+}
+
+template <typename Dtype>
+void AsyncTester<Dtype>::InternalThreadEntry() {
+  Trace::SetThreadName("async test");
+  try {
+    while (!must_stop()) {
+      const int iter = pending_.pop();
+      for (int i = 0; i < solver_->test_nets_.size(); ++i) {
+        solver_->TestNet(i, iter, false);
+      }
+      idle_.push(0);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+INSTANTIATE_CLASS(AsyncTester);
+
 }  // namespace caffe
@@ -39,43 +39,38 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   const int t = this->iter_ + 1;
   const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
       (Dtype(1.) - pow(beta1, t));
-  const int N = net_params[param_id]->count();
   const Dtype eps_hat = this->param_.delta();
 
   switch (Caffe::mode()) {
     case Caffe::CPU: {
-    // update m <- \beta_1 m_{t-1} + (1-\beta_1)g_t
-    caffe_cpu_axpby(N, Dtype(1)-beta1,
-        net_params[param_id]->cpu_diff(), beta1,
-        val_m->mutable_cpu_data());
+    int width;
+    const vector<int>& rows = this->UpdateRows(param_id, &width);
+    Dtype* g = net_params[param_id]->mutable_cpu_diff();
+    Dtype* m = val_m->mutable_cpu_data();
+    Dtype* v = val_v->mutable_cpu_data();
+    Dtype* u = val_t->mutable_cpu_data();
+    for (int i = 0; i < rows.size(); ++i) {
+      const int offset = rows[i] * width;
+      // update m <- \beta_1 m_{t-1} + (1-\beta_1)g_t
+      caffe_cpu_axpby(width, Dtype(1)-beta1, g + offset, beta1, m + offset);
 
-    // update v <- \beta_2 m_{t-1} + (1-\beta_2)g_t^2
-    caffe_mul(N,
-        net_params[param_id]->cpu_diff(),
-        net_params[param_id]->cpu_diff(),
-    val_t->mutable_cpu_data());
-    caffe_cpu_axpby(N, Dtype(1)-beta2,
-        val_t->cpu_data(), beta2,
-        val_v->mutable_cpu_data());
+      // update v <- \beta_2 m_{t-1} + (1-\beta_2)g_t^2
+      caffe_mul(width, g + offset, g + offset, u + offset);
+      caffe_cpu_axpby(width, Dtype(1)-beta2, u + offset, beta2, v + offset);
 
-    // set update
-    caffe_powx(N,
-        val_v->cpu_data(), Dtype(0.5),
-        val_t->mutable_cpu_data());
-    caffe_add_scalar(N, eps_hat, val_t->mutable_cpu_data());
-    caffe_div(N,
-        val_m->cpu_data(),
-        val_t->cpu_data(),
-        val_t->mutable_cpu_data());
+      // set update
+      caffe_powx(width, v + offset, Dtype(0.5), u + offset);
+      caffe_add_scalar(width, eps_hat, u + offset);
+      caffe_div(width, m + offset, u + offset, u + offset);
 
-    caffe_cpu_scale(N, local_rate*correction,
-        val_t->cpu_data(),
-        net_params[param_id]->mutable_cpu_diff());
+      caffe_cpu_scale(width, local_rate*correction, u + offset, g + offset);
+    }
     break;
   }
   case Caffe::GPU: {
 #ifndef CPU_ONLY
-    adam_update_gpu(N, net_params[param_id]->mutable_gpu_diff(),
+    adam_update_gpu(net_params[param_id]->count(),
+        net_params[param_id]->mutable_gpu_diff(),
         val_m->mutable_gpu_data(), val_v->mutable_gpu_data(), beta1, beta2,
         eps_hat, local_rate*correction);
 #else
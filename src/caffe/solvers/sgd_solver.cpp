@@ -75,6 +75,90 @@ void SGDSolver<Dtype>::PreSolve() {
     update_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
     temp_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  // Keep full precision master weights when training in reduced precision.
+  // The master weights share their diff with the net params, which holds the
+  // update value once ComputeUpdateValue is done.
+  master_params_.clear();
+  loss_scale_iters_ = 0;
+  whole_param_.assign(1, 0);
+  if (this->param_.train_precision() != SolverParameter_Precision_FLOAT) {
+    for (int i = 0; i < net_params.size(); ++i) {
+      shared_ptr<Blob<Dtype> > master(new Blob<Dtype>());
+      master->CopyFrom(*net_params[i], false, true);
+      master->ShareDiff(*net_params[i]);
+      master_params_.push_back(master);
+      RoundToTrainPrecision(*master, net_params[i], false);
+    }
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::RoundToTrainPrecision(const Blob<Dtype>& src,
+    Blob<Dtype>* dst, bool diff) {
+  const SolverParameter_Precision precision = this->param_.train_precision();
+  if (precision == SolverParameter_Precision_FLOAT) { return; }
+  const bool half = (precision == SolverParameter_Precision_FLOAT16);
+  const int count = src.count();
+  switch (Caffe::mode()) {
+  case Caffe::CPU: {
+    const Dtype* x = diff ? src.cpu_diff() : src.cpu_data();
+    Dtype* y = diff ? dst->mutable_cpu_diff() : dst->mutable_cpu_data();
+    if (half) {
+      caffe_cpu_round_half(count, x, y);
+    } else {
+      caffe_cpu_round_bfloat16(count, x, y);
+    }
+    break;
+  }
+  case Caffe::GPU: {
+#ifndef CPU_ONLY
+    const Dtype* x = diff ? src.gpu_diff() : src.gpu_data();
+    Dtype* y = diff ? dst->mutable_gpu_diff() : dst->mutable_gpu_data();
+    if (half) {
+      caffe_gpu_round_half(count, x, y);
+    } else {
+      caffe_gpu_round_bfloat16(count, x, y);
+    }
+#else
+    NO_GPU;
+#endif
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
+  }
+}
+
+template <typename Dtype>
+bool SGDSolver<Dtype>::GradientsOverflow() {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  for (int i = 0; i < net_params.size(); ++i) {
+    const Dtype asum = net_params[i]->asum_diff();
+    if (isnan(asum) || isinf(asum)) { return true; }
+  }
+  return false;
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::UpdateLossScale(bool overflow) {
+  if (!this->param_.dynamic_loss_scale()) { return; }
+  if (overflow) {
+    this->loss_scale_ /= 2;
+    loss_scale_iters_ = 0;
+    LOG(INFO) << "Reducing loss scale to " << this->loss_scale_;
+  } else if (++loss_scale_iters_ >= this->param_.loss_scale_window()) {
+    this->loss_scale_ *= 2;
+    loss_scale_iters_ = 0;
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::UpdateMasterParams() {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  for (int i = 0; i < master_params_.size(); ++i) {
+    master_params_[i]->Update();
+    RoundToTrainPrecision(*master_params_[i], net_params[i], false);
+  }
 }
 
 template <typename Dtype>
@@ -86,7 +170,8 @@ void SGDSolver<Dtype>::ClipGradients() {
   for (int i = 0; i < net_params.size(); ++i) {
     sumsq_diff += net_params[i]->sumsq_diff();
   }
-  const Dtype l2norm_diff = std::sqrt(sumsq_diff);
+  // Compare the norm of the unscaled gradient against the threshold.
+  const Dtype l2norm_diff = std::sqrt(sumsq_diff) / this->loss_scale_;
   if (l2norm_diff > clip_gradients) {
     Dtype scale_factor = clip_gradients / l2norm_diff;
     LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
@@ -105,26 +190,65 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   if (this->param_.display() && this->iter_ % this->param_.display() == 0) {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  if (!LazyRowUpdates()) {
+    this->net_->InvalidateParamDiffRows();
+  }
+  if (!master_params_.empty()) {
+    // Store the gradients in reduced precision like the weights.
+    for (int param_id = 0; param_id < net_params.size(); ++param_id) {
+      RoundToTrainPrecision(*net_params[param_id], net_params[param_id], true);
+    }
+  }
+  if (!master_params_.empty() || this->param_.dynamic_loss_scale()) {
+    if (GradientsOverflow()) {
+      LOG(INFO) << "Iteration " << this->iter_
+          << ", gradient overflow: skipping update";
+      UpdateLossScale(true);
+      return;
+    }
+  }
   ClipGradients();
-  for (int param_id = 0; param_id < this->net_->learnable_params().size();
-       ++param_id) {
+  for (int param_id = 0; param_id < net_params.size(); ++param_id) {
     Normalize(param_id);
     Regularize(param_id);
     ComputeUpdateValue(param_id, rate);
   }
-  this->net_->Update();
+  if (master_params_.empty()) {
+    this->net_->Update();
+  } else {
+    UpdateMasterParams();
+  }
+  UpdateLossScale(false);
+}
+
+template <typename Dtype>
+const vector<int>& SGDSolver<Dtype>::UpdateRows(int param_id, int* width) {
+  const Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const vector<int>* rows = this->net_->learnable_param_diff_rows(param_id);
+  if (rows) {
+    *width = param->count(1);
+    return *rows;
+  }
+  *width = param->count();
+  return whole_param_;
 }
 
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
-  if (this->param_.iter_size() == 1) { return; }
-  // Scale gradient to counterbalance accumulation.
+  if (this->param_.iter_size() == 1 && this->loss_scale_ == 1) { return; }
+  // Scale gradient to counterbalance accumulation and loss scaling.
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
-  const Dtype accum_normalization = Dtype(1.) / this->param_.iter_size();
+  const Dtype accum_normalization =
+      Dtype(1.) / (this->param_.iter_size() * this->loss_scale_);
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    caffe_scal(net_params[param_id]->count(), accum_normalization,
-        net_params[param_id]->mutable_cpu_diff());
+    int width;
+    const vector<int>& rows = UpdateRows(param_id, &width);
+    Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+    for (int i = 0; i < rows.size(); ++i) {
+      caffe_scal(width, accum_normalization, diff + rows[i] * width);
+    }
     break;
   }
   case Caffe::GPU: {
@@ -149,25 +273,29 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
   Dtype weight_decay = this->param_.weight_decay();
   string regularization_type = this->param_.regularization_type();
   Dtype local_decay = weight_decay * net_params_weight_decay[param_id];
+  // Decay the full precision master weights rather than their rounding.
+  const Blob<Dtype>* weights = master_params_.empty() ?
+      net_params[param_id] : master_params_[param_id].get();
   switch (Caffe::mode()) {
   case Caffe::CPU: {
     if (local_decay) {
-      if (regularization_type == "L2") {
-        // add weight decay
-        caffe_axpy(net_params[param_id]->count(),
-            local_decay,
-            net_params[param_id]->cpu_data(),
-            net_params[param_id]->mutable_cpu_diff());
-      } else if (regularization_type == "L1") {
-        caffe_cpu_sign(net_params[param_id]->count(),
-            net_params[param_id]->cpu_data(),
-            temp_[param_id]->mutable_cpu_data());
-        caffe_axpy(net_params[param_id]->count(),
-            local_decay,
-            temp_[param_id]->cpu_data(),
-            net_params[param_id]->mutable_cpu_diff());
-      } else {
-        LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+      int width;
+      const vector<int>& rows = UpdateRows(param_id, &width);
+      const Dtype* data = weights->cpu_data();
+      Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+      for (int i = 0; i < rows.size(); ++i) {
+        const int offset = rows[i] * width;
+        if (regularization_type == "L2") {
+          // add weight decay
+          caffe_axpy(width, local_decay, data + offset, diff + offset);
+        } else if (regularization_type == "L1") {
+          Dtype* sign = temp_[param_id]->mutable_cpu_data() + offset;
+          caffe_cpu_sign(width, data + offset, sign);
+          caffe_axpy(width, local_decay, sign, diff + offset);
+        } else {
+          LOG(FATAL) << "Unknown regularization type: "
+              << regularization_type;
+        }
       }
     }
     break;
@@ -179,11 +307,11 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
         // add weight decay
         caffe_gpu_axpy(net_params[param_id]->count(),
             local_decay,
-            net_params[param_id]->gpu_data(),
+            weights->gpu_data(),
             net_params[param_id]->mutable_gpu_diff());
       } else if (regularization_type == "L1") {
         caffe_gpu_sign(net_params[param_id]->count(),
-            net_params[param_id]->gpu_data(),
+            weights->gpu_data(),
             temp_[param_id]->mutable_gpu_data());
         caffe_gpu_axpy(net_params[param_id]->count(),
             local_decay,
@@ -218,12 +346,16 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   // Compute the update to history, then copy it to the parameter diff.
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-              net_params[param_id]->cpu_diff(), momentum,
-              history_[param_id]->mutable_cpu_data());
-    caffe_copy(net_params[param_id]->count(),
-        history_[param_id]->cpu_data(),
-        net_params[param_id]->mutable_cpu_diff());
+    int width;
+    const vector<int>& rows = UpdateRows(param_id, &width);
+    Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+    Dtype* history = history_[param_id]->mutable_cpu_data();
+    for (int i = 0; i < rows.size(); ++i) {
+      const int offset = rows[i] * width;
+      caffe_cpu_axpby(width, local_rate, diff + offset, momentum,
+          history + offset);
+      caffe_copy(width, history + offset, diff + offset);
+    }
     break;
   }
   case Caffe::GPU: {
@@ -269,6 +401,10 @@ void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
     BlobProto* history_blob = state.add_history();
     history_[i]->ToProto(history_blob);
   }
+  for (int i = 0; i < master_params_.size(); ++i) {
+    master_params_[i]->ToProto(state.add_master());
+  }
+  state.set_loss_scale(this->loss_scale_);
   string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
   LOG(INFO)
     << "Snapshotting solver state to binary proto file " << snapshot_filename;
@@ -298,6 +434,19 @@ void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
     hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *history_[i]);
   }
   H5Gclose(history_hid);
+  if (!master_params_.empty()) {
+    hid_t master_hid = H5Gcreate2(file_hid, "master", H5P_DEFAULT,
+        H5P_DEFAULT, H5P_DEFAULT);
+    CHECK_GE(master_hid, 0)
+        << "Error saving solver state to " << snapshot_filename << ".";
+    for (int i = 0; i < master_params_.size(); ++i) {
+      ostringstream oss;
+      oss << i;
+      hdf5_save_nd_dataset<Dtype>(master_hid, oss.str(), *master_params_[i]);
+    }
+    H5Gclose(master_hid);
+  }
+  hdf5_save_float(file_hid, "loss_scale", this->loss_scale_);
   H5Fclose(file_hid);
 }
 
@@ -319,6 +468,23 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
   for (int i = 0; i < history_.size(); ++i) {
     history_[i]->FromProto(state.history(i));
   }
+  if (state.has_loss_scale()) {
+    this->loss_scale_ = state.loss_scale();
+  }
+  if (!master_params_.empty()) {
+    const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+    const bool has_master = (state.master_size() > 0);
+    CHECK(!has_master || state.master_size() == master_params_.size())
+        << "Incorrect length of master blobs.";
+    for (int i = 0; i < master_params_.size(); ++i) {
+      if (has_master) {
+        master_params_[i]->FromProto(state.master(i), false);
+      } else {
+        master_params_[i]->CopyFrom(*net_params[i]);
+      }
+      RoundToTrainPrecision(*master_params_[i], net_params[i], false);
+    }
+  }
 }
 
 template <typename Dtype>
@@ -343,6 +509,34 @@ void SGDSolver<Dtype>::RestoreSolverStateFromHDF5(const string& state_file) {
                                 kMaxBlobAxes, history_[i].get());
   }
   H5Gclose(history_hid);
+  if (H5LTfind_dataset(file_hid, "loss_scale")) {
+    this->loss_scale_ = hdf5_load_float(file_hid, "loss_scale");
+  }
+  if (!master_params_.empty()) {
+    const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+    const bool has_master = H5Lexists(file_hid, "master", H5P_DEFAULT) > 0;
+    hid_t master_hid = -1;
+    if (has_master) {
+      master_hid = H5Gopen2(file_hid, "master", H5P_DEFAULT);
+      CHECK_GE(master_hid, 0) << "Error reading master from " << state_file;
+      CHECK_EQ(hdf5_get_num_links(master_hid), master_params_.size())
+          << "Incorrect length of master blobs.";
+    }
+    for (int i = 0; i < master_params_.size(); ++i) {
+      if (has_master) {
+        ostringstream oss;
+        oss << i;
+        hdf5_load_nd_dataset<Dtype>(master_hid, oss.str().c_str(), 0,
+                                    kMaxBlobAxes, master_params_[i].get());
+      } else {
+        master_params_[i]->CopyFrom(*net_params[i]);
+      }
+      RoundToTrainPrecision(*master_params_[i], net_params[i], false);
+    }
+    if (has_master) {
+      H5Gclose(master_hid);
+    }
+  }
   H5Fclose(file_hid);
 }
 
@@ -1,40 +1,133 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+// The account current on each thread, NULL for the global account. Scopes
+// do not own their accounts, hence the no-op cleanup.
+static void KeepAccount(MemoryAccount*) {}
+static boost::thread_specific_ptr<MemoryAccount> current_account_(
+    &KeepAccount);
+
+MemoryAccount::MemoryAccount(const shared_ptr<MemoryAccount>& parent)
+    : parent_(parent), mutex_(new boost::mutex()) {}
+
+MemoryUsage MemoryAccount::usage(Side side) const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return usage_[side];
+}
+
+void MemoryAccount::ResetPeak() {
+  boost::mutex::scoped_lock lock(*mutex_);
+  usage_[HOST].peak = usage_[HOST].live;
+  usage_[DEVICE].peak = usage_[DEVICE].live;
+}
+
+const shared_ptr<MemoryAccount>& MemoryAccount::Global() {
+  // Never destroyed, as memory may be freed during static destruction.
+  static shared_ptr<MemoryAccount>* global = new shared_ptr<MemoryAccount>(
+      new MemoryAccount(shared_ptr<MemoryAccount>()));
+  return *global;
+}
+
+shared_ptr<MemoryAccount> MemoryAccount::Current() {
+  MemoryAccount* account = current_account_.get();
+  return account ? account->shared_from_this() : Global();
+}
+
+void MemoryAccount::Charge(Side side, size_t size) {
+  for (MemoryAccount* account = this; account;
+       account = account->parent_.get()) {
+    boost::mutex::scoped_lock lock(*account->mutex_);
+    MemoryUsage& usage = account->usage_[side];
+    usage.live += size;
+    usage.peak = std::max(usage.peak, usage.live);
+    usage.allocated += size;
+    ++usage.allocations;
+  }
+}
+
+void MemoryAccount::Refund(Side side, size_t size) {
+  for (MemoryAccount* account = this; account;
+       account = account->parent_.get()) {
+    boost::mutex::scoped_lock lock(*account->mutex_);
+    account->usage_[side].live -= size;
+  }
+}
+
+MemoryScope::MemoryScope(MemoryAccount* account)
+    : previous_(current_account_.get()) {
+  current_account_.reset(account);
+}
+
+MemoryScope::~MemoryScope() {
+  current_account_.reset(previous_);
+}
+
 SyncedMemory::~SyncedMemory() {
   if (cpu_ptr_ && own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    FreeHost();
   }
 
 #ifndef CPU_ONLY
   if (gpu_ptr_ && own_gpu_data_) {
-    int initial_device;
-    cudaGetDevice(&initial_device);
-    if (gpu_device_ != -1) {
-      CUDA_CHECK(cudaSetDevice(gpu_device_));
-    }
-    CUDA_CHECK(cudaFree(gpu_ptr_));
-    cudaSetDevice(initial_device);
+    FreeDevice();
   }
 #endif  // CPU_ONLY
 }
 
+void SyncedMemory::AllocateHost() {
+  CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_,
+      &cpu_malloc_use_pool_);
+  own_cpu_data_ = true;
+  cpu_account_ = MemoryAccount::Current();
+  cpu_account_->Charge(MemoryAccount::HOST, size_);
+}
+
+void SyncedMemory::FreeHost() {
+  CaffeFreeHost(cpu_ptr_, size_, cpu_malloc_use_cuda_, cpu_malloc_use_pool_);
+  cpu_account_->Refund(MemoryAccount::HOST, size_);
+  cpu_account_.reset();
+}
+
+#ifndef CPU_ONLY
+void SyncedMemory::AllocateDevice() {
+  CUDA_CHECK(cudaGetDevice(&gpu_device_));
+  CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
+  own_gpu_data_ = true;
+  gpu_account_ = MemoryAccount::Current();
+  gpu_account_->Charge(MemoryAccount::DEVICE, size_);
+}
+
+void SyncedMemory::FreeDevice() {
+  int initial_device;
+  cudaGetDevice(&initial_device);
+  if (gpu_device_ != -1) {
+    CUDA_CHECK(cudaSetDevice(gpu_device_));
+  }
+  CUDA_CHECK(cudaFree(gpu_ptr_));
+  cudaSetDevice(initial_device);
+  gpu_account_->Refund(MemoryAccount::DEVICE, size_);
+  gpu_account_.reset();
+}
+#endif  // CPU_ONLY
+
 inline void SyncedMemory::to_cpu() {
   switch (head_) {
   case UNINITIALIZED:
-    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+    AllocateHost();
     caffe_memset(size_, 0, cpu_ptr_);
     head_ = HEAD_AT_CPU;
-    own_cpu_data_ = true;
     break;
   case HEAD_AT_GPU:
 #ifndef CPU_ONLY
     if (cpu_ptr_ == NULL) {
-      CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
-      own_cpu_data_ = true;
+      AllocateHost();
     }
     caffe_gpu_memcpy(size_, gpu_ptr_, cpu_ptr_);
     head_ = SYNCED;
@@ -52,17 +145,13 @@ inline void SyncedMemory::to_gpu() {
 #ifndef CPU_ONLY
   switch (head_) {
   case UNINITIALIZED:
-    CUDA_CHECK(cudaGetDevice(&gpu_device_));
-    CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
+    AllocateDevice();
     caffe_gpu_memset(size_, 0, gpu_ptr_);
     head_ = HEAD_AT_GPU;
-    own_gpu_data_ = true;
     break;
   case HEAD_AT_CPU:
     if (gpu_ptr_ == NULL) {
-      CUDA_CHECK(cudaGetDevice(&gpu_device_));
-      CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
-      own_gpu_data_ = true;
+      AllocateDevice();
     }
     caffe_gpu_memcpy(size_, cpu_ptr_, gpu_ptr_);
     head_ = SYNCED;
@@ -84,11 +173,18 @@ const void* SyncedMemory::cpu_data() {
 void SyncedMemory::set_cpu_data(void* data) {
   CHECK(data);
   if (own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    FreeHost();
   }
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  cpu_data_holder_.reset();
+  ++version_;
+}
+
+void SyncedMemory::set_cpu_data(void* data, const shared_ptr<void>& holder) {
+  set_cpu_data(data);
+  cpu_data_holder_ = holder;
 }
 
 const void* SyncedMemory::gpu_data() {
@@ -105,17 +201,12 @@ void SyncedMemory::set_gpu_data(void* data) {
 #ifndef CPU_ONLY
   CHECK(data);
   if (own_gpu_data_) {
-    int initial_device;
-    cudaGetDevice(&initial_device);
-    if (gpu_device_ != -1) {
-      CUDA_CHECK(cudaSetDevice(gpu_device_));
-    }
-    CUDA_CHECK(cudaFree(gpu_ptr_));
-    cudaSetDevice(initial_device);
+    FreeDevice();
   }
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
+  ++version_;
 #else
   NO_GPU;
 #endif
@@ -124,6 +215,7 @@ void SyncedMemory::set_gpu_data(void* data) {
 void* SyncedMemory::mutable_cpu_data() {
   to_cpu();
   head_ = HEAD_AT_CPU;
+  ++version_;
   return cpu_ptr_;
 }
 
@@ -131,6 +223,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  ++version_;
   return gpu_ptr_;
 #else
   NO_GPU;
@@ -142,9 +235,7 @@ void* SyncedMemory::mutable_gpu_data() {
 void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
   CHECK(head_ == HEAD_AT_CPU);
   if (gpu_ptr_ == NULL) {
-    CUDA_CHECK(cudaGetDevice(&gpu_device_));
-    CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
-    own_gpu_data_ = true;
+    AllocateDevice();
   }
   const cudaMemcpyKind put = cudaMemcpyHostToDevice;
   CUDA_CHECK(cudaMemcpyAsync(gpu_ptr_, cpu_ptr_, size_, put, stream));
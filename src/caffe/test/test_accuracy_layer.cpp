@@ -7,6 +7,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/accuracy_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -246,6 +247,28 @@ TYPED_TEST(AccuracyLayerTest, TestForwardCPUTopK) {
               num_correct_labels / 100.0, 1e-4);
 }
 
+TYPED_TEST(AccuracyLayerTest, TestForwardCPUTopKTies) {
+  // All scores tie, so that the top k are the k largest labels, as with
+  // std::greater on (score, label) pairs.
+  TypeParam* data = this->blob_bottom_data_->mutable_cpu_data();
+  caffe_set(this->blob_bottom_data_->count(), TypeParam(1), data);
+  LayerParameter layer_param;
+  AccuracyParameter* accuracy_param = layer_param.mutable_accuracy_param();
+  accuracy_param->set_top_k(this->top_k_);
+  AccuracyLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  int num_correct_labels = 0;
+  for (int i = 0; i < 100; ++i) {
+    if (this->blob_bottom_label_->data_at(i, 0, 0, 0) >= 10 - this->top_k_) {
+      ++num_correct_labels;
+    }
+  }
+  EXPECT_NEAR(this->blob_top_->data_at(0, 0, 0, 0),
+              num_correct_labels / 100.0, 1e-4);
+}
+
 TYPED_TEST(AccuracyLayerTest, TestForwardCPUPerClass) {
   LayerParameter layer_param;
   AccuracyLayer<TypeParam> layer(layer_param);
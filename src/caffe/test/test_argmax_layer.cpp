@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <functional>
 #include <utility>
 #include <vector>
 
@@ -171,6 +173,37 @@ TYPED_TEST(ArgMaxLayerTest, TestCPUTopK) {
   }
 }
 
+TYPED_TEST(ArgMaxLayerTest, TestCPUTopKTies) {
+  typedef std::pair<TypeParam, int> Pair;
+  // Few distinct values, so that most of the top k are tied; ties go to the
+  // larger index.
+  TypeParam* bottom_data = this->blob_bottom_->mutable_cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    bottom_data[i] = static_cast<int>(bottom_data[i] * 2);
+  }
+  for (int top_k = 1; top_k <= this->top_k_; top_k += this->top_k_ - 1) {
+    LayerParameter layer_param;
+    ArgMaxParameter* argmax_param = layer_param.mutable_argmax_param();
+    argmax_param->set_top_k(top_k);
+    ArgMaxLayer<TypeParam> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    int num = this->blob_bottom_->num();
+    int dim = this->blob_bottom_->count() / num;
+    for (int i = 0; i < num; ++i) {
+      std::vector<Pair> expected;
+      for (int k = 0; k < dim; ++k) {
+        expected.push_back(Pair(bottom_data[i * dim + k], k));
+      }
+      std::partial_sort(expected.begin(), expected.begin() + top_k,
+          expected.end(), std::greater<Pair>());
+      for (int j = 0; j < top_k; ++j) {
+        EXPECT_EQ(expected[j].second, this->blob_top_->data_at(i, 0, j, 0));
+      }
+    }
+  }
+}
+
 TYPED_TEST(ArgMaxLayerTest, TestCPUMaxValTopK) {
   LayerParameter layer_param;
   ArgMaxParameter* argmax_param = layer_param.mutable_argmax_param();
@@ -8,6 +8,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/batch_norm_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -130,4 +131,138 @@ namespace caffe {
         this->blob_top_vec_);
   }
 
+  TYPED_TEST(BatchNormLayerTest, TestForwardScaleBias) {
+    typedef typename TypeParam::Dtype Dtype;
+    LayerParameter layer_param;
+    BatchNormParameter* batch_norm_param =
+        layer_param.mutable_batch_norm_param();
+    batch_norm_param->set_scale_bias(true);
+    batch_norm_param->mutable_scale_filler()->set_value(2);
+    batch_norm_param->mutable_bias_filler()->set_value(3);
+
+    BatchNormLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    ASSERT_EQ(5, layer.blobs().size());
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+    int num = this->blob_bottom_->num();
+    int channels = this->blob_bottom_->channels();
+    int height = this->blob_bottom_->height();
+    int width = this->blob_bottom_->width();
+
+    for (int j = 0; j < channels; ++j) {
+      Dtype sum = 0, var = 0;
+      for (int i = 0; i < num; ++i) {
+        for ( int k = 0; k < height; ++k ) {
+          for ( int l = 0; l < width; ++l ) {
+            Dtype data = this->blob_top_->data_at(i, j, k, l) - 3;
+            sum += data;
+            var += data * data;
+          }
+        }
+      }
+      sum /= height * width * num;
+      var /= height * width * num;
+
+      const Dtype kErrorBound = 0.001;
+      // expect the mean and variance of the bias and scale
+      EXPECT_NEAR(0, sum, kErrorBound);
+      EXPECT_NEAR(4, var, kErrorBound);
+    }
+  }
+
+  TYPED_TEST(BatchNormLayerTest, TestGradientScaleBias) {
+    typedef typename TypeParam::Dtype Dtype;
+    LayerParameter layer_param;
+    BatchNormParameter* batch_norm_param =
+        layer_param.mutable_batch_norm_param();
+    batch_norm_param->set_scale_bias(true);
+    batch_norm_param->mutable_scale_filler()->set_type("gaussian");
+    batch_norm_param->mutable_bias_filler()->set_type("gaussian");
+
+    BatchNormLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-2, 1e-4);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+
+  TYPED_TEST(BatchNormLayerTest, TestBackwardGlobalStats) {
+    typedef typename TypeParam::Dtype Dtype;
+    LayerParameter layer_param;
+    BatchNormParameter* batch_norm_param =
+        layer_param.mutable_batch_norm_param();
+    batch_norm_param->set_use_global_stats(true);
+    batch_norm_param->set_scale_bias(true);
+    batch_norm_param->mutable_scale_filler()->set_value(2);
+    batch_norm_param->set_eps(0);
+
+    BatchNormLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    // Stored statistics of mean 0.5 and variance 4, summed over two batches.
+    caffe_set(2, Dtype(1), layer.blobs()[0]->mutable_cpu_data());
+    caffe_set(2, Dtype(8), layer.blobs()[1]->mutable_cpu_data());
+    layer.blobs()[2]->mutable_cpu_data()[0] = 2;
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const int count = this->blob_top_->count();
+    // Y = gamma (X - mean) / std, with gamma and std 2.
+    for (int i = 0; i < count; ++i) {
+      EXPECT_NEAR((this->blob_bottom_->cpu_data()[i] - 0.5) * 2 / 2,
+          this->blob_top_->cpu_data()[i], 1e-5);
+    }
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_top_);
+    caffe_copy(count, this->blob_top_->cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+        this->blob_bottom_vec_);
+    // The gradient of X is gamma / std times that of Y.
+    for (int i = 0; i < count; ++i) {
+      EXPECT_NEAR(this->blob_top_->cpu_diff()[i],
+          this->blob_bottom_->cpu_diff()[i], 1e-5);
+    }
+  }
+
+  TYPED_TEST(BatchNormLayerTest, TestBackwardInplace) {
+    typedef typename TypeParam::Dtype Dtype;
+    LayerParameter layer_param;
+    layer_param.mutable_batch_norm_param()->set_scale_bias(true);
+    layer_param.mutable_batch_norm_param()->mutable_scale_filler()->set_type(
+        "gaussian");
+    BatchNormLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_top_);
+    caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+        this->blob_bottom_vec_);
+
+    // The same in place, with the top overwritten as a later in-place layer
+    // might, gives the same gradients.
+    BatchNormLayer<Dtype> layer_inplace(layer_param);
+    Blob<Dtype> blob_inplace;
+    vector<Blob<Dtype>*> blob_inplace_vec(1, &blob_inplace);
+    blob_inplace.CopyFrom(*this->blob_bottom_, false, true);
+    layer_inplace.SetUp(blob_inplace_vec, blob_inplace_vec);
+    layer_inplace.blobs()[3]->CopyFrom(*layer.blobs()[3]);
+    layer_inplace.Forward(blob_inplace_vec, blob_inplace_vec);
+    caffe_set(blob_inplace.count(), Dtype(7), blob_inplace.mutable_cpu_data());
+    blob_inplace.CopyFrom(*this->blob_top_, true);
+    layer_inplace.Backward(blob_inplace_vec, vector<bool>(1, true),
+        blob_inplace_vec);
+    for (int i = 0; i < blob_inplace.count(); ++i) {
+      EXPECT_NEAR(this->blob_bottom_->cpu_diff()[i],
+          blob_inplace.cpu_diff()[i], 1e-5);
+    }
+    for (int j = 3; j < 5; ++j) {
+      for (int i = 0; i < layer.blobs()[j]->count(); ++i) {
+        EXPECT_NEAR(layer.blobs()[j]->cpu_diff()[i],
+            layer_inplace.blobs()[j]->cpu_diff()[i], 1e-5);
+      }
+    }
+  }
+
 }  // namespace caffe
@@ -87,4 +87,51 @@ TYPED_TEST(BenchmarkTest, TestTimerSeconds) {
   EXPECT_TRUE(timer.has_run_at_least_once());
 }
 
+class LatencyHistogramTest : public ::testing::Test {};
+
+TEST_F(LatencyHistogramTest, TestEmpty) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0, histogram.count());
+  EXPECT_EQ(0, histogram.Mean());
+  EXPECT_EQ(0, histogram.Percentile(50));
+}
+
+TEST_F(LatencyHistogramTest, TestPercentiles) {
+  LatencyHistogram histogram;
+  for (int i = 1000; i >= 1; --i) {
+    histogram.Add(i);
+  }
+  EXPECT_EQ(1000, histogram.count());
+  EXPECT_FLOAT_EQ(500.5, histogram.Mean());
+  EXPECT_EQ(1, histogram.min());
+  EXPECT_EQ(1000, histogram.max());
+  // Buckets are 2^(1/8) wide, percentiles are their upper bound.
+  const float kRelativeError = 0.0906;
+  EXPECT_GE(histogram.Percentile(50), 500);
+  EXPECT_LE(histogram.Percentile(50), 500 * (1 + kRelativeError));
+  EXPECT_GE(histogram.Percentile(95), 950);
+  EXPECT_LE(histogram.Percentile(95), 950 * (1 + kRelativeError));
+  EXPECT_GE(histogram.Percentile(99), 990);
+  EXPECT_LE(histogram.Percentile(99), 1000);
+  EXPECT_EQ(1, histogram.Percentile(0));
+  EXPECT_EQ(1000, histogram.Percentile(100));
+}
+
+TEST_F(LatencyHistogramTest, TestMergeAndClear) {
+  LatencyHistogram low, high;
+  for (int i = 1; i <= 100; ++i) {
+    low.Add(i);
+    high.Add(1000 * i);
+  }
+  low.Merge(high);
+  EXPECT_EQ(200, low.count());
+  EXPECT_EQ(1, low.min());
+  EXPECT_EQ(100000, low.max());
+  EXPECT_LE(low.Percentile(50), 100 * 1.0906);
+  EXPECT_GE(low.Percentile(51), 1000);
+  low.Clear();
+  EXPECT_EQ(0, low.count());
+  EXPECT_EQ(0, low.max());
+}
+
 }  // namespace caffe
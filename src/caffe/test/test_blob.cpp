@@ -51,6 +51,58 @@ TYPED_TEST(BlobSimpleTest, TestReshape) {
   EXPECT_EQ(this->blob_->count(), 120);
 }
 
+TYPED_TEST(BlobSimpleTest, TestShapeVersion) {
+  const int64_t version = this->blob_preshaped_->shape_version();
+  EXPECT_NE(this->blob_->shape_version(), version);
+  this->blob_preshaped_->Reshape(2, 3, 4, 5);
+  EXPECT_EQ(version, this->blob_preshaped_->shape_version());
+  this->blob_preshaped_->Reshape(2, 3, 4, 6);
+  EXPECT_NE(version, this->blob_preshaped_->shape_version());
+  // Versions are unique across blobs.
+  this->blob_->Reshape(2, 3, 4, 5);
+  EXPECT_NE(version, this->blob_->shape_version());
+  EXPECT_NE(this->blob_preshaped_->shape_version(),
+            this->blob_->shape_version());
+  // So does replacing the memory, which blobs sharing it would not see.
+  int64_t last = this->blob_->shape_version();
+  this->blob_->Release();
+  EXPECT_NE(last, this->blob_->shape_version());
+  this->blob_->Reshape(2, 3, 4, 6);
+  last = this->blob_->shape_version();
+  this->blob_->ShareData(*this->blob_preshaped_);
+  EXPECT_NE(last, this->blob_->shape_version());
+  last = this->blob_->shape_version();
+  this->blob_->ShareData(*this->blob_preshaped_);
+  EXPECT_EQ(last, this->blob_->shape_version());
+}
+
+TYPED_TEST(BlobSimpleTest, TestReserveAndShrink) {
+  typedef TypeParam Dtype;
+  this->blob_->Reserve(100);
+  EXPECT_EQ(100, this->blob_->capacity());
+  EXPECT_EQ(0, this->blob_->count());
+  // Reshaping within the capacity does not reallocate.
+  this->blob_->Reshape(2, 3, 4, 1);
+  const SyncedMemory* data = this->blob_->data().get();
+  Dtype* values = this->blob_->mutable_cpu_data();
+  for (int i = 0; i < 24; ++i) {
+    values[i] = i;
+  }
+  this->blob_->Reshape(4, 5, 5, 1);
+  EXPECT_EQ(data, this->blob_->data().get());
+  this->blob_->Reserve(50);
+  EXPECT_EQ(100, this->blob_->capacity());
+  // Shrinking keeps the contents.
+  this->blob_->Reshape(2, 3, 4, 1);
+  this->blob_->ShrinkToFit();
+  EXPECT_EQ(24, this->blob_->capacity());
+  EXPECT_NE(data, this->blob_->data().get());
+  for (int i = 0; i < 24; ++i) {
+    EXPECT_EQ(i, this->blob_->cpu_data()[i]);
+  }
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED, this->blob_->diff()->head());
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
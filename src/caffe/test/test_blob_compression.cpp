@@ -0,0 +1,145 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/blob_compression.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class BlobCompressionTest : public ::testing::Test {
+ protected:
+  BlobCompressionTest() : blob_(new Blob<Dtype>(20, 3, 4, 5)) {
+    FillerParameter filler_param;
+    filler_param.set_std(1);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_);
+  }
+  virtual ~BlobCompressionTest() { delete blob_; }
+
+  // Zeroes all but one value in every period.
+  void Prune(int period) {
+    Dtype* data = blob_->mutable_cpu_data();
+    for (int i = 0; i < blob_->count(); ++i) {
+      if (i % period) {
+        data[i] = 0;
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_;
+};
+
+TYPED_TEST_CASE(BlobCompressionTest, TestDtypes);
+
+TYPED_TEST(BlobCompressionTest, TestDenseKept) {
+  BlobProto proto;
+  this->blob_->ToProto(&proto);
+  CompressBlobProto(CompressionParameter(), &proto);
+  EXPECT_FALSE(proto.has_compressed_data());
+}
+
+TYPED_TEST(BlobCompressionTest, TestSparse) {
+  this->Prune(7);
+  BlobProto proto;
+  this->blob_->ToProto(&proto);
+  const int dense_size = proto.ByteSize();
+  CompressBlobProto(CompressionParameter(), &proto);
+  ASSERT_TRUE(proto.has_compressed_data());
+  EXPECT_EQ(0, proto.data_size() + proto.double_data_size());
+  EXPECT_EQ(21, proto.compressed_data().row_start_size());
+  EXPECT_LT(proto.ByteSize(), dense_size / 3);
+  Blob<TypeParam> blob;
+  blob.FromProto(proto);
+  ASSERT_TRUE(blob.shape() == this->blob_->shape());
+  for (int i = 0; i < blob.count(); ++i) {
+    EXPECT_EQ(this->blob_->cpu_data()[i], blob.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(BlobCompressionTest, TestSparseDoubleExact) {
+  this->Prune(7);
+  // Values that single precision cannot hold.
+  TypeParam* data = this->blob_->mutable_cpu_data();
+  for (int i = 0; i < this->blob_->count(); i += 7) {
+    data[i] = 1 + 1e-12 * (i + 1);
+  }
+  BlobProto proto;
+  this->blob_->ToProto(&proto);
+  const bool is_double = proto.double_data_size() > 0;
+  CompressBlobProto(CompressionParameter(), &proto);
+  ASSERT_TRUE(proto.has_compressed_data());
+  EXPECT_EQ(is_double, proto.compressed_data().double_value_size() > 0);
+  Blob<double> blob;
+  blob.FromProto(proto);
+  for (int i = 0; i < blob.count(); ++i) {
+    EXPECT_EQ(static_cast<double>(this->blob_->cpu_data()[i]),
+              blob.cpu_data()[i]);
+  }
+  // So does a whole net decompressed.
+  NetParameter net_param;
+  net_param.add_layer()->add_blobs()->CopyFrom(proto);
+  DecompressNetParameter(&net_param);
+  const BlobProto& decompressed = net_param.layer(0).blobs(0);
+  EXPECT_FALSE(decompressed.has_compressed_data());
+  ASSERT_EQ(this->blob_->count(), is_double ?
+      decompressed.double_data_size() : decompressed.data_size());
+  for (int i = 0; i < this->blob_->count(); ++i) {
+    EXPECT_EQ(static_cast<double>(this->blob_->cpu_data()[i]), is_double ?
+        decompressed.double_data(i) : decompressed.data(i));
+  }
+}
+
+TYPED_TEST(BlobCompressionTest, TestQuantized) {
+  CompressionParameter param;
+  param.set_quantization_bits(5);
+  for (int sparse = 0; sparse < 2; ++sparse) {
+    if (sparse) {
+      this->Prune(3);
+    }
+    BlobProto proto;
+    this->blob_->ToProto(&proto);
+    const int dense_size = proto.ByteSize();
+    CompressBlobProto(param, &proto);
+    ASSERT_TRUE(proto.has_compressed_data());
+    const CompressedBlob& compressed = proto.compressed_data();
+    EXPECT_EQ(sparse != 0, compressed.row_start_size() > 0);
+    EXPECT_LE(compressed.codebook_size(), 32);
+    EXPECT_LT(proto.ByteSize(), dense_size / 4);
+    Blob<TypeParam> blob;
+    blob.FromProto(proto);
+    // Gaussian values over about 6 std quantized to 32 codes.
+    for (int i = 0; i < blob.count(); ++i) {
+      const TypeParam value = this->blob_->cpu_data()[i];
+      if (sparse && value == 0) {
+        EXPECT_EQ(0, blob.cpu_data()[i]);
+      } else {
+        EXPECT_NEAR(value, blob.cpu_data()[i], 0.2);
+      }
+    }
+  }
+}
+
+TEST(QuantizeValuesTest, TestClusters) {
+  const float kValues[] = {0.1, 0.12, 0.11, 0.9, 0.95, -2, 0.1};
+  std::vector<float> values(kValues, kValues + 7);
+  std::vector<float> codebook;
+  std::vector<int> codes;
+  QuantizeValues(values, 3, 10, &codebook, &codes);
+  ASSERT_EQ(3, codebook.size());
+  EXPECT_FLOAT_EQ(-2, codebook[0]);
+  EXPECT_NEAR(0.1075, codebook[1], 1e-5);
+  EXPECT_NEAR(0.925, codebook[2], 1e-5);
+  const int kCodes[] = {1, 1, 1, 2, 2, 0, 1};
+  for (int i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(kCodes[i], codes[i]);
+  }
+}
+
+}  // namespace caffe
@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/embed_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -175,4 +176,46 @@ TYPED_TEST(EmbedLayerTest, TestGradientWithBias) {
       this->blob_top_vec_, -2);
 }
 
+TYPED_TEST(EmbedLayerTest, TestSparseGradientRows) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  EmbedParameter* embed_param = layer_param.mutable_embed_param();
+  embed_param->set_num_output(10);
+  embed_param->set_input_dim(5);
+  embed_param->set_bias_term(false);
+  embed_param->set_sparse_gradient(true);
+  EmbedLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The rows are tracked from the first clear of the diff on.
+  EXPECT_TRUE(layer.param_diff_rows(0) == NULL);
+  layer.ClearParamDiffRows();
+  this->blob_bottom_->mutable_cpu_data()[0] = 4;
+  this->blob_bottom_->mutable_cpu_data()[1] = 2;
+  this->blob_bottom_->mutable_cpu_data()[2] = 2;
+  this->blob_bottom_->mutable_cpu_data()[3] = 3;
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_set(this->blob_top_->count(), Dtype(1),
+      this->blob_top_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, false);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  const vector<int>* rows = layer.param_diff_rows(0);
+  if (Caffe::mode() == Caffe::GPU) {
+    EXPECT_TRUE(rows == NULL);
+    return;
+  }
+  ASSERT_TRUE(rows != NULL);
+  ASSERT_EQ(3, rows->size());
+  EXPECT_EQ(4, (*rows)[0]);
+  EXPECT_EQ(2, (*rows)[1]);
+  EXPECT_EQ(3, (*rows)[2]);
+  const Dtype* weight_diff = layer.blobs()[0]->cpu_diff();
+  for (int i = 0; i < layer.blobs()[0]->count(); ++i) {
+    const int row = i / 10;
+    const Dtype expected = (row == 2) ? 2 : (row == 3 || row == 4) ? 1 : 0;
+    EXPECT_EQ(expected, weight_diff[i]);
+  }
+  layer.InvalidateParamDiffRows();
+  EXPECT_TRUE(layer.param_diff_rows(0) == NULL);
+}
+
 }  // namespace caffe
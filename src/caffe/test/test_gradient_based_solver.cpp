@@ -42,6 +42,8 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  // Extra solver fields appended to the least squares solver definition.
+  string extra_solver_proto_;
   Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -181,6 +183,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (snapshot) {
       proto << "snapshot: " << num_iters << " ";
     }
+    proto << extra_solver_proto_;
     Caffe::set_random_seed(this->seed_);
     this->InitSolverFromProtoString(proto.str());
     if (from_snapshot != NULL) {
@@ -435,6 +438,41 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     EXPECT_NEAR(expected_bias, accum_bias, error_margin);
   }
 
+  // Check that training in reduced precision stays within the given relative
+  // error of full precision training.
+  void CheckReducedPrecision(const string& precision_proto,
+      const double kPrecision) {
+    const Dtype kLearningRate = 0.01;
+    const Dtype kWeightDecay = 0.5;
+    const Dtype kMomentum = 0.9;
+    const int kNumIters = 4;
+    const double kMinPrecision = kPrecision / 10;
+    this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+        kNumIters);
+    const vector<Blob<Dtype>*>& params =
+        this->solver_->net()->learnable_params();
+    vector<shared_ptr<Blob<Dtype> > > full_params(params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      full_params[i].reset(new Blob<Dtype>());
+      full_params[i]->CopyFrom(*params[i], false, true);
+    }
+    this->extra_solver_proto_ = precision_proto;
+    this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+        kNumIters);
+    const vector<Blob<Dtype>*>& reduced_params =
+        this->solver_->net()->learnable_params();
+    ASSERT_EQ(full_params.size(), reduced_params.size());
+    for (int i = 0; i < reduced_params.size(); ++i) {
+      for (int j = 0; j < reduced_params[i]->count(); ++j) {
+        const Dtype expected_param = full_params[i]->cpu_data()[j];
+        const Dtype reduced_param = reduced_params[i]->cpu_data()[j];
+        const Dtype error_margin = std::max(kMinPrecision, kPrecision *
+            std::min(fabs(expected_param), fabs(reduced_param)));
+        EXPECT_NEAR(expected_param, reduced_param, error_margin);
+      }
+    }
+  }
+
   // Test that the correct update is computed for a regularized least squares
   // problem:
   //
@@ -694,6 +732,70 @@ TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithLossScale) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->extra_solver_proto_ = "loss_scale: 1024 ";
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateFloat16) {
+  this->CheckReducedPrecision("train_precision: FLOAT16 loss_scale: 128 ",
+      1e-2);
+}
+
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateBFloat16) {
+  this->CheckReducedPrecision("train_precision: BFLOAT16 ", 3e-2);
+}
+
+TYPED_TEST(SGDSolverTest, TestDynamicLossScaleOverflow) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kLossScale = 1e8;
+  ostringstream extra;
+  extra << "train_precision: FLOAT16 dynamic_loss_scale: true "
+        << "loss_scale: " << kLossScale << " ";
+  this->extra_solver_proto_ = extra.str();
+  // Save the initial params.
+  this->RunLeastSquaresSolver(kLearningRate, 0, 0, 0);
+  const vector<Blob<Dtype>*>& init_params =
+      this->solver_->net()->learnable_params();
+  vector<shared_ptr<Blob<Dtype> > > param_copies(init_params.size());
+  for (int i = 0; i < init_params.size(); ++i) {
+    param_copies[i].reset(new Blob<Dtype>());
+    param_copies[i]->CopyFrom(*init_params[i], false, true);
+  }
+  // The scaled gradients do not fit in half precision: the update is skipped
+  // and the loss scale reduced.
+  this->RunLeastSquaresSolver(kLearningRate, 0, 0, 1);
+  EXPECT_EQ(kLossScale / 2, this->solver_->loss_scale());
+  const vector<Blob<Dtype>*>& params = this->solver_->net()->learnable_params();
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(param_copies[i]->cpu_data()[j], params[i]->cpu_data()[j])
+          << "param " << i << " data differed at dim " << j;
+    }
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotFloat16) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->extra_solver_proto_ = "train_precision: FLOAT16 loss_scale: 128 "
+      "dynamic_loss_scale: true loss_scale_window: 2 ";
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 
 template <typename TypeParam>
 class AdaGradSolverTest : public GradientBasedSolverTest<TypeParam> {
@@ -0,0 +1,115 @@
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_memory_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostMemoryPoolTest : public ::testing::Test {
+ protected:
+  HostMemoryPoolTest() : pool_(HostMemoryPool::Get()) {}
+
+  virtual void TearDown() {
+    Caffe::set_host_memory_pool(false);
+    pool_.set_max_cached(HostMemoryPool::kDefaultMaxCached);
+    pool_.Trim();
+  }
+
+  HostMemoryPool& pool_;
+};
+
+TEST_F(HostMemoryPoolTest, TestSizeClass) {
+  EXPECT_EQ(64, HostMemoryPool::SizeClass(1));
+  EXPECT_EQ(64, HostMemoryPool::SizeClass(64));
+  EXPECT_EQ(128, HostMemoryPool::SizeClass(65));
+  EXPECT_EQ(1024, HostMemoryPool::SizeClass(1024));
+  EXPECT_EQ(1280, HostMemoryPool::SizeClass(1025));
+  EXPECT_EQ(1536, HostMemoryPool::SizeClass(1300));
+  for (size_t size = 1; size < (1 << 20); size = size * 3 / 2 + 1) {
+    const size_t block_size = HostMemoryPool::SizeClass(size);
+    EXPECT_GE(block_size, size);
+    EXPECT_EQ(0, block_size % HostMemoryPool::kAlignment);
+    // At most a quarter is wasted past the smallest class.
+    EXPECT_LE(block_size, std::max<size_t>(64, size + size / 4 + 64));
+  }
+  // Huge blocks span whole huge pages.
+  EXPECT_EQ(0, HostMemoryPool::SizeClass(HostMemoryPool::kHugePageThreshold
+      + 1) % HostMemoryPool::kHugePageSize);
+}
+
+TEST_F(HostMemoryPoolTest, TestReuse) {
+  pool_.Trim();
+  const HostMemoryPool::Stats before = pool_.stats();
+  void* ptr = pool_.Allocate(1000);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(ptr) % HostMemoryPool::kAlignment);
+  pool_.Free(ptr, 1000);
+  EXPECT_EQ(before.cached + 1024, pool_.stats().cached);
+  // Any request of the same class reuses the block.
+  void* reused = pool_.Allocate(1010);
+  EXPECT_EQ(ptr, reused);
+  // Another class does not.
+  void* other = pool_.Allocate(2000);
+  EXPECT_NE(ptr, other);
+  HostMemoryPool::Stats stats = pool_.stats();
+  EXPECT_EQ(before.allocations + 3, stats.allocations);
+  EXPECT_EQ(before.hits + 1, stats.hits);
+  EXPECT_EQ(before.system_allocations + 2, stats.system_allocations);
+  EXPECT_EQ(before.in_use + 1024 + 2048, stats.in_use);
+  pool_.Free(reused, 1010);
+  pool_.Free(other, 2000);
+  pool_.Trim();
+  stats = pool_.stats();
+  EXPECT_EQ(0, stats.cached);
+  EXPECT_EQ(before.in_use, stats.in_use);
+}
+
+TEST_F(HostMemoryPoolTest, TestMaxCached) {
+  pool_.Trim();
+  EXPECT_EQ(HostMemoryPool::kDefaultMaxCached, pool_.max_cached());
+  pool_.set_max_cached(1024);
+  void* first = pool_.Allocate(1024);
+  void* second = pool_.Allocate(1024);
+  pool_.Free(first, 1024);
+  pool_.Free(second, 1024);
+  EXPECT_EQ(1024, pool_.stats().cached);
+  pool_.set_max_cached(0);
+  EXPECT_EQ(0, pool_.stats().cached);
+}
+
+TEST_F(HostMemoryPoolTest, TestSyncedMemory) {
+  Caffe::set_host_memory_pool(true);
+  pool_.Trim();
+  const HostMemoryPool::Stats before = pool_.stats();
+  void* ptr;
+  {
+    SyncedMemory mem(4000);
+    ptr = mem.mutable_cpu_data();
+    EXPECT_EQ(0, static_cast<char*>(ptr)[3999]);
+    static_cast<char*>(ptr)[3999] = 1;
+  }
+  {
+    // The freed block is reused and cleared.
+    SyncedMemory mem(3900);
+    EXPECT_EQ(ptr, mem.cpu_data());
+    EXPECT_EQ(0, static_cast<const char*>(mem.cpu_data())[3899]);
+  }
+  // Blocks from the pool go back to it even after the pool is disabled.
+  Caffe::set_host_memory_pool(false);
+  {
+    SyncedMemory mem(4000);
+    EXPECT_NE(ptr, mem.cpu_data());
+  }
+  const HostMemoryPool::Stats stats = pool_.stats();
+  EXPECT_EQ(before.allocations + 2, stats.allocations);
+  EXPECT_EQ(before.hits + 1, stats.hits);
+  EXPECT_EQ(before.in_use, stats.in_use);
+}
+
+}  // namespace caffe
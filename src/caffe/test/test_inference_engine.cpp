@@ -0,0 +1,237 @@
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/inference_engine.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class InferenceEngineTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  InferenceEngineTest() : num_requests_(12) {}
+
+  virtual void SetUp() {
+    const string proto =
+        "name: 'InferenceNet' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape: { dim: 2 dim: 3 dim: 4 dim: 4 } } "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "  convolution_param { "
+        "    num_output: 5 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'flatten' "
+        "  type: 'Flatten' "
+        "  bottom: 'conv' "
+        "  top: 'flat' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'flat' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 7 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+    // Requests of varying batch size exercise reshaping of the replicas.
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    for (int i = 0; i < num_requests_; ++i) {
+      inputs_.push_back(shared_ptr<Blob<Dtype> >(
+          new Blob<Dtype>(1 + i % 3, 3, 4, 4)));
+      filler.Fill(inputs_[i].get());
+    }
+  }
+
+  // Compute the expected outputs with the root net before any request.
+  void ComputeExpected(InferenceEngine<Dtype>* engine) {
+    Net<Dtype>* net = engine->net().get();
+    for (int i = 0; i < num_requests_; ++i) {
+      net->input_blobs()[0]->CopyFrom(*inputs_[i], false, true);
+      expected_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      expected_[i]->CopyFrom(*net->Forward()[0], false, true);
+    }
+  }
+
+ public:
+  // Public so that client threads can be bound to it.
+  void Predict(InferenceEngine<Dtype>* engine, int begin, int step,
+      vector<shared_ptr<Blob<Dtype> > >* outputs) {
+    for (int i = begin; i < num_requests_; i += step) {
+      vector<Blob<Dtype>*> input(1, inputs_[i].get());
+      vector<Blob<Dtype>*> output(1, (*outputs)[i].get());
+      engine->Predict(input, output);
+    }
+  }
+
+ protected:
+  void CheckOutputs(const vector<shared_ptr<Blob<Dtype> > >& outputs,
+      int begin = 0, int step = 1) {
+    for (int i = begin; i < num_requests_; i += step) {
+      ASSERT_TRUE(outputs[i]->shape() == expected_[i]->shape());
+      for (int j = 0; j < outputs[i]->count(); ++j) {
+        // Batched products may be accumulated in a different order.
+        EXPECT_NEAR(expected_[i]->cpu_data()[j], outputs[i]->cpu_data()[j],
+            1e-5);
+      }
+    }
+  }
+
+  const int num_requests_;
+  NetParameter param_;
+  vector<shared_ptr<Blob<Dtype> > > inputs_;
+  vector<shared_ptr<Blob<Dtype> > > expected_;
+};
+
+TYPED_TEST_CASE(InferenceEngineTest, TestDtypesAndDevices);
+
+TYPED_TEST(InferenceEngineTest, TestPredict) {
+  typedef typename TypeParam::Dtype Dtype;
+  InferenceEngine<Dtype> engine(this->param_, 1);
+  EXPECT_EQ(1, engine.num_workers());
+  this->ComputeExpected(&engine);
+  vector<shared_ptr<Blob<Dtype> > > outputs;
+  for (int i = 0; i < this->num_requests_; ++i) {
+    outputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  this->Predict(&engine, 0, 1, &outputs);
+  this->CheckOutputs(outputs);
+}
+
+TYPED_TEST(InferenceEngineTest, TestConcurrentPredict) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumWorkers = 3;
+  const int kNumClients = 4;
+  InferenceEngine<Dtype> engine(this->param_, kNumWorkers);
+  EXPECT_EQ(kNumWorkers, engine.num_workers());
+  this->ComputeExpected(&engine);
+  vector<shared_ptr<Blob<Dtype> > > outputs;
+  for (int i = 0; i < this->num_requests_; ++i) {
+    outputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  boost::thread_group clients;
+  for (int i = 0; i < kNumClients; ++i) {
+    clients.create_thread(boost::bind(
+        &InferenceEngineTest<TypeParam>::Predict, this, &engine, i,
+        kNumClients, &outputs));
+  }
+  clients.join_all();
+  this->CheckOutputs(outputs);
+  EXPECT_EQ(this->num_requests_, engine.num_requests());
+  EXPECT_EQ(this->num_requests_, engine.num_batches());
+}
+
+TYPED_TEST(InferenceEngineTest, TestBatching) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Requests 0, 3, 6 and 9 hold a single item each: one per client fills
+  // the batch long before the deadline.
+  const int kNumClients = 4;
+  const int kStep = 3 * kNumClients;
+  InferenceEngine<Dtype> engine(this->param_, 1, kNumClients, 10000000);
+  EXPECT_EQ(kNumClients, engine.max_batch_size());
+  this->ComputeExpected(&engine);
+  vector<shared_ptr<Blob<Dtype> > > outputs;
+  for (int i = 0; i < this->num_requests_; ++i) {
+    outputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  boost::thread_group clients;
+  for (int i = 0; i < kNumClients; ++i) {
+    clients.create_thread(boost::bind(
+        &InferenceEngineTest<TypeParam>::Predict, this, &engine, 3 * i,
+        kStep, &outputs));
+  }
+  clients.join_all();
+  for (int i = 0; i < kNumClients; ++i) {
+    this->CheckOutputs(outputs, 3 * i, kStep);
+  }
+  EXPECT_EQ(kNumClients, engine.num_requests());
+  EXPECT_EQ(1, engine.num_batches());
+  EXPECT_EQ(kNumClients, engine.latency().count());
+  engine.ResetStats();
+  EXPECT_EQ(0, engine.num_requests());
+  EXPECT_EQ(0, engine.latency().count());
+}
+
+TYPED_TEST(InferenceEngineTest, TestConcurrentPredictBatched) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumWorkers = 2;
+  const int kNumClients = 4;
+  InferenceEngine<Dtype> engine(this->param_, kNumWorkers, 5, 1000);
+  this->ComputeExpected(&engine);
+  vector<shared_ptr<Blob<Dtype> > > outputs;
+  for (int i = 0; i < this->num_requests_; ++i) {
+    outputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  boost::thread_group clients;
+  for (int i = 0; i < kNumClients; ++i) {
+    clients.create_thread(boost::bind(
+        &InferenceEngineTest<TypeParam>::Predict, this, &engine, i,
+        kNumClients, &outputs));
+  }
+  clients.join_all();
+  this->CheckOutputs(outputs);
+  EXPECT_EQ(this->num_requests_, engine.num_requests());
+  EXPECT_EQ(this->num_requests_, engine.latency().count());
+  EXPECT_LE(engine.num_batches(), this->num_requests_);
+}
+
+TYPED_TEST(InferenceEngineTest, TestIdleRelease) {
+  typedef typename TypeParam::Dtype Dtype;
+  InferenceEngine<Dtype> engine(this->param_, 1, 1, 0, 10);
+  EXPECT_EQ(10, engine.idle_release_ms());
+  this->ComputeExpected(&engine);
+  vector<shared_ptr<Blob<Dtype> > > outputs;
+  for (int i = 0; i < this->num_requests_; ++i) {
+    outputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  this->Predict(&engine, 0, this->num_requests_, &outputs);
+  // The only worker serves the root net.
+  boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = engine.net()->blobs();
+  for (int i = 0; i < blobs.size(); ++i) {
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED, blobs[i]->data()->head());
+  }
+  // Serving allocates the memory again, and the Flatten top shares the new
+  // memory of its bottom.
+  for (int i = 0; i < this->num_requests_; ++i) {
+    outputs[i].reset(new Blob<Dtype>());
+  }
+  this->Predict(&engine, 0, 1, &outputs);
+  this->CheckOutputs(outputs);
+}
+
+}  // namespace caffe
@@ -388,4 +388,43 @@ TYPED_TEST(InnerProductLayerTest, TestBackwardTranspose) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardSparse) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  for (int transpose = 0; transpose < 2; ++transpose) {
+    LayerParameter layer_param;
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(10);
+    inner_product_param->set_transpose(transpose);
+    inner_product_param->set_sparse_threshold(0.5);
+    inner_product_param->mutable_weight_filler()->set_type("uniform");
+    inner_product_param->mutable_bias_filler()->set_type("uniform");
+    shared_ptr<InnerProductLayer<Dtype> > dense(
+        new InnerProductLayer<Dtype>(layer_param));
+    dense->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    // Prune two weights out of three.
+    Dtype* weight_data = dense->blobs()[0]->mutable_cpu_data();
+    for (int i = 0; i < dense->blobs()[0]->count(); ++i) {
+      if (i % 3 != 0) {
+        weight_data[i] = 0;
+      }
+    }
+    dense->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> dense_top;
+    dense_top.CopyFrom(*this->blob_top_, false, true);
+
+    layer_param.set_phase(TEST);
+    InnerProductLayer<Dtype> sparse(layer_param);
+    sparse.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    sparse.blobs()[0]->ShareData(*dense->blobs()[0]);
+    sparse.blobs()[1]->ShareData(*dense->blobs()[1]);
+    sparse.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(dense_top.cpu_data()[i], this->blob_top_->cpu_data()[i],
+          1e-5);
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,102 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/layers/pooling_layer.hpp"
+#include "caffe/layers/relu_layer.hpp"
+#include "caffe/layers/split_layer.hpp"
+#include "caffe/util/layer_cost.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class LayerCostTest : public ::testing::Test {
+ protected:
+  LayerCostTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 6, 5)),
+        blob_top_(new Blob<Dtype>()) {
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~LayerCostTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(LayerCostTest, TestDtypes);
+
+TYPED_TEST(LayerCostTest, TestConvolution) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(4);
+  ConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const LayerCost cost = EstimateLayerCost(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  // 2 x 4 x 4 x 3 outputs, each a 3 x 3 x 3 dot product plus a bias.
+  const int64_t outputs = 2 * 4 * 4 * 3;
+  EXPECT_EQ(outputs * (2 * 27 + 1), cost.forward_flops);
+  EXPECT_EQ(outputs * (4 * 27 + 1), cost.backward_flops);
+  const int64_t params = 4 * 27 + 4;
+  EXPECT_EQ(sizeof(TypeParam) * (180 + params + outputs),
+      cost.forward_bytes);
+}
+
+TYPED_TEST(LayerCostTest, TestInnerProduct) {
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->set_bias_term(false);
+  InnerProductLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const LayerCost cost = EstimateLayerCost(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  EXPECT_EQ(2 * 2 * 10 * 90, cost.forward_flops);
+  EXPECT_EQ(2 * 2 * 2 * 10 * 90 + 2 * 10, cost.backward_flops);
+}
+
+TYPED_TEST(LayerCostTest, TestPooling) {
+  LayerParameter layer_param;
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(2);
+  pooling_param->set_stride(2);
+  PoolingLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const LayerCost cost = EstimateLayerCost(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->count() * 4, cost.forward_flops);
+}
+
+TYPED_TEST(LayerCostTest, TestElementwiseAndShared) {
+  LayerParameter layer_param;
+  ReLULayer<TypeParam> relu_layer(layer_param);
+  relu_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  LayerCost cost = EstimateLayerCost(&relu_layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  EXPECT_EQ(180, cost.forward_flops);
+  EXPECT_EQ(sizeof(TypeParam) * 2 * 180, cost.forward_bytes);
+  SplitLayer<TypeParam> split_layer(layer_param);
+  split_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  cost = EstimateLayerCost(&split_layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  EXPECT_EQ(0, cost.forward_flops);
+  EXPECT_EQ(0, cost.forward_bytes);
+  EXPECT_EQ(0, cost.backward_bytes);
+}
+
+}  // namespace caffe
@@ -41,6 +41,14 @@ class LRNLayerTest : public MultiDeviceTest<TypeParam> {
     blob_top_vec_.push_back(blob_top_);
   }
   virtual ~LRNLayerTest() { delete blob_bottom_; delete blob_top_; }
+  // Spans two full CPU tiles of 256 positions and a partial third one; the
+  // gradient checks use fewer channels to keep the float objective exact.
+  void ReshapeBottomMultiTile(int channels) {
+    blob_bottom_->Reshape(2, channels, 17, 17);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+  }
   void ReferenceLRNForward(const Blob<Dtype>& blob_bottom,
       const LayerParameter& layer_param, Blob<Dtype>* blob_top);
 
@@ -201,6 +209,60 @@ TYPED_TEST(LRNLayerTest, TestGradientAcrossChannelsLargeRegion) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(LRNLayerTest, TestForwardAcrossChannelsMultiTile) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->ReshapeBottomMultiTile(7);
+  LayerParameter layer_param;
+  LRNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> top_reference;
+  this->ReferenceLRNForward(*(this->blob_bottom_), layer_param,
+      &top_reference);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], top_reference.cpu_data()[i],
+                this->epsilon_);
+  }
+}
+
+TYPED_TEST(LRNLayerTest, TestForwardAcrossChannelsMultiTileBeta) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->ReshapeBottomMultiTile(7);
+  LayerParameter layer_param;
+  layer_param.mutable_lrn_param()->set_beta(0.5);
+  LRNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> top_reference;
+  this->ReferenceLRNForward(*(this->blob_bottom_), layer_param,
+      &top_reference);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], top_reference.cpu_data()[i],
+                this->epsilon_);
+  }
+}
+
+TYPED_TEST(LRNLayerTest, TestGradientAcrossChannelsMultiTile) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->ReshapeBottomMultiTile(3);
+  LayerParameter layer_param;
+  LRNLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradient(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(LRNLayerTest, TestGradientAcrossChannelsMultiTileBeta) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->ReshapeBottomMultiTile(3);
+  LayerParameter layer_param;
+  layer_param.mutable_lrn_param()->set_beta(0.5);
+  LRNLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradient(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 TYPED_TEST(LRNLayerTest, TestSetupWithinChannel) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
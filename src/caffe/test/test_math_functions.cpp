@@ -1,6 +1,8 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
 #include <cmath>  // for std::fabs
+#include <limits>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -119,6 +121,93 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestRoundHalf) {
+  const TypeParam x[] = {1, 1 + 1. / 4096, 1 + 3. / 2048, -2049, 65504, 65520,
+      1e-8, 0.1};
+  const TypeParam expected[] = {1, 1, 1 + 1. / 512, -2048, 65504,
+      std::numeric_limits<TypeParam>::infinity(), 0, 0.0999755859375};
+  TypeParam y[8];
+  caffe_cpu_round_half<TypeParam>(8, x, y);
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(expected[i], y[i]);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestRoundBFloat16) {
+  const TypeParam x[] = {1, 1 + 1. / 256, 1 + 3. / 256, -257, 3.4e38, 0.1};
+  const TypeParam expected[] = {1, 1, 1 + 1. / 64, -256,
+      std::numeric_limits<TypeParam>::infinity(), 0.10009765625};
+  TypeParam y[6];
+  caffe_cpu_round_bfloat16<TypeParam>(6, x, y);
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(expected[i], y[i]);
+  }
+}
+
+// The transcendental functions against libm in double precision, with
+// special values.
+TYPED_TEST(CPUMathFunctionsTest, TestTranscendental) {
+  const TypeParam inf = std::numeric_limits<TypeParam>::infinity();
+  const TypeParam nan = std::numeric_limits<TypeParam>::quiet_NaN();
+  const TypeParam specials[] = {0, -0., 1e-40, -1e-40, 1e-3, -1e-3, 0.6,
+      -0.7, 20, -20, 88.5, -88.5, 100, -100, 1e30, -1e30, inf, -inf, nan};
+  vector<TypeParam> x(specials,
+      specials + sizeof(specials) / sizeof(*specials));
+  const int n = this->blob_bottom_->count();
+  const TypeParam* data = this->blob_bottom_->cpu_data();
+  x.insert(x.end(), data, data + n);
+  for (int i = 0; i < n; ++i) {
+    x.push_back(data[i] * 30);
+  }
+  vector<TypeParam> y(x.size());
+  const TypeParam kRelative = 4 * std::numeric_limits<TypeParam>::epsilon();
+  const TypeParam kAbsolute = 4 * std::numeric_limits<TypeParam>::denorm_min();
+  for (int f = 0; f < 4; ++f) {
+    switch (f) {
+      case 0: caffe_exp<TypeParam>(x.size(), &x[0], &y[0]); break;
+      case 1: caffe_log<TypeParam>(x.size(), &x[0], &y[0]); break;
+      case 2: caffe_tanh<TypeParam>(x.size(), &x[0], &y[0]); break;
+      case 3: caffe_sigmoid<TypeParam>(x.size(), &x[0], &y[0]); break;
+    }
+    for (int i = 0; i < x.size(); ++i) {
+      const double xi = x[i];
+      const TypeParam expected =
+          f == 0 ? std::exp(xi) : f == 1 ? std::log(xi) :
+          f == 2 ? std::tanh(xi) : 1 / (1 + std::exp(-xi));
+      if (std::isnan(expected)) {
+        EXPECT_TRUE(std::isnan(y[i])) << "function " << f << " at " << xi;
+      } else if (std::isinf(expected) || expected == 0) {
+        EXPECT_EQ(expected, y[i]) << "function " << f << " at " << xi;
+      } else {
+        EXPECT_NEAR(expected, y[i],
+            std::abs(expected) * kRelative + kAbsolute)
+            << "function " << f << " at " << xi;
+      }
+    }
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestPowx) {
+  const int n = this->blob_bottom_->count();
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  TypeParam* y = this->blob_bottom_->mutable_cpu_diff();
+  const TypeParam kRelative = 2 * std::numeric_limits<TypeParam>::epsilon();
+  const TypeParam exponents[] = {1, 2, -1, 0.5, 3, -0.75};
+  for (int e = 0; e < sizeof(exponents) / sizeof(*exponents); ++e) {
+    const TypeParam b = exponents[e];
+    caffe_powx<TypeParam>(n, x, b, y);
+    for (int i = 0; i < n; ++i) {
+      const TypeParam expected = std::pow(x[i], b);
+      if (std::isnan(expected)) {
+        EXPECT_TRUE(std::isnan(y[i])) << x[i] << "^" << b;
+      } else {
+        EXPECT_NEAR(expected, y[i], std::abs(expected) * kRelative)
+            << x[i] << "^" << b;
+      }
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
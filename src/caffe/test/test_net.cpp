@@ -1,3 +1,5 @@
+#include <stdint.h>
+
 #include <string>
 #include <utility>
 #include <vector>
@@ -9,7 +11,9 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/weight_file.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -716,6 +720,200 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitRecomputeNet(const bool recompute) {
+    const string recompute_proto = recompute ? "  recompute: true " : "";
+    string proto =
+        "name: 'RecomputeNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    num: 5 "
+        "    channels: 2 "
+        "    height: 3 "
+        "    width: 4 "
+        "    num: 5 "
+        "    channels: 1 "
+        "    height: 1 "
+        "    width: 1 "
+        "    data_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'target' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'innerproduct1' " + recompute_proto +
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'innerproduct1' "
+        "  top: 'innerproduct1' " + recompute_proto +
+        "} "
+        "layer { "
+        "  name: 'innerproduct2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  bottom: 'innerproduct1' "
+        "  top: 'innerproduct2' " + recompute_proto +
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'innerproduct1' "
+        "  bottom: 'innerproduct2' "
+        "  top: 'sum' " + recompute_proto +
+        "} "
+        "layer { "
+        "  name: 'innerproduct3' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  bottom: 'sum' "
+        "  top: 'innerproduct3' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'innerproduct3' "
+        "  bottom: 'target' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitConcatNet() {
+    string proto =
+        "name: 'ConcatNetwork' "
+        "force_backward: true "
+        "layer { "
+        "  name: 'input' "
+        "  type: 'Input' "
+        "  top: 'a' "
+        "  top: 'b' "
+        "  input_param { "
+        "    shape: { dim: 2 dim: 3 } "
+        "    shape: { dim: 3 dim: 3 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'a2' "
+        "  type: 'Power' "
+        "  bottom: 'a' "
+        "  top: 'a2' "
+        "  power_param { scale: 2 } "
+        "} "
+        "layer { "
+        "  name: 'b2' "
+        "  type: 'Power' "
+        "  bottom: 'b' "
+        "  top: 'b2' "
+        "  power_param { scale: 2 } "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'a2' "
+        "  bottom: 'b2' "
+        "  top: 'ab' "
+        "  concat_param { axis: 0 } "
+        "} "
+        "layer { "
+        "  name: 'slice' "
+        "  type: 'Slice' "
+        "  bottom: 'ab' "
+        "  top: 's1' "
+        "  top: 's2' "
+        "  slice_param { axis: 0 slice_point: 1 } "
+        "} "
+        "layer { "
+        "  name: 't1' "
+        "  type: 'Power' "
+        "  bottom: 's1' "
+        "  top: 't1' "
+        "  power_param { scale: 3 } "
+        "} "
+        "layer { "
+        "  name: 't2' "
+        "  type: 'Power' "
+        "  bottom: 's2' "
+        "  top: 't2' "
+        "  power_param { scale: 3 } "
+        "} "
+        "layer { "
+        "  name: 'loss1' "
+        "  type: 'Reduction' "
+        "  bottom: 't1' "
+        "  top: 'loss1' "
+        "  loss_weight: 1 "
+        "} "
+        "layer { "
+        "  name: 'loss2' "
+        "  type: 'Reduction' "
+        "  bottom: 't2' "
+        "  top: 'loss2' "
+        "  loss_weight: 1 "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  // Run the ConcatNetwork on inputs with a rows and check its outputs and
+  // input gradients.
+  void CheckConcatNet(const int a_rows) {
+    Blob<Dtype>* a = net_->blob_by_name("a").get();
+    Blob<Dtype>* b = net_->blob_by_name("b").get();
+    vector<int> shape(2, 3);
+    shape[0] = a_rows;
+    a->Reshape(shape);
+    for (int i = 0; i < a->count(); ++i) {
+      a->mutable_cpu_data()[i] = i;
+    }
+    for (int i = 0; i < b->count(); ++i) {
+      b->mutable_cpu_data()[i] = 100 + i;
+    }
+    net_->Forward();
+    net_->Backward();
+    const Blob<Dtype>* ab = net_->blob_by_name("ab").get();
+    const Blob<Dtype>* t1 = net_->blob_by_name("t1").get();
+    const Blob<Dtype>* t2 = net_->blob_by_name("t2").get();
+    ASSERT_EQ(a->count() + b->count(), ab->count());
+    ASSERT_EQ(3, t1->count());
+    for (int i = 0; i < ab->count(); ++i) {
+      const Dtype x = i < a->count() ? i : 100 + i - a->count();
+      EXPECT_EQ(2 * x, ab->cpu_data()[i]);
+      EXPECT_EQ(6 * x, i < 3 ? t1->cpu_data()[i] : t2->cpu_data()[i - 3]);
+    }
+    for (int i = 0; i < a->count(); ++i) {
+      EXPECT_EQ(6, a->cpu_diff()[i]);
+    }
+    for (int i = 0; i < b->count(); ++i) {
+      EXPECT_EQ(6, b->cpu_diff()[i]);
+    }
+  }
+
   int seed_;
   shared_ptr<Net<Dtype> > net_;
 };
@@ -1174,6 +1372,71 @@ TYPED_TEST(NetTest, TestSharedWeightsUpdate) {
   }
 }
 
+TYPED_TEST(NetTest, TestWeightsNet) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "name: 'WeightsNet' "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 } } } "
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'data' top: 'ip' "
+      "  inner_product_param { num_output: 4 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } } } ";
+  this->InitNetFromProtoString(proto);
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  // The params are shared without running the fillers, which would draw
+  // random numbers.
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> net(param, NULL, this->net_.get());
+  const unsigned int next = caffe_rng_rand();
+  Caffe::set_random_seed(this->seed_);
+  EXPECT_EQ(caffe_rng_rand(), next);
+  const vector<shared_ptr<Blob<Dtype> > >& params = net.params();
+  const vector<shared_ptr<Blob<Dtype> > >& source_params =
+      this->net_->params();
+  ASSERT_EQ(2, params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(source_params[i]->shape(), params[i]->shape());
+    EXPECT_EQ(source_params[i]->data(), params[i]->data());
+  }
+}
+
+TYPED_TEST(NetTest, TestGatherParamDiffRows) {
+  // The rows with gradient are tracked on the CPU only.
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  const string embed_param =
+      "  param { name: 'shared' } "
+      "  embed_param { input_dim: 6 num_output: 4 bias_term: false "
+      "    weight_filler { type: 'gaussian' } sparse_gradient: true } } ";
+  const string proto =
+      "name: 'GatherParamDiffRowsNet' "
+      "layer { name: 'data' type: 'DummyData' top: 'a' top: 'b' "
+      "  dummy_data_param { shape { dim: 2 } shape { dim: 2 } "
+      "    data_filler { type: 'constant' value: 3 } "
+      "    data_filler { type: 'constant' value: 1 } } } "
+      "layer { name: 'embed_a' type: 'Embed' bottom: 'a' top: 'ea' " +
+      embed_param +
+      "layer { name: 'embed_b' type: 'Embed' bottom: 'b' top: 'eb' " +
+      embed_param +
+      "layer { name: 'loss' type: 'EuclideanLoss' bottom: 'ea' bottom: 'eb' "
+      "  top: 'loss' } ";
+  this->InitNetFromProtoString(proto);
+  ASSERT_EQ(1, this->net_->learnable_params().size());
+  this->net_->ClearParamDiffs();
+  this->net_->ForwardBackward();
+  EXPECT_TRUE(this->net_->learnable_param_diff_rows(0) == NULL);
+  // The rows of both layers using the param, merged.
+  this->net_->GatherParamDiffRows();
+  const vector<int>* rows = this->net_->learnable_param_diff_rows(0);
+  ASSERT_TRUE(rows != NULL);
+  ASSERT_EQ(2, rows->size());
+  EXPECT_EQ(1, (*rows)[0]);
+  EXPECT_EQ(3, (*rows)[1]);
+  this->net_->ClearParamDiffs();
+  EXPECT_TRUE(this->net_->learnable_param_diff_rows(0) == NULL);
+}
+
 TYPED_TEST(NetTest, TestSharedWeightsResume) {
   typedef typename TypeParam::Dtype Dtype;
 
@@ -1219,6 +1482,173 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestCopyTrainedLayersLazily) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  Blob<Dtype> shared_params;
+  shared_params.CopyFrom(*this->net_->layers()[1]->blobs()[0], false, true);
+  const int count = shared_params.count();
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  string filename;
+  MakeTempFilename(&filename);
+  WriteProtoToBinaryFile(net_param, filename);
+
+  // Without loading threads, nothing is loaded before the first Forward,
+  // which also loads the layers of the nets sharing them.
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  shared_ptr<Net<Dtype> > net = this->net_;
+  net->CopyTrainedLayersFromLazily(filename, 0);
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->ShareTrainedLayersWith(net.get());
+  Blob<Dtype>* ip1_weights = net->layers()[1]->blobs()[0].get();
+  Blob<Dtype>* ip2_weights = this->net_->layers()[2]->blobs()[0].get();
+  EXPECT_EQ(ip1_weights->cpu_data(), ip2_weights->cpu_data());
+  EXPECT_NE(shared_params.cpu_data()[0], ip1_weights->cpu_data()[0]);
+  this->net_->Forward();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(shared_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+
+  // Loading on threads ends with the same params.
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->CopyTrainedLayersFromLazily(filename, 2);
+  this->net_->WaitForTrainedLayers();
+  ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(shared_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(shared_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestWeightFile) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  Blob<Dtype> shared_params;
+  shared_params.CopyFrom(*this->net_->layers()[1]->blobs()[0], false, true);
+  const int count = shared_params.count();
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  string filename;
+  MakeTempFilename(&filename);
+  filename += WeightFile::kExtension;
+  WeightFile::Write(net_param, filename);
+
+  // The shared params point into the mapping, which is not charged.
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  Blob<Dtype>* ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  Blob<Dtype>* ip2_weights = this->net_->layers()[2]->blobs()[0].get();
+  EXPECT_EQ(ip1_weights->cpu_data(), ip2_weights->cpu_data());
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(ip1_weights->cpu_data()) %
+            WeightFile::kAlignment);
+  EXPECT_TRUE(ip1_weights->data()->cpu_account() == NULL);
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(shared_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+  // Updates copy the pages they write and leave the file untouched.
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  shared_ptr<Net<Dtype> > updated_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(shared_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+  EXPECT_NE(updated_net->layers()[1]->blobs()[0]->cpu_data()[0],
+            ip1_weights->cpu_data()[0]);
+
+  // Params of another type are converted into the net's own memory.
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    LayerParameter* layer = net_param.mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      BlobProto* blob = layer->mutable_blobs(j);
+      if (blob->double_data_size() > 0) {
+        for (int k = 0; k < blob->double_data_size(); ++k) {
+          blob->add_data(blob->double_data(k));
+        }
+        blob->clear_double_data();
+      } else {
+        for (int k = 0; k < blob->data_size(); ++k) {
+          blob->add_double_data(blob->data(k));
+        }
+        blob->clear_data();
+      }
+    }
+  }
+  WeightFile::Write(net_param, filename);
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  EXPECT_TRUE(ip1_weights->data()->cpu_account() != NULL);
+  for (int i = 0; i < count; ++i) {
+    EXPECT_FLOAT_EQ(shared_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestWeightFileLegacyShape) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitTinyNet();
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  // Old models give every param the 4-D shape (num, channels, height,
+  // width), e.g. 1 x 1 x N x M for InnerProduct weights.
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    LayerParameter* layer = net_param.mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      BlobProto* blob = layer->mutable_blobs(j);
+      vector<int> shape(4 - blob->shape().dim_size(), 1);
+      for (int k = 0; k < blob->shape().dim_size(); ++k) {
+        shape.push_back(blob->shape().dim(k));
+      }
+      ASSERT_EQ(4, shape.size());
+      blob->clear_shape();
+      blob->set_num(shape[0]);
+      blob->set_channels(shape[1]);
+      blob->set_height(shape[2]);
+      blob->set_width(shape[3]);
+    }
+  }
+  string filename;
+  MakeTempFilename(&filename);
+  filename += WeightFile::kExtension;
+  WeightFile::Write(net_param, filename);
+  shared_ptr<Net<Dtype> > trained_net = this->net_;
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitTinyNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  const vector<shared_ptr<Blob<Dtype> > >& trained_params =
+      trained_net->params();
+  ASSERT_EQ(trained_params.size(), params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(trained_params[i]->shape(), params[i]->shape());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(trained_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -2371,4 +2801,238 @@ TYPED_TEST(NetTest, TestSkipPropagateDown) {
   }
 }
 
+
+TYPED_TEST(NetTest, TestRecompute) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Compute the loss and gradients without recomputation.
+  Caffe::set_random_seed(this->seed_);
+  this->InitRecomputeNet(false);
+  Dtype loss;
+  this->net_->Forward(&loss);
+  this->net_->Backward();
+  vector<shared_ptr<Blob<Dtype> > > param_diffs;
+  this->CopyNetParams(true, &param_diffs);
+  // The recomputed net must give the same loss and gradients.
+  Caffe::set_random_seed(this->seed_);
+  this->InitRecomputeNet(true);
+  Dtype recompute_loss;
+  this->net_->Forward(&recompute_loss);
+  // The activations inside the segment are released after Forward, while
+  // the segment's output is kept for the following layers.
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+      this->net_->blob_by_name("innerproduct2")->data()->head());
+  EXPECT_NE(SyncedMemory::UNINITIALIZED,
+      this->net_->blob_by_name("sum")->data()->head());
+  this->net_->Backward();
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+      this->net_->blob_by_name("innerproduct2")->data()->head());
+  EXPECT_EQ(loss, recompute_loss);
+  const vector<shared_ptr<Blob<Dtype> > >& recompute_params =
+      this->net_->params();
+  ASSERT_EQ(param_diffs.size(), recompute_params.size());
+  for (int i = 0; i < param_diffs.size(); ++i) {
+    for (int j = 0; j < param_diffs[i]->count(); ++j) {
+      EXPECT_EQ(param_diffs[i]->cpu_diff()[j],
+          recompute_params[i]->cpu_diff()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestRecomputeReshape) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Reshape layers share the memory of their bottoms, both inside the
+  // segment and at its end, where the following layer keeps using it.
+  const string proto_prefix =
+      "name: 'RecomputeReshapeNetwork' "
+      "layer { name: 'data' type: 'DummyData' "
+      "  dummy_data_param { shape { dim: 5 dim: 2 dim: 3 dim: 4 } "
+      "    shape { dim: 5 dim: 1 } "
+      "    data_filler { type: 'gaussian' std: 1 } } "
+      "  top: 'data' top: 'target' } "
+      "layer { name: 'ip1' type: 'InnerProduct' bottom: 'data' top: 'ip1' "
+      "  inner_product_param { num_output: 10 "
+      "    weight_filler { type: 'gaussian' std: 1 } } ";
+  const string proto_suffix =
+      "layer { name: 'ip3' type: 'InnerProduct' bottom: 'r2' top: 'ip3' "
+      "  inner_product_param { num_output: 1 "
+      "    weight_filler { type: 'gaussian' std: 1 } } } "
+      "layer { name: 'loss' type: 'EuclideanLoss' "
+      "  bottom: 'ip3' bottom: 'target' } ";
+  const string layers =
+      "layer { name: 'r1' type: 'Reshape' bottom: 'ip1' top: 'r1' "
+      "  reshape_param { shape { dim: 0 dim: 2 dim: 5 } } ";
+  const string more_layers =
+      "layer { name: 'ip2' type: 'InnerProduct' bottom: 'r1' top: 'ip2' "
+      "  inner_product_param { num_output: 6 "
+      "    weight_filler { type: 'gaussian' std: 1 } } ";
+  const string last_layer =
+      "layer { name: 'r2' type: 'Reshape' bottom: 'ip2' top: 'r2' "
+      "  reshape_param { shape { dim: 0 dim: 3 dim: 2 } } ";
+  Dtype loss[2];
+  vector<shared_ptr<Blob<Dtype> > > param_diffs[2];
+  for (int recompute = 0; recompute < 2; ++recompute) {
+    const string end = recompute ? "recompute: true } " : "} ";
+    Caffe::set_random_seed(this->seed_);
+    this->InitNetFromProtoString(proto_prefix + end + layers + end +
+        more_layers + end + last_layer + end + proto_suffix);
+    this->net_->Forward(&loss[recompute]);
+    this->net_->Backward();
+    this->CopyNetParams(true, &param_diffs[recompute]);
+  }
+  // ip1 and r1 are released; ip2 is kept for r2, which is used after the
+  // segment.
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+      this->net_->blob_by_name("ip1")->data()->head());
+  EXPECT_NE(SyncedMemory::UNINITIALIZED,
+      this->net_->blob_by_name("ip2")->data()->head());
+  EXPECT_EQ(loss[0], loss[1]);
+  ASSERT_EQ(param_diffs[0].size(), param_diffs[1].size());
+  for (int i = 0; i < param_diffs[0].size(); ++i) {
+    for (int j = 0; j < param_diffs[0][i]->count(); ++j) {
+      EXPECT_EQ(param_diffs[0][i]->cpu_diff()[j],
+          param_diffs[1][i]->cpu_diff()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestLayerMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitTinyNet();
+  this->net_->Forward();
+  this->net_->Backward();
+  const MemoryAccount::Side side = Caffe::mode() == Caffe::CPU ?
+      MemoryAccount::HOST : MemoryAccount::DEVICE;
+  const vector<shared_ptr<MemoryAccount> >& layer_memory =
+      this->net_->layer_memory();
+  ASSERT_EQ(3, layer_memory.size());
+  // The layer charged is the one first touching the memory.
+  const SyncedMemory* weights = this->net_->layers()[1]->blobs()[0]->
+      data().get();
+  const Blob<Dtype>* innerproduct =
+      this->net_->blob_by_name("innerproduct").get();
+  EXPECT_EQ(layer_memory[1].get(), side == MemoryAccount::HOST ?
+      weights->cpu_account() : weights->gpu_account());
+  EXPECT_EQ(layer_memory[1].get(), side == MemoryAccount::HOST ?
+      innerproduct->data()->cpu_account() :
+      innerproduct->data()->gpu_account());
+  EXPECT_EQ(layer_memory[2].get(), side == MemoryAccount::HOST ?
+      innerproduct->diff()->cpu_account() :
+      innerproduct->diff()->gpu_account());
+  // The loss layer holds the gradient and the softmax probabilities.
+  const size_t innerproduct_bytes = innerproduct->count() * sizeof(Dtype);
+  EXPECT_GE(layer_memory[2]->usage(side).live, 2 * innerproduct_bytes);
+  size_t layers_live = 0;
+  for (int i = 0; i < layer_memory.size(); ++i) {
+    layers_live += layer_memory[i]->usage(side).live;
+    EXPECT_GE(layer_memory[i]->usage(side).peak,
+              layer_memory[i]->usage(side).live);
+  }
+  const MemoryUsage net_usage = this->net_->memory()->usage(side);
+  EXPECT_EQ(layers_live, net_usage.live);
+  EXPECT_GE(MemoryAccount::Global()->usage(side).live, net_usage.live);
+  // Freeing the net refunds its memory.
+  const size_t global_live = MemoryAccount::Global()->usage(side).live;
+  this->net_.reset();
+  EXPECT_EQ(global_live - net_usage.live,
+            MemoryAccount::Global()->usage(side).live);
+}
+
+TYPED_TEST(NetTest, TestReserve) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitReshapableNet();
+  Blob<Dtype>* input_blob = this->net_->input_blobs()[0];
+  vector<int> shape = input_blob->shape();
+  vector<int> max_shape = shape;
+  max_shape[0] = 4;
+  this->net_->Reserve(vector<vector<int> >(1, max_shape));
+  // The shapes are restored and every blob is allocated for the maximum.
+  EXPECT_EQ(shape, input_blob->shape());
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = this->net_->blobs();
+  vector<const SyncedMemory*> data;
+  for (int i = 0; i < blobs.size(); ++i) {
+    EXPECT_EQ(4 * blobs[i]->count(), blobs[i]->capacity());
+    EXPECT_NE(SyncedMemory::UNINITIALIZED, blobs[i]->data()->head());
+    data.push_back(blobs[i]->data().get());
+  }
+  // Inputs up to the maximum reuse the memory.
+  for (int num = 4; num > 0; --num) {
+    shape[0] = num;
+    input_blob->Reshape(shape);
+    this->net_->Forward();
+    for (int i = 0; i < blobs.size(); ++i) {
+      EXPECT_EQ(data[i], blobs[i]->data().get());
+    }
+  }
+  Blob<Dtype> input, output;
+  input.CopyFrom(*input_blob, false, true);
+  output.CopyFrom(*this->net_->output_blobs()[0], false, true);
+  // Releasing frees the memory and the capacity beyond the current shapes.
+  this->net_->ReleaseBlobs();
+  for (int i = 0; i < blobs.size(); ++i) {
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED, blobs[i]->data()->head());
+    EXPECT_EQ(blobs[i]->count(), blobs[i]->capacity());
+  }
+  input_blob->CopyFrom(input);
+  const Blob<Dtype>* output_blob = this->net_->Forward()[0];
+  ASSERT_EQ(output.shape(), output_blob->shape());
+  for (int i = 0; i < output.count(); ++i) {
+    EXPECT_EQ(output.cpu_data()[i], output_blob->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestReshapeLayerAfterRelease) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "name: 'ReshapeAfterRelease' "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 } } } "
+      "layer { name: 'flat' type: 'Reshape' bottom: 'data' top: 'flat' "
+      "  reshape_param { shape { dim: 6 } } } "
+      "layer { name: 'double' type: 'Power' bottom: 'flat' top: 'out' "
+      "  power_param { scale: 2 } } ";
+  this->InitNetFromProtoString(proto);
+  Blob<Dtype>* data = this->net_->blob_by_name("data").get();
+  const Blob<Dtype>* out = this->net_->blob_by_name("out").get();
+  for (int pass = 0; pass < 2; ++pass) {
+    // Releasing replaces the memory the Reshape layer shares, so its top
+    // must be shared again although no shape changed.
+    this->net_->ReleaseBlobs();
+    for (int i = 0; i < data->count(); ++i) {
+      data->mutable_cpu_data()[i] = i + pass;
+    }
+    this->net_->Forward();
+    ASSERT_EQ(6, out->count());
+    for (int i = 0; i < out->count(); ++i) {
+      EXPECT_EQ(2 * (i + pass), out->cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestConcatRanges) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitConcatNet();
+  this->CheckConcatNet(2);
+  // On the CPU the concatenated and sliced blobs are ranges of one blob.
+  if (Caffe::mode() == Caffe::CPU) {
+    const Blob<Dtype>* ab = this->net_->blob_by_name("ab").get();
+    EXPECT_EQ(ab->cpu_data(), this->net_->blob_by_name("a2")->cpu_data());
+    EXPECT_EQ(ab->cpu_data() + 6, this->net_->blob_by_name("b2")->cpu_data());
+    EXPECT_EQ(ab->cpu_data(), this->net_->blob_by_name("s1")->cpu_data());
+    EXPECT_EQ(ab->cpu_data() + 3, this->net_->blob_by_name("s2")->cpu_data());
+    EXPECT_EQ(ab->cpu_diff() + 6, this->net_->blob_by_name("b2")->cpu_diff());
+    EXPECT_EQ(ab->cpu_diff() + 3, this->net_->blob_by_name("s2")->cpu_diff());
+  }
+  // Reshaping the inputs moves the ranges; they are copied until the net is
+  // reshaped.
+  this->CheckConcatNet(1);
+  this->CheckConcatNet(4);
+  this->net_->Reshape();
+  this->CheckConcatNet(4);
+  if (Caffe::mode() == Caffe::CPU) {
+    const Blob<Dtype>* ab = this->net_->blob_by_name("ab").get();
+    EXPECT_EQ(ab->cpu_data() + 12,
+        this->net_->blob_by_name("b2")->cpu_data());
+  }
+}
+
 }  // namespace caffe
@@ -141,6 +141,11 @@ class NeuronLayerTest : public MultiDeviceTest<TypeParam> {
     GaussianFiller<Dtype> filler(filler_param);
     filler.Fill(this->blob_bottom_);
     Dtype* bottom_data = this->blob_bottom_->mutable_cpu_data();
+    // Keep away from zero, where the finite differences of the gradient
+    // check are too coarse for log.
+    for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+      bottom_data[i] = std::max(bottom_data[i], Dtype(-2));
+    }
     caffe_exp(this->blob_bottom_->count(), bottom_data, bottom_data);
   }
 
@@ -220,6 +225,48 @@ TYPED_TEST(NeuronLayerTest, TestReLU) {
   }
 }
 
+// A ReLULayer counting the calls to Reshape.
+template <typename Dtype>
+class ReshapeCountingReLULayer : public ReLULayer<Dtype> {
+ public:
+  explicit ReshapeCountingReLULayer(const LayerParameter& param)
+      : ReLULayer<Dtype>(param), num_reshapes_(0) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    ++num_reshapes_;
+    ReLULayer<Dtype>::Reshape(bottom, top);
+  }
+  int num_reshapes_;
+};
+
+TYPED_TEST(NeuronLayerTest, TestReshapeOnlyOnShapeChange) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ReshapeCountingReLULayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(1, layer.num_reshapes_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2, layer.num_reshapes_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2, layer.num_reshapes_);
+  // Reshaping to the same shape is not a change.
+  this->blob_bottom_->Reshape(2, 3, 4, 5);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2, layer.num_reshapes_);
+  this->blob_bottom_->Reshape(1, 3, 4, 5);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(3, layer.num_reshapes_);
+  EXPECT_EQ(this->blob_bottom_->shape(), this->blob_top_->shape());
+  // A top reshaped elsewhere is reshaped back.
+  this->blob_top_->Reshape(4, 5, 6, 7);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(4, layer.num_reshapes_);
+  EXPECT_EQ(this->blob_bottom_->shape(), this->blob_top_->shape());
+  // So are different blobs.
+  layer.Forward(this->blob_bottom_vec_, this->blob_bottom_vec_);
+  EXPECT_EQ(5, layer.num_reshapes_);
+}
+
 TYPED_TEST(NeuronLayerTest, TestReLUGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cfloat>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -609,6 +611,87 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestForwardWide) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Wide enough for the blocks of columns of the CPU, with clipped windows.
+  const int height = 9;
+  const int width = 45;
+  this->blob_bottom_->Reshape(2, 3, height, width);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  const int kernels[][2] = {{2, 2}, {3, 3}, {3, 3}, {3, 3}, {2, 3}};
+  const int strides[][2] = {{2, 2}, {2, 2}, {1, 1}, {1, 1}, {1, 2}};
+  const int pads[] = {0, 1, 1, 0, 1};
+  const PoolingParameter_PoolMethod pools[] = {
+      PoolingParameter_PoolMethod_MAX, PoolingParameter_PoolMethod_AVE};
+  const Phase phases[] = {TRAIN, TEST};
+  for (int config = 0; config < 5; ++config) {
+    for (int i = 0; i < 4; ++i) {
+      LayerParameter layer_param;
+      layer_param.set_phase(phases[i % 2]);
+      PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+      pooling_param->set_kernel_h(kernels[config][0]);
+      pooling_param->set_kernel_w(kernels[config][1]);
+      pooling_param->set_stride_h(strides[config][0]);
+      pooling_param->set_stride_w(strides[config][1]);
+      pooling_param->set_pad(pads[config]);
+      pooling_param->set_pool(pools[i / 2]);
+      PoolingLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      const int pooled_height = this->blob_top_->height();
+      const int pooled_width = this->blob_top_->width();
+      const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+      const Dtype* top_data = this->blob_top_->cpu_data();
+      for (int plane = 0; plane < 6; ++plane) {
+        for (int ph = 0; ph < pooled_height; ++ph) {
+          for (int pw = 0; pw < pooled_width; ++pw) {
+            const int hstart = ph * strides[config][0] - pads[config];
+            const int wstart = pw * strides[config][1] - pads[config];
+            const int hend = std::min(hstart + kernels[config][0],
+                height + pads[config]);
+            const int wend = std::min(wstart + kernels[config][1],
+                width + pads[config]);
+            const int pool_size = (hend - hstart) * (wend - wstart);
+            Dtype max = -FLT_MAX;
+            Dtype sum = 0;
+            for (int h = std::max(hstart, 0); h < std::min(hend, height);
+                ++h) {
+              for (int w = std::max(wstart, 0); w < std::min(wend, width);
+                  ++w) {
+                const Dtype value = bottom_data[h * width + w];
+                max = std::max(max, value);
+                sum += value;
+              }
+            }
+            const Dtype expected = (i / 2 == 0) ? max : sum / pool_size;
+            EXPECT_NEAR(expected, top_data[ph * pooled_width + pw], 1e-5);
+          }
+        }
+        bottom_data += height * width;
+        top_data += pooled_height * pooled_width;
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestGradientMaxTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Without a mask, the maxima are found again by Backward.
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(3);
+  pooling_param->set_stride(2);
+  pooling_param->set_pad(1);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+  PoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
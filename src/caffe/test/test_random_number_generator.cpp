@@ -1,10 +1,12 @@
 #include <cmath>
+#include <vector>
 
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/philox.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -395,6 +397,58 @@ TYPED_TEST(RandomNumberGeneratorTest, TestRngBernoulliTimesBernoulli) {
   EXPECT_NEAR(true_mean, sample_p, bound);
 }
 
+TYPED_TEST(RandomNumberGeneratorTest, TestPhilox) {
+  // Known answers of Philox4x32-10 from the Random123 distribution.
+  uint32_t words[4];
+  Philox(0).Generate(0, words);
+  EXPECT_EQ(0x6627e8d5u, words[0]);
+  EXPECT_EQ(0xe169c58du, words[1]);
+  EXPECT_EQ(0xbc57ac4cu, words[2]);
+  EXPECT_EQ(0x9b00dbd8u, words[3]);
+  PhiloxStream stream(0);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(words[i], stream());
+  }
+  Philox(0).Generate(1, words);
+  EXPECT_EQ(words[0], stream());
+}
+
+TYPED_TEST(RandomNumberGeneratorTest, TestRngReproducible) {
+  TypeParam* data = static_cast<TypeParam*>(this->data_->mutable_cpu_data());
+  TypeParam* data_2 =
+      static_cast<TypeParam*>(this->data_2_->mutable_cpu_data());
+  caffe_rng_gaussian(this->sample_size_, TypeParam(0), TypeParam(1), data);
+  Caffe::set_random_seed(this->seed_);
+  caffe_rng_gaussian(this->sample_size_, TypeParam(0), TypeParam(1), data_2);
+  for (int i = 0; i < this->sample_size_; ++i) {
+    EXPECT_EQ(data[i], data_2[i]);
+  }
+  // The next draws are another stream.
+  caffe_rng_gaussian(this->sample_size_, TypeParam(0), TypeParam(1), data_2);
+  int num_equal = 0;
+  for (int i = 0; i < this->sample_size_; ++i) {
+    num_equal += (data[i] == data_2[i]);
+  }
+  EXPECT_EQ(0, num_equal);
+}
+
+TYPED_TEST(RandomNumberGeneratorTest, TestRngBernoulliBits) {
+  // Not a whole number of words.
+  const int n = this->sample_size_ - 5;
+  const TypeParam p = 0.3;
+  int* bernoulli_data =
+      static_cast<int*>(this->int_data_->mutable_cpu_data());
+  caffe_rng_bernoulli(n, p, bernoulli_data);
+  Caffe::set_random_seed(this->seed_);
+  vector<unsigned int> bits((n + 31) / 32 + 1, 0xffffffffu);
+  caffe_rng_bernoulli_bits(n, p, &bits[0]);
+  for (int i = 0; i < bits.size() * 32 - 32; ++i) {
+    const int bit = (bits[i / 32] >> (i % 32)) & 1;
+    EXPECT_EQ(i < n ? bernoulli_data[i] : 0, bit);
+  }
+  EXPECT_EQ(0xffffffffu, bits.back());
+}
+
 #ifndef CPU_ONLY
 
 TYPED_TEST(RandomNumberGeneratorTest, TestRngGaussianGPU) {
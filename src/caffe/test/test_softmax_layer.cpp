@@ -83,6 +83,38 @@ TYPED_TEST(SoftmaxLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(SoftmaxLayerTest, TestForwardLongRows) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Rows of many values with the max growing along them, and large enough
+  // to overflow exp without the max subtracted.
+  vector<int> shape(2);
+  shape[0] = 2;
+  shape[1] = 3000;
+  this->blob_bottom_->Reshape(shape);
+  Dtype* bottom_data = this->blob_bottom_->mutable_cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    bottom_data[i] = Dtype(i % shape[1]) / 4 + 100 * (i / shape[1]);
+  }
+  LayerParameter layer_param;
+  SoftmaxLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  for (int i = 0; i < shape[0]; ++i) {
+    const Dtype* row = bottom_data + i * shape[1];
+    const double max = row[shape[1] - 1];
+    double scale = 0;
+    for (int j = 0; j < shape[1]; ++j) {
+      scale += exp(row[j] - max);
+    }
+    for (int j = 0; j < shape[1]; ++j) {
+      const double expected = exp(row[j] - max) / scale;
+      EXPECT_NEAR(expected, top_data[i * shape[1] + j], 1e-4 * expected + 1e-7)
+          << "debug: " << i << " " << j;
+    }
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNSoftmaxLayerTest : public GPUDeviceTest<Dtype> {
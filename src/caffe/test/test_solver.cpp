@@ -9,6 +9,7 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/solver.hpp"
+#include "caffe/solver_factory.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -106,4 +107,152 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+
+TYPED_TEST(SolverTest, TestAsyncTest) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+     "base_lr: 0.01 "
+     "lr_policy: 'fixed' "
+     "max_iter: 4 "
+     "test_interval: 1 "
+     "test_iter: 2 "
+     "test_async: true "
+     "snapshot_after_train: false "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { "
+     "        dim: 5 "
+     "        dim: 2 "
+     "        dim: 3 "
+     "        dim: 4 "
+     "      } "
+     "      shape { "
+     "        dim: 5 "
+     "      } "
+     "      data_filler { "
+     "        type: 'gaussian' "
+     "      } "
+     "      data_filler { "
+     "        type: 'constant' "
+     "      } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'label' "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 10 "
+     "      weight_filler { "
+     "        type: 'gaussian' "
+     "      } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'SoftmaxWithLoss' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "  } "
+     "} ";
+  this->InitSolverFromProtoString(proto);
+  this->solver_->Solve();
+  // The final test evaluated a copy of the trained weights.
+  const Blob<Dtype>& weights =
+      *this->solver_->net()->layer_by_name("innerprod")->blobs()[0];
+  const Blob<Dtype>& test_weights =
+      *this->solver_->test_nets()[0]->layer_by_name("innerprod")->blobs()[0];
+  EXPECT_NE(weights.data(), test_weights.data());
+  ASSERT_EQ(weights.count(), test_weights.count());
+  for (int i = 0; i < weights.count(); ++i) {
+    EXPECT_EQ(weights.cpu_data()[i], test_weights.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(SolverTest, TestLazyRowUpdates) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The rows with gradient are tracked on the CPU only.
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  const char* types[] = {"SGD", "Adam"};
+  for (int t = 0; t < 2; ++t) {
+    shared_ptr<Solver<Dtype> > solvers[2];
+    for (int sparse = 0; sparse < 2; ++sparse) {
+      ostringstream proto;
+      proto <<
+         "type: '" << types[t] << "' "
+         "base_lr: 0.1 "
+         "lr_policy: 'fixed' "
+         "momentum: 0.9 "
+         "weight_decay: 0.1 "
+         "max_iter: 3 "
+         "random_seed: 1701 "
+         "snapshot_after_train: false "
+         "solver_mode: CPU "
+         "net_param { "
+         "  name: 'TestNetwork' "
+         "  layer { "
+         "    name: 'data' "
+         "    type: 'DummyData' "
+         "    dummy_data_param { "
+         "      shape { dim: 2 } "
+         "      shape { dim: 2 dim: 4 } "
+         "      data_filler { type: 'constant' value: 3 } "
+         "      data_filler { type: 'constant' value: 1 } "
+         "    } "
+         "    top: 'index' "
+         "    top: 'target' "
+         "  } "
+         "  layer { "
+         "    name: 'embed' "
+         "    type: 'Embed' "
+         "    embed_param { "
+         "      input_dim: 6 "
+         "      num_output: 4 "
+         "      bias_term: false "
+         "      weight_filler { type: 'gaussian' } "
+         "      sparse_gradient: " << (sparse ? "true" : "false") << " "
+         "    } "
+         "    bottom: 'index' "
+         "    top: 'embed' "
+         "  } "
+         "  layer { "
+         "    name: 'loss' "
+         "    type: 'EuclideanLoss' "
+         "    bottom: 'embed' "
+         "    bottom: 'target' "
+         "  } "
+         "} ";
+      SolverParameter param;
+      CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(),
+          &param));
+      solvers[sparse].reset(SolverRegistry<Dtype>::CreateSolver(param));
+    }
+    Blob<Dtype> initial;
+    initial.CopyFrom(*solvers[1]->net()->learnable_params()[0], false, true);
+    solvers[0]->Solve();
+    solvers[1]->Solve();
+    const Blob<Dtype>& dense = *solvers[0]->net()->learnable_params()[0];
+    const Blob<Dtype>& sparse = *solvers[1]->net()->learnable_params()[0];
+    ASSERT_EQ(24, sparse.count());
+    for (int i = 0; i < sparse.count(); ++i) {
+      if (i / 4 == 3) {
+        // The row of the input is updated in every iteration.
+        EXPECT_NE(initial.cpu_data()[i], sparse.cpu_data()[i]);
+        EXPECT_NEAR(dense.cpu_data()[i], sparse.cpu_data()[i], 1e-5);
+      } else {
+        // The other rows get no weight decay.
+        EXPECT_EQ(initial.cpu_data()[i], sparse.cpu_data()[i]);
+        EXPECT_NE(initial.cpu_data()[i], dense.cpu_data()[i]);
+      }
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,132 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/sparse_matrix.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class SparseMatrixTest : public ::testing::Test {
+ protected:
+  SparseMatrixTest()
+      : rows_(6), cols_(7), m_(5), dense_(rows_, cols_, 1, 1) {}
+
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&dense_);
+    // Zero most entries, including a whole row.
+    Dtype* data = dense_.mutable_cpu_data();
+    for (int i = 0; i < dense_.count(); ++i) {
+      if (i % 3 != 0 || i / cols_ == 2) {
+        data[i] = 0;
+      }
+    }
+    matrix_.FromDense(rows_, cols_, dense_.cpu_data());
+  }
+
+  // Fill a rows x cols matrix with Gaussian values.
+  void Fill(int rows, int cols, Blob<Dtype>* blob) {
+    blob->Reshape(rows, cols, 1, 1);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob);
+  }
+
+  void ExpectNear(const Blob<Dtype>& expected, const Dtype* actual) {
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], actual[i], 1e-5);
+    }
+  }
+
+  const int rows_;
+  const int cols_;
+  const int m_;
+  Blob<Dtype> dense_;
+  SparseMatrix<Dtype> matrix_;
+};
+
+TYPED_TEST_CASE(SparseMatrixTest, TestDtypes);
+
+TYPED_TEST(SparseMatrixTest, TestFromDense) {
+  EXPECT_EQ(this->rows_, this->matrix_.rows());
+  EXPECT_EQ(this->cols_, this->matrix_.cols());
+  int nnz = 0;
+  for (int i = 0; i < this->dense_.count(); ++i) {
+    nnz += (this->dense_.cpu_data()[i] != 0);
+  }
+  EXPECT_EQ(nnz, this->matrix_.nnz());
+}
+
+TYPED_TEST(SparseMatrixTest, TestMultiplyRows) {
+  Blob<TypeParam> b, expected;
+  this->Fill(this->cols_, this->m_, &b);
+  expected.Reshape(this->rows_, this->m_, 1, 1);
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, this->rows_,
+      this->m_, this->cols_, 1, this->dense_.cpu_data(), b.cpu_data(), 0,
+      expected.mutable_cpu_data());
+  vector<TypeParam> c(this->rows_ * this->m_, 1);
+  // In two parts, as grouped convolution does.
+  this->matrix_.MultiplyRows(0, 2, this->m_, b.cpu_data(), &c[0]);
+  this->matrix_.MultiplyRows(2, this->rows_, this->m_, b.cpu_data(),
+      &c[2 * this->m_]);
+  this->ExpectNear(expected, &c[0]);
+}
+
+TYPED_TEST(SparseMatrixTest, TestMultiplyTransposedBy) {
+  Blob<TypeParam> b, expected;
+  this->Fill(this->m_, this->cols_, &b);
+  expected.Reshape(this->m_, this->rows_, 1, 1);
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasTrans, this->m_, this->rows_,
+      this->cols_, 1, b.cpu_data(), this->dense_.cpu_data(), 0,
+      expected.mutable_cpu_data());
+  vector<TypeParam> c(this->m_ * this->rows_, 1);
+  vector<TypeParam> buffer(this->m_ * (this->rows_ + this->cols_));
+  this->matrix_.MultiplyTransposedBy(this->m_, b.cpu_data(), &c[0],
+      &buffer[0]);
+  this->ExpectNear(expected, &c[0]);
+}
+
+TYPED_TEST(SparseMatrixTest, TestMultiplyBy) {
+  Blob<TypeParam> b, expected;
+  this->Fill(this->m_, this->rows_, &b);
+  expected.Reshape(this->m_, this->cols_, 1, 1);
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, this->m_,
+      this->cols_, this->rows_, 1, b.cpu_data(), this->dense_.cpu_data(), 0,
+      expected.mutable_cpu_data());
+  vector<TypeParam> c(this->m_ * this->cols_, 1);
+  this->matrix_.MultiplyBy(this->m_, b.cpu_data(), &c[0]);
+  this->ExpectNear(expected, &c[0]);
+}
+
+TYPED_TEST(SparseMatrixTest, TestSparseWeights) {
+  SparseWeights<TypeParam> weights;
+  // Two entries out of three are zero.
+  EXPECT_TRUE(weights.Get(this->dense_, this->rows_, this->cols_, 0.5));
+  EXPECT_FALSE(weights.Get(this->dense_, this->rows_, this->cols_, 0.9));
+  EXPECT_FALSE(weights.Get(this->dense_, this->rows_, this->cols_, 1.1));
+  const SparseMatrix<TypeParam>* matrix =
+      weights.Get(this->dense_, this->rows_, this->cols_, 0.5);
+  ASSERT_TRUE(matrix);
+  EXPECT_EQ(this->matrix_.nnz(), matrix->nnz());
+  // Weights sharing memory share the sparse form.
+  Blob<TypeParam> shared(this->dense_.shape());
+  shared.ShareData(this->dense_);
+  SparseWeights<TypeParam> shared_weights;
+  EXPECT_EQ(matrix,
+      shared_weights.Get(shared, this->rows_, this->cols_, 0.5));
+  // Writing the weights rebuilds the sparse form.
+  caffe_set(this->dense_.count(), TypeParam(1),
+      this->dense_.mutable_cpu_data());
+  EXPECT_FALSE(weights.Get(this->dense_, this->rows_, this->cols_, 0.5));
+}
+
+}  // namespace caffe
@@ -980,4 +980,72 @@ TEST_F(SplitLayerInsertionTest, TestWithInPlace) {
   this->RunInsertionTest(input_proto, expected_output_proto);
 }
 
+TEST_F(SplitLayerInsertionTest, TestInsertionRecompute) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Data' "
+      "  top: 'data' "
+      "  top: 'label' "
+      "} "
+      "layer { "
+      "  name: 'innerprod1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'innerprod1' "
+      "  recompute: true "
+      "} "
+      "layer { "
+      "  name: 'innerprod2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'innerprod1' "
+      "  top: 'innerprod2' "
+      "  recompute: true "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'innerprod1' "
+      "  bottom: 'innerprod2' "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Data' "
+      "  top: 'data' "
+      "  top: 'label' "
+      "} "
+      "layer { "
+      "  name: 'innerprod1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'innerprod1' "
+      "  recompute: true "
+      "} "
+      "layer { "
+      "  name: 'innerprod1_innerprod1_0_split' "
+      "  type: 'Split' "
+      "  bottom: 'innerprod1' "
+      "  top: 'innerprod1_innerprod1_0_split_0' "
+      "  top: 'innerprod1_innerprod1_0_split_1' "
+      "  recompute: true "
+      "} "
+      "layer { "
+      "  name: 'innerprod2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'innerprod1_innerprod1_0_split_0' "
+      "  top: 'innerprod2' "
+      "  recompute: true "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'innerprod1_innerprod1_0_split_1' "
+      "  bottom: 'innerprod2' "
+      "} ";
+  this->RunInsertionTest(input_proto, expected_output_proto);
+}
+
 }  // namespace caffe
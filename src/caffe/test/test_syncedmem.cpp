@@ -122,4 +122,50 @@ TEST_F(SyncedMemoryTest, TestGPUWrite) {
 
 #endif
 
+TEST_F(SyncedMemoryTest, TestMemoryAccount) {
+  shared_ptr<MemoryAccount> parent(new MemoryAccount());
+  shared_ptr<MemoryAccount> account(new MemoryAccount(parent));
+  const MemoryUsage global = MemoryAccount::Global()->usage(
+      MemoryAccount::HOST);
+  {
+    MemoryScope scope(account.get());
+    EXPECT_EQ(account, MemoryAccount::Current());
+    SyncedMemory mem(10);
+    // Allocation is lazy.
+    EXPECT_EQ(0, account->usage(MemoryAccount::HOST).live);
+    mem.cpu_data();
+    EXPECT_EQ(account.get(), mem.cpu_account());
+    EXPECT_EQ(0, account->usage(MemoryAccount::DEVICE).live);
+    {
+      MemoryScope inner_scope(parent.get());
+      SyncedMemory other_mem(20);
+      other_mem.mutable_cpu_data();
+      EXPECT_EQ(parent.get(), other_mem.cpu_account());
+    }
+    EXPECT_EQ(account, MemoryAccount::Current());
+    MemoryUsage usage = account->usage(MemoryAccount::HOST);
+    EXPECT_EQ(10, usage.live);
+    EXPECT_EQ(10, usage.peak);
+    EXPECT_EQ(1, usage.allocations);
+    usage = parent->usage(MemoryAccount::HOST);
+    EXPECT_EQ(10, usage.live);
+    EXPECT_EQ(30, usage.peak);
+    EXPECT_EQ(30, usage.allocated);
+    EXPECT_EQ(2, usage.allocations);
+    usage = MemoryAccount::Global()->usage(MemoryAccount::HOST);
+    EXPECT_EQ(global.live + 10, usage.live);
+    EXPECT_EQ(global.allocated + 30, usage.allocated);
+    // Memory set from outside is not charged and refunds the owned memory.
+    float data[10];
+    mem.set_cpu_data(data);
+    EXPECT_FALSE(mem.cpu_account());
+    EXPECT_EQ(0, account->usage(MemoryAccount::HOST).live);
+    parent->ResetPeak();
+    EXPECT_EQ(0, parent->usage(MemoryAccount::HOST).peak);
+  }
+  EXPECT_EQ(MemoryAccount::Global(), MemoryAccount::Current());
+  EXPECT_EQ(global.live,
+      MemoryAccount::Global()->usage(MemoryAccount::HOST).live);
+}
+
 }  // namespace caffe
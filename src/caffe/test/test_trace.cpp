@@ -0,0 +1,148 @@
+#include <boost/thread.hpp>
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/trace.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class TraceTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    Trace::Disable();
+    Trace::Clear();
+  }
+
+  int CountEvents(const vector<TraceEvent>& events, const string& category,
+      const string& name) {
+    int count = 0;
+    for (int i = 0; i < events.size(); ++i) {
+      if (events[i].category == category && events[i].name == name) {
+        EXPECT_GE(events[i].duration, 0);
+        ++count;
+      }
+    }
+    return count;
+  }
+};
+
+static void RecordEvents(int num) {
+  Trace::SetThreadName("recorder");
+  for (int i = 0; i < num; ++i) {
+    TraceScope trace("test", "event " + format_int(i));
+  }
+}
+
+TEST_F(TraceTest, TestDisabled) {
+  EXPECT_FALSE(Trace::enabled());
+  { TraceScope trace("test", "disabled"); }
+  vector<TraceEvent> events;
+  Trace::Events(&events);
+  EXPECT_EQ(0, CountEvents(events, "test", "disabled"));
+}
+
+TEST_F(TraceTest, TestRingBuffer) {
+  // Record from a new thread, whose buffer takes the capacity below.
+  Trace::Enable(4);
+  boost::thread recorder(&RecordEvents, 10);
+  recorder.join();
+  vector<TraceEvent> events;
+  Trace::Events(&events);
+  ASSERT_EQ(4, events.size());
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ("event " + format_int(6 + i), events[i].name);
+    EXPECT_EQ(events[0].thread, events[i].thread);
+    if (i > 0) {
+      EXPECT_LE(events[i - 1].start, events[i].start);
+    }
+  }
+  Trace::Clear();
+  Trace::Events(&events);
+  EXPECT_EQ(0, events.size());
+}
+
+TEST_F(TraceTest, TestNet) {
+  const string proto =
+      "name: 'TraceNet' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'DummyData' "
+      "  dummy_data_param { "
+      "    shape { dim: 2 dim: 3 } "
+      "    shape { dim: 2 dim: 4 } "
+      "    data_filler { type: 'gaussian' } "
+      "  } "
+      "  top: 'data' "
+      "  top: 'target' "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 4 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'ip' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'ip' "
+      "  bottom: 'target' "
+      "  top: 'loss' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<float> net(param);
+  Trace::Enable();
+  net.Forward();
+  net.Backward();
+  Trace::Disable();
+  net.Forward();
+  vector<TraceEvent> events;
+  Trace::Events(&events);
+  EXPECT_EQ(1, CountEvents(events, "forward", "data"));
+  EXPECT_EQ(1, CountEvents(events, "forward", "ip"));
+  EXPECT_EQ(1, CountEvents(events, "forward", "loss"));
+  EXPECT_EQ(0, CountEvents(events, "backward", "data"));
+  EXPECT_EQ(1, CountEvents(events, "backward", "ip"));
+  EXPECT_EQ(1, CountEvents(events, "backward", "loss"));
+
+  string filename;
+  MakeTempFilename(&filename);
+  Trace::WriteChromeTrace(filename);
+  std::ifstream file(filename.c_str());
+  std::stringstream contents;
+  contents << file.rdbuf();
+  const string trace = contents.str();
+  EXPECT_EQ(0, trace.find("{\"traceEvents\": ["));
+  EXPECT_NE(string::npos, trace.find(
+      "{\"name\": \"ip\", \"cat\": \"backward\", \"ph\": \"X\""));
+}
+
+TEST_F(TraceTest, TestEscaping) {
+  Trace::Enable();
+  { TraceScope trace("test", "\"quoted\"\\\tline\n"); }
+  string filename;
+  MakeTempFilename(&filename);
+  Trace::WriteChromeTrace(filename);
+  std::ifstream file(filename.c_str());
+  std::stringstream contents;
+  contents << file.rdbuf();
+  EXPECT_NE(string::npos, contents.str().find(
+      "{\"name\": \"\\\"quoted\\\"\\\\\\u0009line\\u000a\", "));
+}
+
+}  // namespace caffe
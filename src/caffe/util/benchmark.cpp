@@ -1,5 +1,8 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <algorithm>
+#include <string>
+
 #include "caffe/common.hpp"
 #include "caffe/util/benchmark.hpp"
 
@@ -165,4 +168,90 @@ float CPUTimer::MicroSeconds() {
   return this->elapsed_microseconds_;
 }
 
+// Bucket 0 holds durations below 1us, bucket b > 0 holds durations in
+// [2^((b - 1) / 8), 2^(b / 8)), the last one everything above ~2^40us.
+static const int kBucketsPerOctave = 8;
+static const int kNumBuckets = 40 * kBucketsPerOctave + 2;
+
+LatencyHistogram::LatencyHistogram()
+    : buckets_(kNumBuckets, 0) {
+  Clear();
+}
+
+int LatencyHistogram::Bucket(float microseconds) {
+  if (microseconds < 1) {
+    return 0;
+  }
+  const int bucket = 1 + static_cast<int>(
+      std::floor(kBucketsPerOctave * std::log(microseconds) / std::log(2.)));
+  return std::min(bucket, kNumBuckets - 1);
+}
+
+float LatencyHistogram::BucketUpperBound(int bucket) {
+  return std::pow(2., static_cast<double>(bucket) / kBucketsPerOctave);
+}
+
+void LatencyHistogram::Add(float microseconds) {
+  ++buckets_[Bucket(microseconds)];
+  min_ = count_ ? std::min(min_, microseconds) : microseconds;
+  max_ = count_ ? std::max(max_, microseconds) : microseconds;
+  sum_ += microseconds;
+  ++count_;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  if (!other.count_) {
+    return;
+  }
+  for (int i = 0; i < kNumBuckets; ++i) {
+    buckets_[i] += other.buckets_[i];
+  }
+  min_ = count_ ? std::min(min_, other.min_) : other.min_;
+  max_ = count_ ? std::max(max_, other.max_) : other.max_;
+  sum_ += other.sum_;
+  count_ += other.count_;
+}
+
+void LatencyHistogram::Clear() {
+  std::fill(buckets_.begin(), buckets_.end(), 0);
+  count_ = 0;
+  sum_ = 0;
+  min_ = 0;
+  max_ = 0;
+}
+
+float LatencyHistogram::Mean() const {
+  return count_ ? sum_ / count_ : 0;
+}
+
+float LatencyHistogram::Percentile(float p) const {
+  CHECK_GE(p, 0);
+  CHECK_LE(p, 100);
+  if (!count_) {
+    return 0;
+  } else if (p == 0) {
+    return min_;
+  }
+  // Rank of the sample at the percentile, 1-based.
+  const int64_t rank = std::max<int64_t>(1,
+      static_cast<int64_t>(std::ceil(p / 100 * count_)));
+  int64_t seen = 0;
+  int bucket = 0;
+  for (; bucket < kNumBuckets - 1; ++bucket) {
+    seen += buckets_[bucket];
+    if (seen >= rank) {
+      break;
+    }
+  }
+  return std::max(min_, std::min(max_, BucketUpperBound(bucket)));
+}
+
+string LatencyHistogram::ToString() const {
+  ostringstream stream;
+  stream << "count " << count_ << ", mean " << Mean() << " us, p50 "
+      << Percentile(50) << " us, p95 " << Percentile(95) << " us, p99 "
+      << Percentile(99) << " us, max " << max_ << " us";
+  return stream.str();
+}
+
 }  // namespace caffe
@@ -0,0 +1,311 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "caffe/util/blob_compression.hpp"
+
+namespace caffe {
+
+namespace {
+
+int VarintSize(uint32_t value) {
+  int size = 1;
+  while (value >= 128) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+// The number of rows a blob proto is viewed as: its first axis, or one row
+// for blobs with fewer than two axes.
+int ProtoRows(const BlobProto& proto) {
+  if (proto.has_num() || proto.has_channels() ||
+      proto.has_height() || proto.has_width()) {
+    return proto.num();
+  }
+  return proto.shape().dim_size() > 1 ? proto.shape().dim(0) : 1;
+}
+
+int ProtoCount(const BlobProto& proto) {
+  if (proto.has_num() || proto.has_channels() ||
+      proto.has_height() || proto.has_width()) {
+    return proto.num() * proto.channels() * proto.height() * proto.width();
+  }
+  int count = 1;
+  for (int i = 0; i < proto.shape().dim_size(); ++i) {
+    count *= proto.shape().dim(i);
+  }
+  return count;
+}
+
+// Packs codes of code_bits bits from the lowest bit of the first byte.
+string PackCodes(const vector<int>& codes, int code_bits) {
+  string packed((static_cast<uint64_t>(codes.size()) * code_bits + 7) / 8,
+      '\0');
+  uint64_t bit = 0;
+  for (int i = 0; i < codes.size(); ++i, bit += code_bits) {
+    const uint32_t code = static_cast<uint32_t>(codes[i]) << (bit & 7);
+    packed[bit >> 3] |= static_cast<char>(code & 0xff);
+    if ((bit & 7) + code_bits > 8) {
+      packed[(bit >> 3) + 1] |= static_cast<char>(code >> 8);
+    }
+  }
+  return packed;
+}
+
+// Reads the stored values of a CompressedBlob, quantized or not.
+class StoredValues {
+ public:
+  StoredValues(const CompressedBlob& compressed, int num_values)
+      : values_(compressed.value().data()),
+        double_values_(compressed.double_value_size() > 0 ?
+            compressed.double_value().data() : NULL),
+        codebook_(compressed.codebook().data()),
+        code_(reinterpret_cast<const uint8_t*>(compressed.code().data())),
+        code_size_(compressed.code().size()),
+        code_bits_(compressed.code_bits()),
+        mask_((1 << code_bits_) - 1) {
+    if (compressed.codebook_size() > 0) {
+      CHECK(code_bits_ >= 1 && code_bits_ <= 8)
+          << "Unsupported code size " << code_bits_;
+      CHECK_GE(static_cast<uint64_t>(code_size_) * 8,
+          static_cast<uint64_t>(num_values) * code_bits_)
+          << "Truncated compressed blob";
+      CHECK_LE(compressed.codebook_size(), 1 << code_bits_);
+      // Codes past the codebook read as its last value.
+      padded_codebook_.assign(codebook_,
+          codebook_ + compressed.codebook_size());
+      padded_codebook_.resize(1 << code_bits_, padded_codebook_.back());
+      codebook_ = &padded_codebook_[0];
+    } else {
+      CHECK_EQ(double_values_ ? compressed.double_value_size() :
+          compressed.value_size(), num_values) << "Truncated compressed blob";
+      codebook_ = NULL;
+    }
+  }
+
+  inline double operator[](int i) const {
+    if (!codebook_) {
+      return double_values_ ? double_values_[i] : values_[i];
+    }
+    const uint64_t bit = static_cast<uint64_t>(i) * code_bits_;
+    const size_t byte = bit >> 3;
+    uint32_t word = code_[byte];
+    if (byte + 1 < code_size_) {
+      word |= static_cast<uint32_t>(code_[byte + 1]) << 8;
+    }
+    return codebook_[(word >> (bit & 7)) & mask_];
+  }
+
+ private:
+  const float* values_;
+  const double* double_values_;
+  const float* codebook_;
+  vector<float> padded_codebook_;
+  const uint8_t* code_;
+  size_t code_size_;
+  int code_bits_;
+  uint32_t mask_;
+};
+
+}  // namespace
+
+void QuantizeValues(const vector<float>& values, int num_codes,
+    int iterations, vector<float>* codebook, vector<int>* codes) {
+  CHECK_GT(num_codes, 0);
+  codebook->clear();
+  codes->assign(values.size(), 0);
+  if (values.empty()) {
+    return;
+  }
+  const float min_value = *std::min_element(values.begin(), values.end());
+  const float max_value = *std::max_element(values.begin(), values.end());
+  num_codes = std::min<size_t>(num_codes, values.size());
+  for (int i = 0; i < num_codes; ++i) {
+    codebook->push_back(num_codes == 1 ? min_value :
+        min_value + (max_value - min_value) * i / (num_codes - 1));
+  }
+  vector<float> boundaries(num_codes - 1);
+  vector<double> sums(num_codes);
+  vector<int> counts(num_codes);
+  for (int iter = 0; iter <= iterations; ++iter) {
+    // Assign each value to the nearest code; clusters are intervals.
+    for (int i = 0; i < boundaries.size(); ++i) {
+      boundaries[i] = ((*codebook)[i] + (*codebook)[i + 1]) / 2;
+    }
+    std::fill(sums.begin(), sums.end(), 0);
+    std::fill(counts.begin(), counts.end(), 0);
+    for (int i = 0; i < values.size(); ++i) {
+      const int code = std::upper_bound(boundaries.begin(), boundaries.end(),
+          values[i]) - boundaries.begin();
+      (*codes)[i] = code;
+      sums[code] += values[i];
+      ++counts[code];
+    }
+    if (iter == iterations) {
+      break;
+    }
+    // Move each code to the mean of its values; empty ones stay put.
+    for (int i = 0; i < num_codes; ++i) {
+      if (counts[i] > 0) {
+        (*codebook)[i] = sums[i] / counts[i];
+      }
+    }
+    std::sort(codebook->begin(), codebook->end());
+  }
+}
+
+void CompressBlobProto(const CompressionParameter& param, BlobProto* proto) {
+  const int code_bits = param.quantization_bits();
+  CHECK_LE(code_bits, 8) << "At most 8 quantization bits are supported.";
+  const bool is_double = proto->double_data_size() > 0;
+  const int count = is_double ? proto->double_data_size() : proto->data_size();
+  const int rows = ProtoRows(*proto);
+  if (count == 0 || rows <= 0 || count % rows != 0) {
+    return;
+  }
+  const int cols = count / rows;
+  vector<double> values(count);
+  for (int i = 0; i < count; ++i) {
+    values[i] = is_double ? proto->double_data(i) : proto->data(i);
+  }
+
+  // Index the nonzero values, to see whether storing them alone is smaller.
+  CompressedBlob sparse;
+  vector<double> nonzero_values;
+  size_t index_bytes = 0;
+  for (int r = 0; r < rows; ++r) {
+    sparse.add_row_start(nonzero_values.size());
+    index_bytes += VarintSize(nonzero_values.size());
+    int last_col = -1;
+    for (int c = 0; c < cols; ++c) {
+      const double value = values[r * cols + c];
+      if (value != 0) {
+        sparse.add_column_delta(c - last_col - 1);
+        index_bytes += VarintSize(c - last_col - 1);
+        nonzero_values.push_back(value);
+        last_col = c;
+      }
+    }
+  }
+  sparse.add_row_start(nonzero_values.size());
+  const size_t dtype_bytes = is_double ? sizeof(double) : sizeof(float);
+  const double value_bytes = code_bits > 0 ? code_bits / 8. : dtype_bytes;
+  CompressedBlob compressed;
+  if (index_bytes + nonzero_values.size() * value_bytes <
+      count * value_bytes) {
+    compressed.Swap(&sparse);
+    values.swap(nonzero_values);
+  } else if (code_bits == 0) {
+    return;
+  }
+
+  if (code_bits > 0) {
+    const vector<float> float_values(values.begin(), values.end());
+    vector<float> codebook;
+    vector<int> codes;
+    QuantizeValues(float_values, 1 << code_bits,
+        param.quantization_iterations(), &codebook, &codes);
+    for (int i = 0; i < codebook.size(); ++i) {
+      compressed.add_codebook(codebook[i]);
+    }
+    compressed.set_code_bits(code_bits);
+    compressed.set_code(PackCodes(codes, code_bits));
+  } else if (is_double) {
+    for (int i = 0; i < values.size(); ++i) {
+      compressed.add_double_value(values[i]);
+    }
+  } else {
+    for (int i = 0; i < values.size(); ++i) {
+      compressed.add_value(values[i]);
+    }
+  }
+  if (static_cast<size_t>(compressed.ByteSize()) >= count * dtype_bytes) {
+    return;
+  }
+  proto->clear_data();
+  proto->clear_double_data();
+  proto->mutable_compressed_data()->Swap(&compressed);
+}
+
+void CompressNetParameter(const CompressionParameter& param,
+    NetParameter* net_param) {
+  for (int i = 0; i < net_param->layer_size(); ++i) {
+    LayerParameter* layer = net_param->mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      CompressBlobProto(param, layer->mutable_blobs(j));
+    }
+  }
+}
+
+void DecompressNetParameter(NetParameter* net_param) {
+  for (int i = 0; i < net_param->layer_size(); ++i) {
+    LayerParameter* layer = net_param->mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      BlobProto* blob = layer->mutable_blobs(j);
+      if (!blob->has_compressed_data()) {
+        continue;
+      }
+      vector<double> values(ProtoCount(*blob));
+      if (!values.empty()) {
+        DecompressBlobData(blob->compressed_data(), values.size(), &values[0]);
+      }
+      const bool is_double = blob->compressed_data().double_value_size() > 0;
+      blob->clear_compressed_data();
+      for (int k = 0; k < values.size(); ++k) {
+        if (is_double) {
+          blob->add_double_data(values[k]);
+        } else {
+          blob->add_data(values[k]);
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DecompressBlobData(const CompressedBlob& compressed, int count,
+    Dtype* data) {
+  const int num_rows = compressed.row_start_size() - 1;
+  if (num_rows < 0) {
+    StoredValues values(compressed, count);
+    for (int i = 0; i < count; ++i) {
+      data[i] = values[i];
+    }
+    return;
+  }
+  CHECK(num_rows > 0 && count % num_rows == 0)
+      << "Compressed blob rows do not match its count";
+  const int cols = count / num_rows;
+  const uint32_t* row_start = compressed.row_start().data();
+  const uint32_t* column_delta = compressed.column_delta().data();
+  const int num_values = row_start[num_rows];
+  CHECK_EQ(compressed.column_delta_size(), num_values)
+      << "Truncated compressed blob";
+  StoredValues values(compressed, num_values);
+  std::fill(data, data + count, Dtype(0));
+  for (int r = 0; r < num_rows; ++r) {
+    CHECK_LE(row_start[r], row_start[r + 1]);
+    Dtype* row = data + static_cast<size_t>(r) * cols;
+    int64_t col = -1;
+    for (int i = row_start[r]; i < row_start[r + 1]; ++i) {
+      col += column_delta[i] + 1;
+      CHECK_LT(col, cols) << "Compressed blob column out of range";
+      row[col] = values[i];
+    }
+  }
+}
+
+template void DecompressBlobData<float>(const CompressedBlob& compressed,
+    int count, float* data);
+template void DecompressBlobData<double>(const CompressedBlob& compressed,
+    int count, double* data);
+template void DecompressBlobData<int>(const CompressedBlob& compressed,
+    int count, int* data);
+template void DecompressBlobData<unsigned int>(
+    const CompressedBlob& compressed, int count, unsigned int* data);
+
+}  // namespace caffe
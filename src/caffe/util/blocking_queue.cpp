@@ -2,6 +2,7 @@
 #include <string>
 
 #include "caffe/data_reader.hpp"
+#include "caffe/inference_engine.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/util/blocking_queue.hpp"
@@ -41,6 +42,26 @@ bool BlockingQueue<T>::try_pop(T* t) {
   return true;
 }
 
+template<typename T>
+bool BlockingQueue<T>::try_pop(T* t, int timeout_us) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  const boost::system_time deadline = boost::get_system_time()
+      + boost::posix_time::microseconds(timeout_us);
+
+  while (queue_.empty()) {
+    if (!sync_->condition_.timed_wait(lock, deadline)) {
+      if (queue_.empty()) {
+        return false;
+      }
+      break;
+    }
+  }
+
+  *t = queue_.front();
+  queue_.pop();
+  return true;
+}
+
 template<typename T>
 T BlockingQueue<T>::pop(const string& log_on_wait) {
   boost::mutex::scoped_lock lock(sync_->mutex_);
@@ -86,11 +107,14 @@ size_t BlockingQueue<T>::size() const {
   return queue_.size();
 }
 
+template class BlockingQueue<int>;
 template class BlockingQueue<Batch<float>*>;
 template class BlockingQueue<Batch<double>*>;
 template class BlockingQueue<Datum*>;
 template class BlockingQueue<shared_ptr<DataReader::QueuePair> >;
 template class BlockingQueue<P2PSync<float>*>;
 template class BlockingQueue<P2PSync<double>*>;
+template class BlockingQueue<InferenceEngine<float>::Request*>;
+template class BlockingQueue<InferenceEngine<double>::Request*>;
 
 }  // namespace caffe
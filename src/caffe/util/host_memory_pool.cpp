@@ -0,0 +1,126 @@
+#include <boost/thread.hpp>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "caffe/util/host_memory_pool.hpp"
+
+namespace caffe {
+
+const size_t HostMemoryPool::kAlignment;
+const size_t HostMemoryPool::kHugePageSize;
+const size_t HostMemoryPool::kHugePageThreshold;
+const size_t HostMemoryPool::kDefaultMaxCached;
+
+HostMemoryPool& HostMemoryPool::Get() {
+  // Never destroyed, as blocks may be freed during static destruction.
+  static HostMemoryPool* pool = new HostMemoryPool();
+  return *pool;
+}
+
+HostMemoryPool::HostMemoryPool()
+    : mutex_(new boost::mutex()),
+      max_cached_(kDefaultMaxCached) {}
+
+size_t HostMemoryPool::SizeClass(size_t size) {
+  if (size <= kAlignment) {
+    return kAlignment;
+  }
+  // Round up to a quarter of the power of two just below size.
+  size_t octave = kAlignment;
+  while (octave * 2 < size) {
+    octave *= 2;
+  }
+  const size_t step = std::max(octave / 4, kAlignment);
+  return (size + step - 1) / step * step;
+}
+
+void* HostMemoryPool::Allocate(size_t size) {
+  const size_t block_size = SizeClass(size);
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    ++stats_.allocations;
+    stats_.in_use += block_size;
+    std::map<size_t, std::vector<void*> >::iterator blocks =
+        free_blocks_.find(block_size);
+    if (blocks != free_blocks_.end() && !blocks->second.empty()) {
+      void* ptr = blocks->second.back();
+      blocks->second.pop_back();
+      stats_.cached -= block_size;
+      ++stats_.hits;
+      return ptr;
+    }
+    ++stats_.system_allocations;
+    stats_.peak = std::max(stats_.peak, stats_.in_use + stats_.cached);
+  }
+  const bool huge = block_size >= kHugePageThreshold;
+  void* ptr = NULL;
+  const int error = posix_memalign(&ptr, huge ? kHugePageSize : kAlignment,
+      block_size);
+  CHECK_EQ(error, 0) << "host allocation of size " << block_size
+      << " failed";
+#ifdef MADV_HUGEPAGE
+  if (huge) {
+    // Only a hint; the kernel may not support transparent huge pages.
+    madvise(ptr, block_size, MADV_HUGEPAGE);
+  }
+#endif
+  return ptr;
+}
+
+void HostMemoryPool::Free(void* ptr, size_t size) {
+  const size_t block_size = SizeClass(size);
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    stats_.in_use -= block_size;
+    if (stats_.cached + block_size <= max_cached_) {
+      free_blocks_[block_size].push_back(ptr);
+      stats_.cached += block_size;
+      return;
+    }
+  }
+  free(ptr);
+}
+
+void HostMemoryPool::Trim() {
+  std::map<size_t, std::vector<void*> > blocks;
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    blocks.swap(free_blocks_);
+    stats_.cached = 0;
+  }
+  for (std::map<size_t, std::vector<void*> >::iterator it = blocks.begin();
+       it != blocks.end(); ++it) {
+    for (int i = 0; i < it->second.size(); ++i) {
+      free(it->second[i]);
+    }
+  }
+}
+
+HostMemoryPool::Stats HostMemoryPool::stats() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return stats_;
+}
+
+size_t HostMemoryPool::max_cached() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return max_cached_;
+}
+
+void HostMemoryPool::set_max_cached(size_t bytes) {
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    max_cached_ = bytes;
+    if (stats_.cached <= max_cached_) {
+      return;
+    }
+  }
+  Trim();
+}
+
+}  // namespace caffe
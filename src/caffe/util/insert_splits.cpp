@@ -78,6 +78,10 @@ void InsertSplits(const NetParameter& param, NetParameter* param_split) {
         const float loss_weight = top_idx_to_loss_weight[top_idx];
         ConfigureSplitLayer(layer_name, blob_name, j, split_count,
             loss_weight, split_layer_param);
+        // Keep the split inside the recompute segment of its producer.
+        if (layer_param->recompute()) {
+          split_layer_param->set_recompute(true);
+        }
         if (loss_weight) {
           layer_param->clear_loss_weight();
           top_idx_to_bottom_split_idx[top_idx]++;
@@ -23,6 +23,7 @@ const int kProtoReadBytesLimit = INT_MAX;  // Max size of 2 GB minus 1 byte.
 
 namespace caffe {
 
+using google::protobuf::io::ArrayInputStream;
 using google::protobuf::io::FileInputStream;
 using google::protobuf::io::FileOutputStream;
 using google::protobuf::io::ZeroCopyInputStream;
@@ -64,6 +65,14 @@ bool ReadProtoFromBinaryFile(const char* filename, Message* proto) {
   return success;
 }
 
+bool ReadProtoFromBinaryArray(const char* data, size_t size, Message* proto) {
+  CHECK_LE(size, static_cast<size_t>(kProtoReadBytesLimit));
+  ArrayInputStream raw_input(data, size);
+  CodedInputStream coded_input(&raw_input);
+  coded_input.SetTotalBytesLimit(kProtoReadBytesLimit, 536870912);
+  return proto->ParseFromCodedStream(&coded_input);
+}
+
 void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   fstream output(filename, ios::out | ios::trunc | ios::binary);
   CHECK(proto.SerializeToOstream(&output));
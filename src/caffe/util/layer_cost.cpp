@@ -0,0 +1,123 @@
+#include <string>
+#include <vector>
+
+#include "caffe/util/layer_cost.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+static int64_t TotalCount(const vector<Blob<Dtype>*>& blobs) {
+  int64_t count = 0;
+  for (int i = 0; i < blobs.size(); ++i) {
+    count += blobs[i]->count();
+  }
+  return count;
+}
+
+template <typename Dtype>
+static int64_t TotalCount(const vector<shared_ptr<Blob<Dtype> > >& blobs) {
+  int64_t count = 0;
+  for (int i = 0; i < blobs.size(); ++i) {
+    count += blobs[i]->count();
+  }
+  return count;
+}
+
+// Number of input elements combined into each pooled output.
+static int64_t PoolingWindow(const PoolingParameter& param, int height,
+    int width) {
+  if (param.global_pooling()) {
+    return static_cast<int64_t>(height) * width;
+  }
+  const int kernel_h = param.has_kernel_size() ?
+      param.kernel_size() : param.kernel_h();
+  const int kernel_w = param.has_kernel_size() ?
+      param.kernel_size() : param.kernel_w();
+  return static_cast<int64_t>(kernel_h) * kernel_w;
+}
+
+template <typename Dtype>
+LayerCost EstimateLayerCost(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const string type = layer->type();
+  const LayerParameter& param = layer->layer_param();
+  const int64_t bottom_count = TotalCount(bottom);
+  const int64_t top_count = TotalCount(top);
+  const int64_t param_count = TotalCount(layer->blobs());
+  LayerCost cost;
+  // Layers sharing their bottom data with their top move nothing.
+  if (type == "Split" || type == "Reshape" || type == "Flatten" ||
+      type == "Silence") {
+    return cost;
+  }
+  // Forward reads the bottoms and params and writes the tops, backward
+  // reads the top diffs and the bottoms and writes the bottom and param
+  // diffs.
+  cost.forward_bytes = sizeof(Dtype) * (bottom_count + param_count + top_count);
+  cost.backward_bytes =
+      sizeof(Dtype) * (top_count + 2 * bottom_count + 2 * param_count);
+  if (type == "Convolution") {
+    // Every output is a dot product over one group's inputs in the window.
+    const int64_t flops = 2 * top_count * layer->blobs()[0]->count(1);
+    cost.forward_flops = flops + (layer->blobs().size() > 1 ? top_count : 0);
+    cost.backward_flops = 2 * flops + top_count;
+  } else if (type == "Deconvolution") {
+    // Every input is scattered over one group's outputs in the window.
+    const int64_t flops = 2 * bottom_count * layer->blobs()[0]->count(1);
+    cost.forward_flops = flops + (layer->blobs().size() > 1 ? top_count : 0);
+    cost.backward_flops = 2 * flops + top_count;
+  } else if (type == "InnerProduct") {
+    const int num_output = param.inner_product_param().num_output();
+    const int64_t flops =
+        2 * top_count * (layer->blobs()[0]->count() / num_output);
+    cost.forward_flops = flops + (layer->blobs().size() > 1 ? top_count : 0);
+    cost.backward_flops = 2 * flops + top_count;
+  } else if (type == "Pooling") {
+    const int64_t window = PoolingWindow(param.pooling_param(),
+        bottom[0]->height(), bottom[0]->width());
+    cost.forward_flops = top[0]->count() * window;
+    cost.backward_flops = top[0]->count() * window;
+  } else if (type == "LRN") {
+    const LRNParameter& lrn_param = param.lrn_param();
+    const int64_t size = lrn_param.local_size();
+    const int64_t window =
+        lrn_param.norm_region() == LRNParameter_NormRegion_WITHIN_CHANNEL ?
+        size * size : size;
+    // Sum of squares over the window, then scale and power.
+    cost.forward_flops = bottom_count * (2 * window + 3);
+    cost.backward_flops = 2 * cost.forward_flops;
+  } else if (type == "Softmax" || type == "SoftmaxWithLoss") {
+    // Max, subtract and exponentiate, sum, divide.
+    cost.forward_flops = 5 * bottom[0]->count();
+    cost.backward_flops = 3 * bottom[0]->count();
+  } else if (type == "BatchNorm") {
+    // Subtract the mean and divide by the deviation, plus computing both
+    // when not using the global statistics.
+    const bool global_stats = param.batch_norm_param().has_use_global_stats()
+        ? param.batch_norm_param().use_global_stats() : param.phase() == TEST;
+    cost.forward_flops = (global_stats ? 2 : 6) * bottom_count;
+    cost.backward_flops = 6 * bottom_count;
+  } else if (type == "Eltwise") {
+    cost.forward_flops = (bottom.size() - 1) * top_count;
+    cost.backward_flops = bottom_count;
+  } else if (type == "Concat" || type == "Slice") {
+    // Pure copies.
+  } else if (type == "Input" || type == "Data" || type == "ImageData" ||
+      type == "MemoryData" || type == "HDF5Data" || type == "DummyData" ||
+      type == "WindowData") {
+    cost.forward_bytes = sizeof(Dtype) * top_count;
+    cost.backward_bytes = 0;
+  } else {
+    // Elementwise: one operation per output.
+    cost.forward_flops = top_count;
+    cost.backward_flops = top_count;
+  }
+  return cost;
+}
+
+template LayerCost EstimateLayerCost<float>(Layer<float>* layer,
+    const vector<Blob<float>*>& bottom, const vector<Blob<float>*>& top);
+template LayerCost EstimateLayerCost<double>(Layer<double>* layer,
+    const vector<Blob<double>*>& bottom, const vector<Blob<double>*>& top);
+
+}  // namespace caffe
@@ -1,11 +1,15 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
 
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/philox.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/vector_math.hpp"
 
 namespace caffe {
 
@@ -174,15 +178,50 @@ void caffe_div<double>(const int n, const double* a, const double* b,
   vdDiv(n, a, b, y);
 }
 
+// y = a^b without pow for the exponents layers use most, false for the others.
+// The results are those of pow, but for a = -0 and -inf with b = 0.5.
+template <typename Dtype>
+static bool caffe_powx_special(const int n, const Dtype* a, const Dtype b,
+    Dtype* y) {
+  if (b == 1) {
+    caffe_copy(n, a, y);
+  } else if (b == 2) {
+    for (int i = 0; i < n; ++i) {
+      y[i] = a[i] * a[i];
+    }
+  } else if (b == -1) {
+    for (int i = 0; i < n; ++i) {
+      y[i] = 1 / a[i];
+    }
+  } else if (b == 0.5) {
+    for (int i = 0; i < n; ++i) {
+      y[i] = std::sqrt(a[i]);
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
 template <>
 void caffe_powx<float>(const int n, const float* a, const float b,
     float* y) {
+#ifndef USE_MKL
+  if (caffe_powx_special(n, a, b, y)) {
+    return;
+  }
+#endif
   vsPowx(n, a, b, y);
 }
 
 template <>
 void caffe_powx<double>(const int n, const double* a, const double b,
     double* y) {
+#ifndef USE_MKL
+  if (caffe_powx_special(n, a, b, y)) {
+    return;
+  }
+#endif
   vdPowx(n, a, b, y);
 }
 
@@ -196,9 +235,32 @@ void caffe_sqr<double>(const int n, const double* a, double* y) {
   vdSqr(n, a, y);
 }
 
+// Applies a function of vector_math.hpp in chunks, in parallel when there is
+// more than one.
+static void vector_chunks(void (*func)(const int, const float*, float*),
+    const int n, const float* a, float* y) {
+  const int kChunk = 4096;
+  if (n <= kChunk) {
+    func(n, a, y);
+    return;
+  }
+  const int num_chunks = (n + kChunk - 1) / kChunk;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < num_chunks; ++i) {
+    const int begin = i * kChunk;
+    func(std::min(kChunk, n - begin), a + begin, y + begin);
+  }
+}
+
 template <>
 void caffe_exp<float>(const int n, const float* a, float* y) {
+#ifdef USE_MKL
   vsExp(n, a, y);
+#else
+  vector_chunks(vector_exp, n, a, y);
+#endif
 }
 
 template <>
@@ -208,7 +270,11 @@ void caffe_exp<double>(const int n, const double* a, double* y) {
 
 template <>
 void caffe_log<float>(const int n, const float* a, float* y) {
+#ifdef USE_MKL
   vsLn(n, a, y);
+#else
+  vector_chunks(vector_log, n, a, y);
+#endif
 }
 
 template <>
@@ -216,6 +282,30 @@ void caffe_log<double>(const int n, const double* a, double* y) {
   vdLn(n, a, y);
 }
 
+template <>
+void caffe_tanh<float>(const int n, const float* a, float* y) {
+  vector_chunks(vector_tanh, n, a, y);
+}
+
+template <>
+void caffe_tanh<double>(const int n, const double* a, double* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::tanh(a[i]);
+  }
+}
+
+template <>
+void caffe_sigmoid<float>(const int n, const float* a, float* y) {
+  vector_chunks(vector_sigmoid, n, a, y);
+}
+
+template <>
+void caffe_sigmoid<double>(const int n, const double* a, double* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = 1. / (1. + std::exp(-a[i]));
+  }
+}
+
 template <>
 void caffe_abs<float>(const int n, const float* a, float* y) {
     vsAbs(n, a, y);
@@ -242,17 +332,130 @@ float caffe_nextafter(const float b);
 template
 double caffe_nextafter(const double b);
 
+namespace {
+
+// Words are generated a tile at a time, a multiple of the four of a block
+// and of the 32 draws packed in a word.
+const int kTileWords = 1024;
+
+// Generates num_words words of a Philox stream keyed from the thread's
+// generator, so that Caffe::set_random_seed makes them reproducible, and
+// hands each tile to transform(begin, end, words) for the words from begin
+// to end. Tiles are generated in parallel, with the same result whatever
+// the number of threads.
+template <typename Transform>
+void philox_generate(const int num_words, const Transform& transform) {
+  const uint64_t high = caffe_rng_rand();
+  const uint64_t low = caffe_rng_rand();
+  const Philox philox(high << 32 | low);
+  const int num_tiles = (num_words + kTileWords - 1) / kTileWords;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int tile = 0; tile < num_tiles; ++tile) {
+    const int begin = tile * kTileWords;
+    const int end = std::min(num_words, begin + kTileWords);
+    uint32_t words[kTileWords];
+    philox.Fill(begin / 4, end - begin, words);
+    transform(begin, end, words);
+  }
+}
+
+// Uniform values in (0, 1) from 24 random bits of one word for float, 53 of
+// two for double.
+template <typename Dtype> struct UnitUniform;
+
+template <> struct UnitUniform<float> {
+  static const int kWords = 1;
+  static inline float Get(const uint32_t* words) {
+    return ((words[0] >> 8) + 0.5f) * (1.f / (1 << 24));
+  }
+};
+
+template <> struct UnitUniform<double> {
+  static const int kWords = 2;
+  static inline double Get(const uint32_t* words) {
+    const uint64_t bits =
+        (static_cast<uint64_t>(words[0]) << 21) ^ (words[1] >> 11);
+    return (bits + 0.5) * (1. / (static_cast<uint64_t>(1) << 53));
+  }
+};
+
+template <typename Dtype>
+struct UniformTransform {
+  static const int kWords = UnitUniform<Dtype>::kWords;
+  Dtype a, b;
+  Dtype* r;
+  void operator()(int begin, int end, const uint32_t* words) const {
+    Dtype* tile_r = r + begin / kWords;
+    const int n = (end - begin) / kWords;
+    for (int i = 0; i < n; ++i) {
+      tile_r[i] = std::min(b,
+          a + (b - a) * UnitUniform<Dtype>::Get(words + i * kWords));
+    }
+  }
+};
+
+// Each word is a draw: its top 31 bits are compared with p scaled to 2^31,
+// so that p = 1 fits in the 32-bit compare and the loop vectorizes.
+template <typename Itype>
+struct BernoulliTransform {
+  uint32_t threshold;
+  Itype* r;
+  void operator()(int begin, int end, const uint32_t* words) const {
+    Itype* tile_r = r + begin;
+    for (int i = 0; i < end - begin; ++i) {
+      tile_r[i] = (words[i] >> 1) < threshold;
+    }
+  }
+};
+
+// Bernoulli draws packed 32 to a word; tiles start at a word boundary.
+struct BernoulliBitsTransform {
+  uint32_t threshold;
+  unsigned int* r;
+  void operator()(int begin, int end, const uint32_t* words) const {
+    for (int i = 0; i < end - begin; i += 32) {
+      const int num_bits = std::min(32, end - begin - i);
+      unsigned int bits = 0;
+      for (int j = 0; j < num_bits; ++j) {
+        bits |= static_cast<unsigned int>((words[i + j] >> 1) < threshold)
+            << j;
+      }
+      r[(begin + i) / 32] = bits;
+    }
+  }
+};
+
+template <typename Dtype>
+uint32_t bernoulli_threshold(const Dtype p) {
+  CHECK_GE(p, 0);
+  CHECK_LE(p, 1);
+  return static_cast<uint32_t>(static_cast<double>(p) * 2147483648.);
+}
+
+template <typename Dtype, typename Itype>
+void philox_bernoulli(const int n, const Dtype p, Itype* r) {
+  CHECK_GE(n, 0);
+  CHECK(r);
+  BernoulliTransform<Itype> transform;
+  transform.threshold = bernoulli_threshold(p);
+  transform.r = r;
+  philox_generate(n, transform);
+}
+
+}  // namespace
+
 template <typename Dtype>
 void caffe_rng_uniform(const int n, const Dtype a, const Dtype b, Dtype* r) {
   CHECK_GE(n, 0);
   CHECK(r);
   CHECK_LE(a, b);
-  boost::uniform_real<Dtype> random_distribution(a, caffe_nextafter<Dtype>(b));
-  boost::variate_generator<caffe::rng_t*, boost::uniform_real<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  UniformTransform<Dtype> transform;
+  transform.a = a;
+  transform.b = b;
+  transform.r = r;
+  philox_generate(n * UniformTransform<Dtype>::kWords, transform);
 }
 
 template
@@ -263,6 +466,8 @@ template
 void caffe_rng_uniform<double>(const int n, const double a, const double b,
                                double* r);
 
+// Boost's ziggurat stays faster than Box-Muller over Philox words, whose
+// log and sincos cost more than the table lookups.
 template <typename Dtype>
 void caffe_rng_gaussian(const int n, const Dtype a,
                         const Dtype sigma, Dtype* r) {
@@ -287,16 +492,7 @@ void caffe_rng_gaussian<double>(const int n, const double mu,
 
 template <typename Dtype>
 void caffe_rng_bernoulli(const int n, const Dtype p, int* r) {
-  CHECK_GE(n, 0);
-  CHECK(r);
-  CHECK_GE(p, 0);
-  CHECK_LE(p, 1);
-  boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  philox_bernoulli(n, p, r);
 }
 
 template
@@ -307,16 +503,7 @@ void caffe_rng_bernoulli<float>(const int n, const float p, int* r);
 
 template <typename Dtype>
 void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r) {
-  CHECK_GE(n, 0);
-  CHECK(r);
-  CHECK_GE(p, 0);
-  CHECK_LE(p, 1);
-  boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = static_cast<unsigned int>(variate_generator());
-  }
+  philox_bernoulli(n, p, r);
 }
 
 template
@@ -325,6 +512,24 @@ void caffe_rng_bernoulli<double>(const int n, const double p, unsigned int* r);
 template
 void caffe_rng_bernoulli<float>(const int n, const float p, unsigned int* r);
 
+template <typename Dtype>
+void caffe_rng_bernoulli_bits(const int n, const Dtype p, unsigned int* r) {
+  CHECK_GE(n, 0);
+  CHECK(r);
+  BernoulliBitsTransform transform;
+  transform.threshold = bernoulli_threshold(p);
+  transform.r = r;
+  philox_generate(n, transform);
+}
+
+template
+void caffe_rng_bernoulli_bits<double>(const int n, const double p,
+                                      unsigned int* r);
+
+template
+void caffe_rng_bernoulli_bits<float>(const int n, const float p,
+                                     unsigned int* r);
+
 template <>
 float caffe_cpu_strided_dot<float>(const int n, const float* x, const int incx,
     const float* y, const int incy) {
@@ -372,4 +577,50 @@ void caffe_cpu_scale<double>(const int n, const double alpha, const double *x,
   cblas_dscal(n, alpha, y, 1);
 }
 
+// Rounds x to the nearest value of a binary floating point format with the
+// given number of significand bits (including the implicit one) and range of
+// normal exponents; below the normal range the spacing of subnormals is kept.
+static double round_to_format(const double x, const int significand_bits,
+    const int min_exponent, const int max_exponent) {
+  int exponent;
+  frexp(x, &exponent);  // |x| = m * 2^exponent with 0.5 <= m < 1
+  const int ulp_exponent = std::max(exponent - 1, min_exponent)
+      - (significand_bits - 1);
+  const double y = ldexp(rint(ldexp(x, -ulp_exponent)), ulp_exponent);
+  const double max_value =
+      ldexp(2. - ldexp(1., 1 - significand_bits), max_exponent);
+  if (std::fabs(y) > max_value) {
+    return x < 0 ? -std::numeric_limits<double>::infinity() :
+        std::numeric_limits<double>::infinity();
+  }
+  return y;
+}
+
+template <typename Dtype>
+void caffe_cpu_round_half(const int n, const Dtype* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = round_to_format(x[i], 11, -14, 15);
+  }
+}
+
+template
+void caffe_cpu_round_half<float>(const int n, const float* x, float* y);
+
+template
+void caffe_cpu_round_half<double>(const int n, const double* x, double* y);
+
+template <typename Dtype>
+void caffe_cpu_round_bfloat16(const int n, const Dtype* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = round_to_format(x[i], 8, -126, 127);
+  }
+}
+
+template
+void caffe_cpu_round_bfloat16<float>(const int n, const float* x, float* y);
+
+template
+void caffe_cpu_round_bfloat16<double>(const int n, const double* x,
+                                      double* y);
+
 }  // namespace caffe
@@ -1,4 +1,5 @@
 #include <math_functions.h>  // CUDA's, not caffe's, for fabs, signbit
+#include <math_constants.h>  // CUDART_INF
 #include <thrust/device_vector.h>
 #include <thrust/functional.h>  // thrust::plus
 #include <thrust/reduce.h>
@@ -371,6 +372,27 @@ DEFINE_AND_INSTANTIATE_GPU_UNARY_FUNC(sign, y[index] = (Dtype(0) < x[index])
                                       - (x[index] < Dtype(0)));
 DEFINE_AND_INSTANTIATE_GPU_UNARY_FUNC(sgnbit, y[index] = signbit(x[index]));
 
+// See round_to_format in math_functions.cpp.
+__device__ double round_to_format(const double x, const int significand_bits,
+    const int min_exponent, const int max_exponent) {
+  int exponent;
+  frexp(x, &exponent);
+  const int ulp_exponent = max(exponent - 1, min_exponent)
+      - (significand_bits - 1);
+  const double y = ldexp(rint(ldexp(x, -ulp_exponent)), ulp_exponent);
+  const double max_value =
+      ldexp(2. - ldexp(1., 1 - significand_bits), max_exponent);
+  if (fabs(y) > max_value) {
+    return copysign(CUDART_INF, x);
+  }
+  return y;
+}
+
+DEFINE_AND_INSTANTIATE_GPU_UNARY_FUNC(round_half,
+    y[index] = round_to_format(x[index], 11, -14, 15));
+DEFINE_AND_INSTANTIATE_GPU_UNARY_FUNC(round_bfloat16,
+    y[index] = round_to_format(x[index], 8, -126, 127));
+
 void caffe_gpu_rng_uniform(const int n, unsigned int* r) {
   CURAND_CHECK(curandGenerate(Caffe::curand_generator(), r, n));
 }
@@ -0,0 +1,194 @@
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+#include <map>
+#include <vector>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/sparse_matrix.hpp"
+
+namespace caffe {
+
+using boost::weak_ptr;
+
+namespace {
+
+// Writes the transpose of the rows x cols matrix A to B.
+template <typename Dtype>
+void Transpose(int rows, int cols, const Dtype* A, Dtype* B) {
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      B[static_cast<size_t>(c) * rows + r] =
+          A[static_cast<size_t>(r) * cols + c];
+    }
+  }
+}
+
+// The CSR form last built from the weights in source, for the SparseWeights
+// of every layer sharing them.
+template <typename Dtype>
+struct SharedSparseWeights {
+  SharedSparseWeights() : version(0), rows(0), threshold(0), sparse(false) {}
+  weak_ptr<SyncedMemory> source;
+  int64_t version;
+  int rows;
+  float threshold;
+  bool sparse;
+  weak_ptr<const SparseMatrix<Dtype> > matrix;
+};
+
+boost::mutex shared_sparse_weights_mutex_;
+
+// Guarded by shared_sparse_weights_mutex_.
+template <typename Dtype>
+std::map<const SyncedMemory*, SharedSparseWeights<Dtype> >&
+    SharedSparseWeightsRegistry() {
+  static std::map<const SyncedMemory*, SharedSparseWeights<Dtype> > registry;
+  return registry;
+}
+
+}  // namespace
+
+template <typename Dtype>
+void SparseMatrix<Dtype>::FromDense(int rows, int cols, const Dtype* dense) {
+  rows_ = rows;
+  cols_ = cols;
+  row_start_.resize(rows + 1);
+  col_index_.clear();
+  values_.clear();
+  for (int r = 0; r < rows; ++r) {
+    row_start_[r] = values_.size();
+    const Dtype* row = dense + static_cast<size_t>(r) * cols;
+    for (int c = 0; c < cols; ++c) {
+      if (row[c] != 0) {
+        col_index_.push_back(c);
+        values_.push_back(row[c]);
+      }
+    }
+  }
+  row_start_[rows] = values_.size();
+}
+
+template <typename Dtype>
+void SparseMatrix<Dtype>::Clear() {
+  rows_ = 0;
+  cols_ = 0;
+  vector<int>(1, 0).swap(row_start_);
+  vector<int>().swap(col_index_);
+  vector<Dtype>().swap(values_);
+}
+
+template <typename Dtype>
+void SparseMatrix<Dtype>::MultiplyRows(int row_begin, int row_end, int n,
+    const Dtype* B, Dtype* C) const {
+  for (int r = row_begin; r < row_end; ++r) {
+    Dtype* c_row = C + static_cast<size_t>(r - row_begin) * n;
+    caffe_set(n, Dtype(0), c_row);
+    for (int i = row_start_[r]; i < row_start_[r + 1]; ++i) {
+      const Dtype value = values_[i];
+      const Dtype* b_row = B + static_cast<size_t>(col_index_[i]) * n;
+      for (int j = 0; j < n; ++j) {
+        c_row[j] += value * b_row[j];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void SparseMatrix<Dtype>::MultiplyTransposedBy(int m, const Dtype* B,
+    Dtype* C, Dtype* buffer) const {
+  if (m == 1) {
+    for (int r = 0; r < rows_; ++r) {
+      Dtype sum = 0;
+      for (int k = row_start_[r]; k < row_start_[r + 1]; ++k) {
+        sum += values_[k] * B[col_index_[k]];
+      }
+      C[r] = sum;
+    }
+    return;
+  }
+  // C^T = A B^T, so that the inner loop runs over contiguous rows of B^T
+  // rather than gathering from B.
+  Dtype* B_t = buffer;
+  Dtype* C_t = buffer + static_cast<size_t>(cols_) * m;
+  Transpose(m, cols_, B, B_t);
+  MultiplyRows(0, rows_, m, B_t, C_t);
+  Transpose(rows_, m, C_t, C);
+}
+
+template <typename Dtype>
+void SparseMatrix<Dtype>::MultiplyBy(int m, const Dtype* B, Dtype* C) const {
+  caffe_set(m * cols_, Dtype(0), C);
+  for (int r = 0; r < rows_; ++r) {
+    for (int i = 0; i < m; ++i) {
+      const Dtype b = B[static_cast<size_t>(i) * rows_ + r];
+      if (b == 0) {
+        continue;
+      }
+      Dtype* c_row = C + static_cast<size_t>(i) * cols_;
+      for (int k = row_start_[r]; k < row_start_[r + 1]; ++k) {
+        c_row[col_index_[k]] += b * values_[k];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+const SparseMatrix<Dtype>* SparseWeights<Dtype>::Get(
+    const Blob<Dtype>& weights, int rows, int cols, float threshold) {
+  CHECK_EQ(rows * cols, weights.count());
+  if (threshold > 1) {
+    return NULL;
+  }
+  const shared_ptr<SyncedMemory>& data = weights.data();
+  if (data == source_ && data->version() == version_ &&
+      threshold == threshold_) {
+    return matrix_.get();
+  }
+  source_ = data;
+  version_ = data->version();
+  threshold_ = threshold;
+  boost::mutex::scoped_lock lock(shared_sparse_weights_mutex_);
+  std::map<const SyncedMemory*, SharedSparseWeights<Dtype> >& registry =
+      SharedSparseWeightsRegistry<Dtype>();
+  SharedSparseWeights<Dtype>& shared = registry[data.get()];
+  if (shared.source.lock() == data && shared.version == version_ &&
+      shared.rows == rows && shared.threshold == threshold) {
+    matrix_ = shared.matrix.lock();
+    if (matrix_ || !shared.sparse) {
+      return matrix_.get();
+    }
+  }
+  const Dtype* dense = weights.cpu_data();
+  int zeros = 0;
+  for (int i = 0; i < weights.count(); ++i) {
+    zeros += (dense[i] == 0);
+  }
+  matrix_.reset();
+  shared.sparse = zeros >= threshold * weights.count();
+  if (shared.sparse) {
+    shared_ptr<SparseMatrix<Dtype> > matrix(new SparseMatrix<Dtype>());
+    matrix->FromDense(rows, cols, dense);
+    matrix_ = matrix;
+  }
+  shared.source = data;
+  shared.version = version_;
+  shared.rows = rows;
+  shared.threshold = threshold;
+  shared.matrix = matrix_;
+  // Forget the weights that are gone.
+  typename std::map<const SyncedMemory*, SharedSparseWeights<Dtype> >::iterator
+      it = registry.begin();
+  while (it != registry.end()) {
+    if (it->second.source.expired()) {
+      registry.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  return matrix_.get();
+}
+
+INSTANTIATE_CLASS(SparseMatrix);
+INSTANTIATE_CLASS(SparseWeights);
+
+}  // namespace caffe
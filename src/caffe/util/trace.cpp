@@ -0,0 +1,154 @@
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/format.hpp"
+#include "caffe/util/trace.hpp"
+
+namespace caffe {
+
+// Ring buffer of the events recorded by one thread, allocated on the first
+// event. The mutex is only contended while exporting.
+struct TraceBuffer {
+  explicit TraceBuffer(int thread) : next(0), size(0), thread(thread) {}
+
+  boost::mutex mutex;
+  vector<TraceEvent> events;
+  int next;
+  int size;
+  const int thread;
+  string thread_name;
+};
+
+boost::atomic<bool> Trace::enabled_(false);
+
+static boost::mutex registry_mutex_;
+static vector<shared_ptr<TraceBuffer> > buffers_;
+static boost::thread_specific_ptr<shared_ptr<TraceBuffer> > thread_buffer_;
+static int capacity_ = 0;
+static boost::posix_time::ptime epoch_;
+
+// The calling thread's buffer, registered on first use so that its events
+// outlive the thread.
+static TraceBuffer* ThreadBuffer() {
+  if (!thread_buffer_.get()) {
+    boost::mutex::scoped_lock lock(registry_mutex_);
+    shared_ptr<TraceBuffer> buffer(new TraceBuffer(buffers_.size()));
+    buffers_.push_back(buffer);
+    thread_buffer_.reset(new shared_ptr<TraceBuffer>(buffer));
+  }
+  return thread_buffer_->get();
+}
+
+void Trace::Enable(int capacity) {
+  CHECK_GT(capacity, 0) << "Trace capacity must be positive.";
+  boost::mutex::scoped_lock lock(registry_mutex_);
+  if (epoch_.is_not_a_date_time()) {
+    epoch_ = boost::posix_time::microsec_clock::universal_time();
+  }
+  capacity_ = capacity;
+  enabled_.store(true, boost::memory_order_release);
+}
+
+void Trace::Disable() {
+  enabled_.store(false, boost::memory_order_release);
+}
+
+void Trace::Clear() {
+  boost::mutex::scoped_lock lock(registry_mutex_);
+  for (int i = 0; i < buffers_.size(); ++i) {
+    boost::mutex::scoped_lock buffer_lock(buffers_[i]->mutex);
+    buffers_[i]->next = 0;
+    buffers_[i]->size = 0;
+  }
+}
+
+void Trace::SetThreadName(const string& name) {
+  TraceBuffer* buffer = ThreadBuffer();
+  boost::mutex::scoped_lock lock(buffer->mutex);
+  buffer->thread_name = name;
+}
+
+int64_t Trace::Now() {
+  return (boost::posix_time::microsec_clock::universal_time() - epoch_)
+      .total_microseconds();
+}
+
+void Trace::Record(const char* category, const string& name,
+    int64_t start, int64_t end) {
+  TraceBuffer* buffer = ThreadBuffer();
+  boost::mutex::scoped_lock lock(buffer->mutex);
+  if (buffer->events.empty()) {
+    buffer->events.resize(capacity_);
+  }
+  TraceEvent& event = buffer->events[buffer->next];
+  event.name = name;
+  event.category = category;
+  event.start = start;
+  event.duration = end - start;
+  event.thread = buffer->thread;
+  buffer->next = (buffer->next + 1) % buffer->events.size();
+  buffer->size = std::min<int>(buffer->size + 1, buffer->events.size());
+}
+
+static bool EventStartsBefore(const TraceEvent& a, const TraceEvent& b) {
+  return a.start < b.start;
+}
+
+void Trace::Events(vector<TraceEvent>* events) {
+  events->clear();
+  boost::mutex::scoped_lock lock(registry_mutex_);
+  for (int i = 0; i < buffers_.size(); ++i) {
+    TraceBuffer* buffer = buffers_[i].get();
+    boost::mutex::scoped_lock buffer_lock(buffer->mutex);
+    if (!buffer->size) {
+      continue;
+    }
+    const int capacity = buffer->events.size();
+    const int oldest = (buffer->next - buffer->size + capacity) % capacity;
+    for (int j = 0; j < buffer->size; ++j) {
+      events->push_back(buffer->events[(oldest + j) % capacity]);
+    }
+  }
+  std::stable_sort(events->begin(), events->end(), EventStartsBefore);
+}
+
+void Trace::WriteChromeTrace(const string& filename) {
+  vector<TraceEvent> events;
+  Events(&events);
+  std::ofstream output(filename.c_str());
+  CHECK(output.good()) << "Failed to open trace " << filename;
+  output << "{\"traceEvents\": [";
+  bool first = true;
+  {
+    boost::mutex::scoped_lock lock(registry_mutex_);
+    for (int i = 0; i < buffers_.size(); ++i) {
+      boost::mutex::scoped_lock buffer_lock(buffers_[i]->mutex);
+      if (buffers_[i]->thread_name.empty()) {
+        continue;
+      }
+      output << (first ? "" : ",") << "\n  {\"name\": \"thread_name\", "
+          << "\"ph\": \"M\", \"pid\": 0, \"tid\": " << buffers_[i]->thread
+          << ", \"args\": {\"name\": "
+          << format_json_string(buffers_[i]->thread_name) << "}}";
+      first = false;
+    }
+  }
+  for (int i = 0; i < events.size(); ++i) {
+    const TraceEvent& event = events[i];
+    output << (first ? "" : ",") << "\n  {\"name\": "
+        << format_json_string(event.name) << ", \"cat\": "
+        << format_json_string(event.category) << ", \"ph\": \"X\", \"ts\": "
+        << event.start << ", \"dur\": " << event.duration
+        << ", \"pid\": 0, \"tid\": " << event.thread << "}";
+    first = false;
+  }
+  output << "\n], \"displayTimeUnit\": \"ms\"}\n";
+  LOG(INFO) << "Wrote " << events.size() << " trace events to " << filename;
+}
+
+}  // namespace caffe
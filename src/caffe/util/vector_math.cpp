@@ -0,0 +1,264 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <cmath>
+
+#include "caffe/util/vector_math.hpp"
+
+// The kernels need vector extensions with __builtin_convertvector, which
+// GCC has since version 9; older compilers use libm.
+#if defined(__clang__)
+#if __has_builtin(__builtin_convertvector)
+#define VECTOR_MATH_EXTENSIONS
+#endif
+#elif defined(__GNUC__) && __GNUC__ >= 9
+#define VECTOR_MATH_EXTENSIONS
+#endif
+
+#ifdef VECTOR_MATH_EXTENSIONS
+#define VECTOR_MATH_INLINE inline __attribute__((always_inline))
+#if defined(__x86_64__) || defined(__i386__)
+#define VECTOR_MATH_DISPATCH
+#endif
+// The helpers below are always inlined into the function of each target, so
+// the ABI of the vectors they return does not matter.
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+namespace caffe {
+
+#ifdef VECTOR_MATH_INLINE
+
+namespace {
+
+// The polynomials are those of the Cephes library, in single precision.
+
+template <int kLanes>
+struct Lanes {
+  typedef float Float __attribute__((vector_size(kLanes * sizeof(float))));
+  typedef int32_t Int __attribute__((vector_size(kLanes * sizeof(int32_t))));
+};
+
+template <typename Float>
+VECTOR_MATH_INLINE Float Splat(float value) {
+  return Float() + value;
+}
+
+template <typename Int, typename Float>
+VECTOR_MATH_INLINE Int Bits(const Float& x) {
+  return reinterpret_cast<Int>(x);
+}
+
+template <typename Float, typename Int>
+VECTOR_MATH_INLINE Float FromBits(const Int& x) {
+  return reinterpret_cast<Float>(x);
+}
+
+// a where the mask is set, b elsewhere.
+template <typename Float, typename Int>
+VECTOR_MATH_INLINE Float Select(const Int& mask, const Float& a,
+    const Float& b) {
+  return FromBits<Float>((mask & Bits<Int>(a)) | (~mask & Bits<Int>(b)));
+}
+
+template <int kLanes>
+VECTOR_MATH_INLINE typename Lanes<kLanes>::Float Exp(
+    const typename Lanes<kLanes>::Float& x) {
+  typedef typename Lanes<kLanes>::Float Float;
+  typedef typename Lanes<kLanes>::Int Int;
+  // exp(x) overflows above hi, and is below half the least subnormal
+  // under lo.
+  const Float hi = Splat<Float>(88.7228391f);
+  const Float lo = Splat<Float>(-103.972084f);
+  Float xc = Select(x > hi, hi, x);
+  xc = Select(xc < lo, lo, xc);
+  // x = n ln(2) + r, |r| <= ln(2) / 2, with ln(2) in two parts.
+  const Float fx = xc * 1.44269504088896341f;
+  const Int n = __builtin_convertvector(
+      fx + Select(fx < 0, Splat<Float>(-0.5f), Splat<Float>(0.5f)), Int);
+  const Float fn = __builtin_convertvector(n, Float);
+  const Float r = xc - fn * 0.693359375f + fn * 2.12194440e-4f;
+  Float p = Splat<Float>(1.9875691500e-4f);
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1;
+  // 2^n in two factors, which are normal down to n = -150.
+  const Int n1 = n >> 1;
+  Float y = p * FromBits<Float>((n1 + 127) << 23) *
+      FromBits<Float>((n - n1 + 127) << 23);
+  y = Select(x > hi, Splat<Float>(INFINITY), y);
+  y = Select(x < lo, Float(), y);
+  return Select(x != x, x, y);
+}
+
+template <int kLanes>
+VECTOR_MATH_INLINE typename Lanes<kLanes>::Float Log(
+    const typename Lanes<kLanes>::Float& x) {
+  typedef typename Lanes<kLanes>::Float Float;
+  typedef typename Lanes<kLanes>::Int Int;
+  // Subnormals are scaled to normals by 2^23.
+  const Int subnormal = x < 1.17549435e-38f;
+  const Float xs = Select(subnormal, x * 8388608.0f, x);
+  const Int bits = Bits<Int>(xs);
+  // x = m 2^e, with m in [sqrt(1/2), sqrt(2)).
+  Int e = ((bits >> 23) & 0xff) - 126 + (subnormal & -23);
+  const Float m = FromBits<Float>((bits & 0x007fffff) | 0x3f000000);
+  const Int small = m < 0.707106781186547524f;
+  e += small;
+  const Float f = Select(small, m + m, m) - 1;
+  const Float z = f * f;
+  Float p = Splat<Float>(7.0376836292e-2f);
+  p = p * f - 1.1514610310e-1f;
+  p = p * f + 1.1676998740e-1f;
+  p = p * f - 1.2420140846e-1f;
+  p = p * f + 1.4249322787e-1f;
+  p = p * f - 1.6668057665e-1f;
+  p = p * f + 2.0000714765e-1f;
+  p = p * f - 2.4999993993e-1f;
+  p = p * f + 3.3333331174e-1f;
+  const Float fe = __builtin_convertvector(e, Float);
+  Float y = p * f * z + fe * -2.12194440e-4f - 0.5f * z + f +
+      fe * 0.693359375f;
+  y = Select(x == INFINITY, x, y);
+  y = Select(x == 0, Splat<Float>(-INFINITY), y);
+  y = Select(x < 0, Splat<Float>(NAN), y);
+  return Select(x != x, x, y);
+}
+
+template <int kLanes>
+VECTOR_MATH_INLINE typename Lanes<kLanes>::Float Tanh(
+    const typename Lanes<kLanes>::Float& x) {
+  typedef typename Lanes<kLanes>::Float Float;
+  typedef typename Lanes<kLanes>::Int Int;
+  const Int sign = Bits<Int>(x) & 0x80000000;
+  const Float a = FromBits<Float>(Bits<Int>(x) ^ sign);
+  // An odd polynomial near 0, 1 - 2 / (exp(2 |x|) + 1) with the sign of x
+  // elsewhere.
+  const Float z = x * x;
+  Float p = Splat<Float>(-5.70498872745e-3f);
+  p = p * z + 2.06390887954e-2f;
+  p = p * z - 5.37397155531e-2f;
+  p = p * z + 1.33314422036e-1f;
+  p = p * z - 3.33332819422e-1f;
+  p = p * z * x + x;
+  const Float t = 1 - 2 / (Exp<kLanes>(a + a) + 1);
+  return Select(a < 0.625f, p, FromBits<Float>(Bits<Int>(t) | sign));
+}
+
+template <int kLanes>
+VECTOR_MATH_INLINE typename Lanes<kLanes>::Float Sigmoid(
+    const typename Lanes<kLanes>::Float& x) {
+  typedef typename Lanes<kLanes>::Float Float;
+  // e / (1 + e) for x < 0, with e = exp(x), which does not overflow.
+  const Float e = Exp<kLanes>(Select(x < 0, x, -x));
+  return Select(x < 0, e, Splat<Float>(1)) / (1 + e);
+}
+
+// y = Op(a) a vector at a time, the tail through a padded vector.
+#define DEFINE_VECTOR_KERNEL(name, lanes) \
+  void name##lanes(const int n, const float* a, float* y) { \
+    typedef Lanes<lanes>::Float Float; \
+    int i = 0; \
+    for (; i + lanes <= n; i += lanes) { \
+      Float x; \
+      memcpy(&x, a + i, sizeof(x)); \
+      x = name<lanes>(x); \
+      memcpy(y + i, &x, sizeof(x)); \
+    } \
+    if (i < n) { \
+      Float x = Float(); \
+      memcpy(&x, a + i, (n - i) * sizeof(float)); \
+      x = name<lanes>(x); \
+      memcpy(y + i, &x, (n - i) * sizeof(float)); \
+    } \
+  }
+
+#ifdef VECTOR_MATH_DISPATCH
+
+#define DEFINE_VECTOR_FUNC(name, lowercase) \
+  __attribute__((target("avx512f"))) DEFINE_VECTOR_KERNEL(name, 16) \
+  __attribute__((target("avx2,fma"))) DEFINE_VECTOR_KERNEL(name, 8) \
+  DEFINE_VECTOR_KERNEL(name, 4) \
+  void (*const lowercase##_kernel[])(const int, const float*, float*) = \
+      {name##4, name##8, name##16}
+
+// The index in the kernel tables of the widest the CPU supports.
+int DetectLevel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return 2;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return 1;
+  }
+  return 0;
+}
+
+const int kLevel = DetectLevel();
+
+#else
+
+#define DEFINE_VECTOR_FUNC(name, lowercase) \
+  DEFINE_VECTOR_KERNEL(name, 4) \
+  void (*const lowercase##_kernel[])(const int, const float*, float*) = \
+      {name##4}
+
+const int kLevel = 0;
+
+#endif  // VECTOR_MATH_DISPATCH
+
+DEFINE_VECTOR_FUNC(Exp, exp);
+DEFINE_VECTOR_FUNC(Log, log);
+DEFINE_VECTOR_FUNC(Tanh, tanh);
+DEFINE_VECTOR_FUNC(Sigmoid, sigmoid);
+
+}  // namespace
+
+void vector_exp(const int n, const float* a, float* y) {
+  exp_kernel[kLevel](n, a, y);
+}
+
+void vector_log(const int n, const float* a, float* y) {
+  log_kernel[kLevel](n, a, y);
+}
+
+void vector_tanh(const int n, const float* a, float* y) {
+  tanh_kernel[kLevel](n, a, y);
+}
+
+void vector_sigmoid(const int n, const float* a, float* y) {
+  sigmoid_kernel[kLevel](n, a, y);
+}
+
+#else  // Without vector extensions, fall back to libm.
+
+void vector_exp(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::exp(a[i]);
+  }
+}
+
+void vector_log(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::log(a[i]);
+  }
+}
+
+void vector_tanh(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::tanh(a[i]);
+  }
+}
+
+void vector_sigmoid(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = 1 / (1 + std::exp(-a[i]));
+  }
+}
+
+#endif  // VECTOR_MATH_INLINE
+
+}  // namespace caffe
@@ -0,0 +1,232 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/blob_compression.hpp"
+#include "caffe/util/weight_file.hpp"
+
+namespace caffe {
+
+const char WeightFile::kMagic[8] = {'C', 'A', 'F', 'F', 'E', 'W', 'T', 'S'};
+const uint32_t WeightFile::kVersion;
+const size_t WeightFile::kAlignment;
+const char WeightFile::kExtension[] = ".caffeweights";
+
+namespace {
+
+struct Unmap {
+  explicit Unmap(size_t size) : size(size) {}
+  void operator()(void* addr) const { munmap(addr, size); }
+  size_t size;
+};
+
+// Reads the index of a mapped file, failing on anything past its end.
+class IndexReader {
+ public:
+  IndexReader(const char* data, size_t size, const string& filename)
+      : data_(data), size_(size), offset_(0), filename_(filename) {}
+
+  void Read(void* value, size_t size) {
+    CHECK_LE(size, size_ - offset_) << "Truncated weight file " << filename_;
+    memcpy(value, data_ + offset_, size);
+    offset_ += size;
+  }
+  template <typename T>
+  T Read() {
+    T value;
+    Read(&value, sizeof(value));
+    return value;
+  }
+
+ private:
+  const char* data_;
+  size_t size_;
+  size_t offset_;
+  const string& filename_;
+};
+
+template <typename T>
+void WriteValue(std::ofstream* output, const T& value) {
+  output->write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+uint64_t Align(uint64_t offset) {
+  return (offset + WeightFile::kAlignment - 1) / WeightFile::kAlignment *
+      WeightFile::kAlignment;
+}
+
+// The shape a BlobProto is loaded with by Blob::FromProto.
+vector<int> ProtoShape(const BlobProto& proto) {
+  vector<int> shape;
+  if (proto.has_num() || proto.has_channels() ||
+      proto.has_height() || proto.has_width()) {
+    shape.push_back(proto.num());
+    shape.push_back(proto.channels());
+    shape.push_back(proto.height());
+    shape.push_back(proto.width());
+  } else {
+    for (int i = 0; i < proto.shape().dim_size(); ++i) {
+      shape.push_back(proto.shape().dim(i));
+    }
+  }
+  return shape;
+}
+
+bool HasCompressedBlobs(const NetParameter& param) {
+  for (int i = 0; i < param.layer_size(); ++i) {
+    for (int j = 0; j < param.layer(i).blobs_size(); ++j) {
+      if (param.layer(i).blobs(j).has_compressed_data()) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+WeightFile::WeightFile(const string& filename) : size_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Failed to stat " << filename;
+  size_ = st.st_size;
+  CHECK_GE(size_, sizeof(kMagic) + 2 * sizeof(uint32_t))
+      << "Truncated weight file " << filename;
+  // Writable so that params can be updated in place; being private, the
+  // writes only copy the pages they touch and never reach the file.
+  void* addr = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  CHECK(addr != MAP_FAILED) << "Failed to map " << filename;
+  mapping_.reset(addr, Unmap(size_));
+
+  char* data = static_cast<char*>(addr);
+  IndexReader reader(data, size_, filename);
+  char magic[sizeof(kMagic)];
+  reader.Read(magic, sizeof(magic));
+  CHECK_EQ(memcmp(magic, kMagic, sizeof(kMagic)), 0)
+      << filename << " is not a weight file";
+  CHECK_EQ(reader.Read<uint32_t>(), kVersion)
+      << "Unsupported weight file version in " << filename;
+  layers_.resize(reader.Read<uint32_t>());
+  for (int i = 0; i < layers_.size(); ++i) {
+    Layer& layer = layers_[i];
+    layer.name.resize(reader.Read<uint32_t>());
+    if (!layer.name.empty()) {
+      reader.Read(&layer.name[0], layer.name.size());
+    }
+    layer.params.resize(reader.Read<uint32_t>());
+    for (int j = 0; j < layer.params.size(); ++j) {
+      Param& param = layer.params[j];
+      const uint32_t type = reader.Read<uint32_t>();
+      CHECK(type == FLOAT || type == DOUBLE)
+          << "Unknown param type " << type << " in " << filename;
+      param.type = static_cast<Type>(type);
+      param.shape.resize(reader.Read<uint32_t>());
+      for (int k = 0; k < param.shape.size(); ++k) {
+        param.shape[k] = reader.Read<int32_t>();
+      }
+      const uint64_t offset = reader.Read<uint64_t>();
+      param.count = reader.Read<uint64_t>();
+      const size_t bytes = param.count *
+          (param.type == FLOAT ? sizeof(float) : sizeof(double));
+      CHECK(offset <= size_ && bytes <= size_ - offset)
+          << "Param " << j << " of layer " << layer.name
+          << " lies past the end of " << filename;
+      param.data = data + offset;
+    }
+  }
+}
+
+void WeightFile::Write(const NetParameter& trained_param,
+    const string& filename) {
+  NetParameter decompressed_param;
+  if (HasCompressedBlobs(trained_param)) {
+    decompressed_param.CopyFrom(trained_param);
+    DecompressNetParameter(&decompressed_param);
+  }
+  const NetParameter& param = HasCompressedBlobs(trained_param) ?
+      decompressed_param : trained_param;
+  // Lay out the index first, so that the data offsets are known.
+  uint64_t index_size = sizeof(kMagic) + 2 * sizeof(uint32_t);
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    index_size += 2 * sizeof(uint32_t) + layer.name().size();
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      index_size += 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t) +
+          ProtoShape(layer.blobs(j)).size() * sizeof(int32_t);
+    }
+  }
+
+  // Written aside and renamed, as truncating a file that is mapped would
+  // crash the processes reading it.
+  const string temp_filename = filename + ".tmp";
+  std::ofstream output(temp_filename.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(output) << "Cannot open " << temp_filename << " to save weights.";
+  output.write(kMagic, sizeof(kMagic));
+  WriteValue<uint32_t>(&output, kVersion);
+  WriteValue<uint32_t>(&output, param.layer_size());
+  uint64_t offset = Align(index_size);
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    WriteValue<uint32_t>(&output, layer.name().size());
+    output.write(layer.name().data(), layer.name().size());
+    WriteValue<uint32_t>(&output, layer.blobs_size());
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      const BlobProto& blob = layer.blobs(j);
+      const vector<int> shape = ProtoShape(blob);
+      const bool is_double = blob.double_data_size() > 0;
+      const uint64_t count = is_double ?
+          blob.double_data_size() : blob.data_size();
+      WriteValue<uint32_t>(&output, is_double ? DOUBLE : FLOAT);
+      WriteValue<uint32_t>(&output, shape.size());
+      for (int k = 0; k < shape.size(); ++k) {
+        WriteValue<int32_t>(&output, shape[k]);
+      }
+      WriteValue<uint64_t>(&output, offset);
+      WriteValue<uint64_t>(&output, count);
+      offset = Align(offset +
+          count * (is_double ? sizeof(double) : sizeof(float)));
+    }
+  }
+
+  const char padding[kAlignment] = {0};
+  uint64_t written = index_size;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      output.write(padding, Align(written) - written);
+      written = Align(written);
+      const BlobProto& blob = layer.blobs(j);
+      if (blob.double_data_size() > 0) {
+        output.write(reinterpret_cast<const char*>(blob.double_data().data()),
+            blob.double_data_size() * sizeof(double));
+        written += blob.double_data_size() * sizeof(double);
+      } else {
+        output.write(reinterpret_cast<const char*>(blob.data().data()),
+            blob.data_size() * sizeof(float));
+        written += blob.data_size() * sizeof(float);
+      }
+    }
+  }
+  output.close();
+  CHECK(output) << "Error saving weights to " << filename << ".";
+  CHECK_EQ(rename(temp_filename.c_str(), filename.c_str()), 0)
+      << "Error saving weights to " << filename << ".";
+}
+
+bool WeightFile::IsWeightFile(const string& filename) {
+  const size_t length = strlen(kExtension);
+  return filename.size() >= length &&
+      filename.compare(filename.size() - length, length, kExtension) == 0;
+}
+
+}  // namespace caffe
@@ -0,0 +1,248 @@
+#include <boost/thread.hpp>
+#include <stdint.h>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/io.hpp"
+#include "caffe/util/weight_loader.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Walks the fields of a serialized message without decoding them.
+class FieldReader {
+ public:
+  FieldReader(const char* data, size_t size)
+      : data_(data), size_(size), pos_(0), field_(0), offset_(0), length_(0),
+        error_(false) {}
+
+  // Moves to the next field; false at the end of the message or if it is
+  // malformed.
+  bool Next() {
+    if (pos_ == size_) {
+      return false;
+    }
+    uint64_t tag, value;
+    if (!ReadVarint(&tag)) {
+      return Fail();
+    }
+    field_ = tag >> 3;
+    offset_ = pos_;
+    length_ = 0;
+    switch (tag & 7) {
+    case 0:  // varint
+      if (!ReadVarint(&value)) { return Fail(); }
+      break;
+    case 1:  // 64-bit
+      if (!Skip(8)) { return Fail(); }
+      break;
+    case 2:  // length-delimited
+      if (!ReadVarint(&value)) { return Fail(); }
+      offset_ = pos_;
+      length_ = value;
+      if (!Skip(value)) { return Fail(); }
+      break;
+    case 5:  // 32-bit
+      if (!Skip(4)) { return Fail(); }
+      break;
+    default:  // groups are not used by caffe.proto
+      return Fail();
+    }
+    return true;
+  }
+
+  inline bool error() const { return error_; }
+  inline int field() const { return field_; }
+  /// The payload of a length-delimited field.
+  inline size_t offset() const { return offset_; }
+  inline size_t length() const { return length_; }
+
+ private:
+  bool ReadVarint(uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && pos_ < size_; shift += 7) {
+      const uint8_t byte = data_[pos_++];
+      *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  bool Skip(uint64_t size) {
+    if (size > size_ - pos_) {
+      return false;
+    }
+    pos_ += size;
+    return true;
+  }
+  bool Fail() {
+    error_ = true;
+    return false;
+  }
+
+  const char* data_;
+  size_t size_;
+  size_t pos_;
+  int field_;
+  size_t offset_;
+  size_t length_;
+  bool error_;
+};
+
+}  // namespace
+
+template <typename Dtype>
+WeightLoader<Dtype>::WeightLoader(const string& filename)
+    : filename_(filename), indexed_(true), num_pending_(0), next_(0),
+      stop_(false), mutex_(new boost::mutex()),
+      loaded_(new boost::condition_variable()) {
+  std::ifstream input(filename.c_str(), std::ios::in | std::ios::binary);
+  CHECK(input) << "File not found: " << filename;
+  input.seekg(0, std::ios::end);
+  data_.resize(input.tellg());
+  input.seekg(0, std::ios::beg);
+  if (!data_.empty()) {
+    input.read(&data_[0], data_.size());
+  }
+  CHECK(input) << "Failed to read " << filename;
+
+  FieldReader net(data_.data(), data_.size());
+  while (net.Next()) {
+    if (net.field() == NetParameter::kLayersFieldNumber) {
+      indexed_ = false;
+    } else if (net.field() == NetParameter::kLayerFieldNumber) {
+      Layer layer;
+      layer.offset = net.offset();
+      layer.size = net.length();
+      layer.state = LOADED;
+      FieldReader fields(data_.data() + layer.offset, layer.size);
+      while (fields.Next()) {
+        if (fields.field() == LayerParameter::kNameFieldNumber) {
+          layer.name.assign(data_, layer.offset + fields.offset(),
+              fields.length());
+        }
+      }
+      CHECK(!fields.error()) << "Failed to parse NetParameter file: "
+          << filename;
+      layers_.push_back(layer);
+    }
+  }
+  CHECK(!net.error()) << "Failed to parse NetParameter file: " << filename;
+  if (!indexed_) {
+    layers_.clear();
+    string().swap(data_);
+  }
+}
+
+template <typename Dtype>
+WeightLoader<Dtype>::~WeightLoader() {
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    stop_ = true;
+  }
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+}
+
+template <typename Dtype>
+void WeightLoader<Dtype>::SetTargets(int i,
+    const vector<shared_ptr<Blob<Dtype> > >& blobs) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  CHECK_NE(layers_[i].state, LOADING);
+  layers_[i].targets = blobs;
+  if (layers_[i].state == LOADED) {
+    layers_[i].state = PENDING;
+    ++num_pending_;
+  }
+}
+
+template <typename Dtype>
+void WeightLoader<Dtype>::Start(int num_threads) {
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.push_back(shared_ptr<boost::thread>(
+        new boost::thread(&WeightLoader::ThreadEntry, this)));
+  }
+}
+
+template <typename Dtype>
+void WeightLoader<Dtype>::Load(int i) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  Layer& layer = layers_[i];
+  while (layer.state == LOADING) {
+    loaded_->wait(lock);
+  }
+  if (layer.state == LOADED) {
+    return;
+  }
+  layer.state = LOADING;
+  lock.unlock();
+  Decode(layer);
+  lock.lock();
+  layer.state = LOADED;
+  layer.targets.clear();
+  if (--num_pending_ == 0) {
+    string().swap(data_);
+  }
+  loaded_->notify_all();
+}
+
+template <typename Dtype>
+void WeightLoader<Dtype>::LoadAll() {
+  for (int i = 0; i < layers_.size(); ++i) {
+    Load(i);
+  }
+}
+
+template <typename Dtype>
+void WeightLoader<Dtype>::Decode(const Layer& layer) {
+  LayerParameter param;
+  CHECK(ReadProtoFromBinaryArray(data_.data() + layer.offset, layer.size,
+      &param)) << "Failed to parse layer " << layer.name << " of "
+      << filename_;
+  CHECK_EQ(layer.targets.size(), param.blobs_size())
+      << "Incompatible number of blobs for layer " << layer.name;
+  for (int j = 0; j < layer.targets.size(); ++j) {
+    Blob<Dtype>* target = layer.targets[j].get();
+    if (!target) {
+      continue;
+    }
+    if (!target->ShapeEquals(param.blobs(j))) {
+      Blob<Dtype> source_blob;
+      source_blob.FromProto(param.blobs(j), true);
+      LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
+          << layer.name << "'; shape mismatch.  Source param shape is "
+          << source_blob.shape_string() << "; target param shape is "
+          << target->shape_string() << ". "
+          << "To learn this layer's parameters from scratch rather than "
+          << "copying from a saved net, rename the layer.";
+    }
+    target->FromProto(param.blobs(j), false);
+  }
+}
+
+template <typename Dtype>
+void WeightLoader<Dtype>::ThreadEntry() {
+  while (true) {
+    int i;
+    {
+      boost::mutex::scoped_lock lock(*mutex_);
+      while (next_ < layers_.size() && layers_[next_].state != PENDING) {
+        ++next_;
+      }
+      if (stop_ || next_ == layers_.size()) {
+        return;
+      }
+      i = next_++;
+    }
+    Load(i);
+  }
+}
+
+INSTANTIATE_CLASS(WeightLoader);
+
+}  // namespace caffe
@@ -6,17 +6,24 @@ namespace bp = boost::python;
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <cstring>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/layer_cost.hpp"
 #include "caffe/util/signal_handler.h"
+#include "caffe/util/trace.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
+using caffe::format_csv_field;
+using caffe::format_json_string;
 using caffe::Net;
 using caffe::Layer;
 using caffe::Solver;
@@ -41,6 +48,22 @@ DEFINE_string(weights, "",
     "separated by ','. Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_string(phase, "TRAIN",
+    "Optional; network phase (TRAIN or TEST) to time. "
+    "Only the forward pass is timed in TEST.");
+DEFINE_int32(warmup, 1,
+    "Optional; the number of untimed iterations run before timing.");
+DEFINE_int32(batch_size, 0,
+    "Optional; override the batch size of the data and input layers.");
+DEFINE_bool(force_reshape, false,
+    "Optional; reshape every layer before each timed forward, as if no shape "
+    "were unchanged, to measure what skipping redundant reshapes saves.");
+DEFINE_string(trace, "",
+    "Optional; record the layers, data prefetching and solver updates and "
+    "write them to this file in the Chrome trace-event format.");
+DEFINE_string(profile, "",
+    "Optional; write the timing profile to this file, as JSON if its name "
+    "ends in '.json' and as CSV otherwise.");
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
               "snapshot, stop or none.");
@@ -298,8 +321,111 @@ RegisterBrewFunction(test);
 
 
 // Time: benchmark the execution time of a model.
+
+// Timing of one pass of a layer, or of the whole net, over all iterations.
+struct PassProfile {
+  string name;
+  string type;
+  string pass;
+  vector<float> times_ms;
+  int64_t flops;
+  int64_t bytes;
+
+  PassProfile(const string& name, const string& type, const string& pass,
+      int64_t flops, int64_t bytes)
+      : name(name), type(type), pass(pass), flops(flops), bytes(bytes) {}
+  float Mean() const {
+    double sum = 0;
+    for (int i = 0; i < times_ms.size(); ++i) {
+      sum += times_ms[i];
+    }
+    return sum / times_ms.size();
+  }
+  // Nearest-rank percentile, p in [0, 100].
+  float Percentile(float p) const {
+    vector<float> sorted(times_ms);
+    std::sort(sorted.begin(), sorted.end());
+    const int rank = static_cast<int>(std::ceil(p / 100 * sorted.size()));
+    return sorted[std::max(rank, 1) - 1];
+  }
+  // Achieved rates at the mean time, flops per ns is GFLOP/s.
+  float GFlopsPerSecond() const {
+    const float mean = Mean();
+    return mean > 0 ? flops / (mean * 1e6) : 0;
+  }
+  float GBytesPerSecond() const {
+    const float mean = Mean();
+    return mean > 0 ? bytes / (mean * 1e6) : 0;
+  }
+};
+
+static void WriteProfile(const string& filename,
+    const vector<PassProfile>& profiles) {
+  std::ofstream output(filename.c_str());
+  CHECK(output.good()) << "Failed to open profile " << filename;
+  const bool json = boost::algorithm::ends_with(filename, ".json");
+  if (json) {
+    output << "{\n  \"model\": " << format_json_string(FLAGS_model) << ",\n"
+        << "  \"phase\": " << format_json_string(FLAGS_phase) << ",\n"
+        << "  \"mode\": "
+        << format_json_string(Caffe::mode() == Caffe::GPU ? "GPU" : "CPU")
+        << ",\n"
+        << "  \"iterations\": " << FLAGS_iterations << ",\n"
+        << "  \"warmup\": " << FLAGS_warmup << ",\n"
+        << "  \"passes\": [";
+  } else {
+    output << "name,type,pass,mean_ms,p50_ms,p95_ms,p99_ms,flops,bytes,"
+        << "gflops_per_s,gb_per_s\n";
+  }
+  for (int i = 0; i < profiles.size(); ++i) {
+    const PassProfile& profile = profiles[i];
+    if (json) {
+      output << (i ? "," : "") << "\n    {\"name\": "
+          << format_json_string(profile.name) << ", \"type\": "
+          << format_json_string(profile.type) << ", \"pass\": "
+          << format_json_string(profile.pass) << ", \"mean_ms\": "
+          << profile.Mean()
+          << ", \"p50_ms\": " << profile.Percentile(50)
+          << ", \"p95_ms\": " << profile.Percentile(95)
+          << ", \"p99_ms\": " << profile.Percentile(99)
+          << ", \"flops\": " << profile.flops
+          << ", \"bytes\": " << profile.bytes
+          << ", \"gflops_per_s\": " << profile.GFlopsPerSecond()
+          << ", \"gb_per_s\": " << profile.GBytesPerSecond() << "}";
+    } else {
+      output << format_csv_field(profile.name) << ","
+          << format_csv_field(profile.type) << ","
+          << format_csv_field(profile.pass) << "," << profile.Mean() << ","
+          << profile.Percentile(50) << "," << profile.Percentile(95) << ","
+          << profile.Percentile(99) << ","
+          << profile.flops << "," << profile.bytes << ","
+          << profile.GFlopsPerSecond() << "," << profile.GBytesPerSecond()
+          << "\n";
+    }
+  }
+  if (json) {
+    output << "\n  ]\n}\n";
+  }
+  LOG(INFO) << "Wrote profile to " << filename;
+}
+
+static void LogProfile(const PassProfile& profile) {
+  LOG(INFO) << std::setfill(' ') << std::setw(10) << profile.name << "\t"
+      << profile.pass << ": " << profile.Mean() << " ms (p50 "
+      << profile.Percentile(50) << ", p95 " << profile.Percentile(95)
+      << ", p99 " << profile.Percentile(99) << "), "
+      << profile.GFlopsPerSecond() << " GFLOP/s, "
+      << profile.GBytesPerSecond() << " GB/s.";
+}
+
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
+  CHECK_GT(FLAGS_iterations, 0) << "Need at least one iteration to time.";
+  CHECK_GE(FLAGS_warmup, 0) << "Warmup iterations must be non-negative.";
+  caffe::Phase phase;
+  CHECK(caffe::Phase_Parse(FLAGS_phase, &phase))
+      << "Unknown phase " << FLAGS_phase << ", use TRAIN or TEST.";
+  const bool backward = phase == caffe::TRAIN;
 
   // Set device id and mode
   vector<int> gpus;
@@ -313,79 +439,248 @@ int time() {
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, caffe::TRAIN);
+  Net<float> caffe_net(FLAGS_model, phase);
 
-  // Do a clean forward and backward pass, so that memory allocation are done
+  // Do clean forward and backward passes, so that memory allocation are done
   // and future iterations will be more stable.
-  LOG(INFO) << "Performing Forward";
   // Note that for the speed benchmark, we will assume that the network does
   // not take any input blobs.
-  float initial_loss;
-  caffe_net.Forward(&initial_loss);
-  LOG(INFO) << "Initial loss: " << initial_loss;
-  LOG(INFO) << "Performing Backward";
-  caffe_net.Backward();
+  for (int j = 0; j < FLAGS_warmup; ++j) {
+    float loss;
+    caffe_net.Forward(&loss);
+    if (j == 0) {
+      LOG(INFO) << "Initial loss: " << loss;
+    }
+    if (backward) {
+      caffe_net.Backward();
+    }
+  }
 
   const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
   const vector<vector<Blob<float>*> >& bottom_vecs = caffe_net.bottom_vecs();
   const vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
   const vector<vector<bool> >& bottom_need_backward =
       caffe_net.bottom_need_backward();
+  // Estimate the cost of each layer at the shapes set up by the net.
+  vector<PassProfile> forward_profiles, backward_profiles;
+  int64_t forward_flops = 0, forward_bytes = 0;
+  int64_t backward_flops = 0, backward_bytes = 0;
+  for (int i = 0; i < layers.size(); ++i) {
+    const caffe::LayerCost cost =
+        caffe::EstimateLayerCost(layers[i].get(), bottom_vecs[i], top_vecs[i]);
+    const string& name = layers[i]->layer_param().name();
+    const string type = layers[i]->type();
+    forward_profiles.push_back(PassProfile(name, type, "forward",
+        cost.forward_flops, cost.forward_bytes));
+    backward_profiles.push_back(PassProfile(name, type, "backward",
+        cost.backward_flops, cost.backward_bytes));
+    forward_flops += cost.forward_flops;
+    forward_bytes += cost.forward_bytes;
+    backward_flops += cost.backward_flops;
+    backward_bytes += cost.backward_bytes;
+  }
+  PassProfile forward_total("total", caffe_net.name(), "forward",
+      forward_flops, forward_bytes);
+  PassProfile backward_total("total", caffe_net.name(), "backward",
+      backward_flops, backward_bytes);
+
   LOG(INFO) << "*** Benchmark begins ***";
-  LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
+  LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations in "
+      << FLAGS_phase << " phase after " << FLAGS_warmup << " warmup.";
   Timer total_timer;
   total_timer.Start();
   Timer forward_timer;
   Timer backward_timer;
   Timer timer;
-  std::vector<double> forward_time_per_layer(layers.size(), 0.0);
-  std::vector<double> backward_time_per_layer(layers.size(), 0.0);
-  double forward_time = 0.0;
-  double backward_time = 0.0;
   for (int j = 0; j < FLAGS_iterations; ++j) {
     Timer iter_timer;
     iter_timer.Start();
     forward_timer.Start();
     for (int i = 0; i < layers.size(); ++i) {
+      caffe::TraceScope trace("forward", layers[i]->layer_param().name());
       timer.Start();
+      if (FLAGS_force_reshape) {
+        layers[i]->Reshape(bottom_vecs[i], top_vecs[i]);
+      }
       layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
-      forward_time_per_layer[i] += timer.MicroSeconds();
+      forward_profiles[i].times_ms.push_back(timer.MicroSeconds() / 1000);
     }
-    forward_time += forward_timer.MicroSeconds();
-    backward_timer.Start();
-    for (int i = layers.size() - 1; i >= 0; --i) {
-      timer.Start();
-      layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
-                          bottom_vecs[i]);
-      backward_time_per_layer[i] += timer.MicroSeconds();
+    forward_total.times_ms.push_back(forward_timer.MicroSeconds() / 1000);
+    if (backward) {
+      backward_timer.Start();
+      for (int i = layers.size() - 1; i >= 0; --i) {
+        caffe::TraceScope trace("backward", layers[i]->layer_param().name());
+        timer.Start();
+        layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
+                            bottom_vecs[i]);
+        backward_profiles[i].times_ms.push_back(timer.MicroSeconds() / 1000);
+      }
+      backward_total.times_ms.push_back(backward_timer.MicroSeconds() / 1000);
     }
-    backward_time += backward_timer.MicroSeconds();
-    LOG(INFO) << "Iteration: " << j + 1 << " forward-backward time: "
-      << iter_timer.MilliSeconds() << " ms.";
+    LOG(INFO) << "Iteration: " << j + 1 << (backward ? " forward-backward" :
+        " forward") << " time: " << iter_timer.MilliSeconds() << " ms.";
   }
-  LOG(INFO) << "Average time per layer: ";
+  total_timer.Stop();
+
+  vector<PassProfile> profiles;
+  LOG(INFO) << "Time per layer: ";
   for (int i = 0; i < layers.size(); ++i) {
-    const caffe::string& layername = layers[i]->layer_param().name();
-    LOG(INFO) << std::setfill(' ') << std::setw(10) << layername <<
-      "\tforward: " << forward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
-    LOG(INFO) << std::setfill(' ') << std::setw(10) << layername  <<
-      "\tbackward: " << backward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
+    LogProfile(forward_profiles[i]);
+    profiles.push_back(forward_profiles[i]);
+    if (backward) {
+      LogProfile(backward_profiles[i]);
+      profiles.push_back(backward_profiles[i]);
+    }
   }
-  total_timer.Stop();
-  LOG(INFO) << "Average Forward pass: " << forward_time / 1000 /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Average Backward pass: " << backward_time / 1000 /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
-    FLAGS_iterations << " ms.";
+  LOG(INFO) << "Forward pass: ";
+  LogProfile(forward_total);
+  profiles.push_back(forward_total);
+  if (backward) {
+    LOG(INFO) << "Backward pass: ";
+    LogProfile(backward_total);
+    profiles.push_back(backward_total);
+  }
+  LOG(INFO) << "Average " << (backward ? "Forward-Backward: " : "Forward: ")
+      << total_timer.MilliSeconds() / FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
   LOG(INFO) << "*** Benchmark ends ***";
+  if (FLAGS_profile.size()) {
+    WriteProfile(FLAGS_profile, profiles);
+  }
   return 0;
 }
 RegisterBrewFunction(time);
 
+// Set the batch size of the data and input layers of param.
+static void SetBatchSize(int batch_size, caffe::NetParameter* param) {
+  for (int i = 0; i < param->layer_size(); ++i) {
+    caffe::LayerParameter* layer = param->mutable_layer(i);
+    if (layer->has_data_param()) {
+      layer->mutable_data_param()->set_batch_size(batch_size);
+    }
+    if (layer->has_image_data_param()) {
+      layer->mutable_image_data_param()->set_batch_size(batch_size);
+    }
+    if (layer->has_hdf5_data_param()) {
+      layer->mutable_hdf5_data_param()->set_batch_size(batch_size);
+    }
+    if (layer->has_memory_data_param()) {
+      layer->mutable_memory_data_param()->set_batch_size(batch_size);
+    }
+    if (layer->has_window_data_param()) {
+      layer->mutable_window_data_param()->set_batch_size(batch_size);
+    }
+    for (int j = 0; j < layer->input_param().shape_size(); ++j) {
+      caffe::BlobShape* shape = layer->mutable_input_param()->mutable_shape(j);
+      if (shape->dim_size() > 0) {
+        shape->set_dim(0, batch_size);
+      }
+    }
+    for (int j = 0; j < layer->dummy_data_param().shape_size(); ++j) {
+      caffe::BlobShape* shape =
+          layer->mutable_dummy_data_param()->mutable_shape(j);
+      if (shape->dim_size() > 0) {
+        shape->set_dim(0, batch_size);
+      }
+    }
+  }
+}
+
+// Bytes of the data and diff of blob charged to account and not yet seen.
+static size_t ChargedBytes(const Blob<float>& blob,
+    const caffe::MemoryAccount* account, caffe::MemoryAccount::Side side,
+    std::set<const caffe::SyncedMemory*>* seen) {
+  const shared_ptr<caffe::SyncedMemory> memory[] = {blob.data(), blob.diff()};
+  size_t bytes = 0;
+  for (int i = 0; i < 2; ++i) {
+    if (!memory[i] || !seen->insert(memory[i].get()).second) { continue; }
+    const caffe::MemoryAccount* charged =
+        side == caffe::MemoryAccount::HOST ? memory[i]->cpu_account() :
+        memory[i]->gpu_account();
+    if (charged == account) {
+      bytes += memory[i]->size();
+    }
+  }
+  return bytes;
+}
+
+static string Megabytes(size_t bytes) {
+  ostringstream stream;
+  stream << std::fixed << std::setprecision(2) << bytes / 1048576.;
+  return stream.str();
+}
+
+// Memory: report the memory each layer allocates in one pass.
+int memory() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to measure.";
+  caffe::Phase phase;
+  CHECK(caffe::Phase_Parse(FLAGS_phase, &phase))
+      << "Unknown phase " << FLAGS_phase << ", use TRAIN or TEST.";
+  vector<int> gpus;
+  get_gpus(&gpus);
+  if (gpus.size() != 0) {
+    LOG(INFO) << "Use GPU with device ID " << gpus[0];
+    Caffe::SetDevice(gpus[0]);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    LOG(INFO) << "Use CPU.";
+    Caffe::set_mode(Caffe::CPU);
+  }
+  const caffe::MemoryAccount::Side side = gpus.size() ?
+      caffe::MemoryAccount::DEVICE : caffe::MemoryAccount::HOST;
+
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  param.mutable_state()->set_phase(phase);
+  if (FLAGS_batch_size > 0) {
+    SetBatchSize(FLAGS_batch_size, &param);
+  }
+  Net<float> caffe_net(param);
+  // Run one pass so that every blob and buffer is allocated; the weights
+  // are never updated.
+  caffe_net.Forward();
+  if (phase == caffe::TRAIN) {
+    caffe_net.Backward();
+  }
+
+  LOG(INFO) << "Memory in MB on the " << (gpus.size() ? "device" : "host")
+      << ", after one " << (phase == caffe::TRAIN ? "forward-backward" :
+      "forward") << " pass:";
+  LOG(INFO) << std::setfill(' ') << std::setw(10) << "layer" << "\t"
+      << "params\ttops\tbottoms\tbuffers\ttotal\tpeak";
+  const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
+  for (int i = 0; i < layers.size(); ++i) {
+    const caffe::MemoryAccount* account = caffe_net.layer_memory()[i].get();
+    std::set<const caffe::SyncedMemory*> seen;
+    size_t params = 0, tops = 0, bottoms = 0;
+    for (int j = 0; j < layers[i]->blobs().size(); ++j) {
+      params += ChargedBytes(*layers[i]->blobs()[j], account, side, &seen);
+    }
+    for (int j = 0; j < caffe_net.top_vecs()[i].size(); ++j) {
+      tops += ChargedBytes(*caffe_net.top_vecs()[i][j], account, side, &seen);
+    }
+    for (int j = 0; j < caffe_net.bottom_vecs()[i].size(); ++j) {
+      bottoms += ChargedBytes(*caffe_net.bottom_vecs()[i][j], account, side,
+          &seen);
+    }
+    const caffe::MemoryUsage usage = account->usage(side);
+    LOG(INFO) << std::setfill(' ') << std::setw(10)
+        << caffe_net.layer_names()[i] << "\t" << Megabytes(params) << "\t"
+        << Megabytes(tops) << "\t" << Megabytes(bottoms) << "\t"
+        << Megabytes(usage.live - params - tops - bottoms) << "\t"
+        << Megabytes(usage.live) << "\t" << Megabytes(usage.peak);
+  }
+  const caffe::MemoryUsage usage = caffe_net.memory()->usage(side);
+  LOG(INFO) << std::setfill(' ') << std::setw(10) << "total" << "\t\t\t\t\t"
+      << Megabytes(usage.live) << "\t" << Megabytes(usage.peak);
+  LOG(INFO) << "Memory of the process: "
+      << Megabytes(caffe::MemoryAccount::Global()->usage(side).peak)
+      << " MB at peak in " << caffe::MemoryAccount::Global()->usage(
+      side).allocations << " allocations.";
+  return 0;
+}
+RegisterBrewFunction(memory);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -398,14 +693,22 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  memory          report the memory used by each layer of a model");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
 #endif
-      return GetBrewFunction(caffe::string(argv[1]))();
+      if (FLAGS_trace.size()) {
+        caffe::Trace::Enable();
+      }
+      const int result = GetBrewFunction(caffe::string(argv[1]))();
+      if (FLAGS_trace.size()) {
+        caffe::Trace::WriteChromeTrace(FLAGS_trace);
+      }
+      return result;
 #ifdef WITH_PYTHON_LAYER
     } catch (bp::error_already_set) {
       PyErr_Print();
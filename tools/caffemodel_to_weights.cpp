@@ -0,0 +1,34 @@
+// This is a script to convert trained weights to a memory mapped weight file.
+// Usage:
+//    caffemodel_to_weights net.caffemodel net.caffeweights
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/weight_file.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 3) {
+    LOG(ERROR) << "Usage: "
+        << "caffemodel_to_weights net.caffemodel net"
+        << WeightFile::kExtension;
+    return 1;
+  }
+  if (!WeightFile::IsWeightFile(argv[2])) {
+    LOG(WARNING) << "Nets only map weight files ending in "
+        << WeightFile::kExtension << "; " << argv[2] << " will be parsed "
+        << "as a binary proto.";
+  }
+
+  NetParameter net_param;
+  ReadNetParamsFromBinaryFileOrDie(argv[1], &net_param);
+  WeightFile::Write(net_param, argv[2]);
+
+  LOG(INFO) << "Wrote weight file " << argv[2];
+  return 0;
+}
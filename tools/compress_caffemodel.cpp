@@ -0,0 +1,69 @@
+// This program compresses the weights of a trained model, storing pruned
+// (sparse) params in compressed sparse row form and optionally quantizing
+// the weights. The result loads like any .caffemodel.
+// Usage:
+//    compress_caffemodel [FLAGS] net.caffemodel compressed.caffemodel
+
+#include <string>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/blob_compression.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(quantization_bits, 0,
+    "Quantize the weights to 2^quantization_bits shared values (at most 8); "
+    "0 keeps them exact.");
+DEFINE_int32(quantization_iterations, 10,
+    "Iterations of the k-means finding the shared values.");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Compress the weights of a trained model.\n"
+        "Usage:\n"
+        "    compress_caffemodel [FLAGS] INPUT_MODEL OUTPUT_MODEL\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/compress_caffemodel");
+    return 1;
+  }
+
+  NetParameter net_param;
+  ReadNetParamsFromBinaryFileOrDie(argv[1], &net_param);
+  const int original_size = net_param.ByteSize();
+  CompressionParameter compression;
+  compression.set_quantization_bits(FLAGS_quantization_bits);
+  compression.set_quantization_iterations(FLAGS_quantization_iterations);
+  CompressNetParameter(compression, &net_param);
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    const LayerParameter& layer = net_param.layer(i);
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      const BlobProto& blob = layer.blobs(j);
+      if (!blob.has_compressed_data()) {
+        continue;
+      }
+      const CompressedBlob& compressed = blob.compressed_data();
+      LOG(INFO) << "Layer " << layer.name() << " param " << j << ": "
+          << (compressed.row_start_size() > 0 ? "sparse" : "dense")
+          << (compressed.codebook_size() > 0 ? ", quantized" : "")
+          << ", " << blob.ByteSize() << " bytes";
+    }
+  }
+  WriteProtoToBinaryFile(net_param, argv[2]);
+  LOG(INFO) << "Wrote " << argv[2] << ": " << net_param.ByteSize()
+      << " bytes, from " << original_size << " bytes";
+  return 0;
+}
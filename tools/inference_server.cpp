@@ -0,0 +1,132 @@
+// This program serves a trained net with a dynamically batching
+// InferenceEngine and drives it from local loopback clients, reporting the
+// throughput and the request latency distribution.
+// Usage:
+//   inference_server [FLAGS] NET_PROTOTXT WEIGHTS
+//
+// Each client thread sends requests of request_size random items back to
+// back, optionally pausing interval_us between them.
+
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/inference_engine.hpp"
+#include "caffe/util/benchmark.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(gpu, -1,
+    "Optional; run in GPU mode on the given device ID.");
+DEFINE_int32(workers, 1,
+    "Number of net replicas serving requests.");
+DEFINE_int32(max_batch_size, 1,
+    "Maximum number of items batched into one forward pass.");
+DEFINE_int32(max_latency_us, 0,
+    "Maximum time a request waits for a batch to fill, in microseconds.");
+DEFINE_int32(idle_release_ms, 0,
+    "Optional; release a worker's blobs after this long without requests.");
+DEFINE_int32(clients, 1,
+    "Number of loopback client threads.");
+DEFINE_int32(requests, 100,
+    "Number of requests sent by each client.");
+DEFINE_int32(request_size, 1,
+    "Number of items in each request, along the first input axis.");
+DEFINE_int32(interval_us, 0,
+    "Optional; pause between consecutive requests of a client.");
+DEFINE_int32(warmup, 1,
+    "Requests sent by each client before the statistics are reset.");
+
+static void RunClient(InferenceEngine<float>* engine, int num_requests) {
+  const Net<float>& net = *engine->net();
+  vector<shared_ptr<Blob<float> > > inputs, outputs;
+  vector<Blob<float>*> input_vec, output_vec;
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  for (int i = 0; i < net.num_inputs(); ++i) {
+    vector<int> shape = net.input_blobs()[i]->shape();
+    CHECK_GT(shape.size(), 0) << "Net inputs need a batch axis.";
+    shape[0] = FLAGS_request_size;
+    inputs.push_back(shared_ptr<Blob<float> >(new Blob<float>(shape)));
+    filler.Fill(inputs[i].get());
+    input_vec.push_back(inputs[i].get());
+  }
+  for (int i = 0; i < net.num_outputs(); ++i) {
+    outputs.push_back(shared_ptr<Blob<float> >(new Blob<float>()));
+    output_vec.push_back(outputs[i].get());
+  }
+  for (int i = 0; i < num_requests; ++i) {
+    engine->Predict(input_vec, output_vec);
+    if (FLAGS_interval_us > 0) {
+      boost::this_thread::sleep(
+          boost::posix_time::microseconds(FLAGS_interval_us));
+    }
+  }
+}
+
+static void RunClients(InferenceEngine<float>* engine, int num_requests) {
+  boost::thread_group clients;
+  for (int i = 0; i < FLAGS_clients; ++i) {
+    clients.create_thread(boost::bind(&RunClient, engine, num_requests));
+  }
+  clients.join_all();
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Serve a trained net to local loopback clients\n"
+        "and report throughput and latency.\n"
+        "Usage:\n"
+        "    inference_server [FLAGS] NET_PROTOTXT WEIGHTS\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/inference_server");
+    return 1;
+  }
+
+  if (FLAGS_gpu >= 0) {
+    LOG(INFO) << "Using GPU " << FLAGS_gpu;
+    Caffe::SetDevice(FLAGS_gpu);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    LOG(INFO) << "Using CPU";
+    Caffe::set_mode(Caffe::CPU);
+  }
+
+  InferenceEngine<float> engine(argv[1], argv[2], FLAGS_workers,
+      FLAGS_max_batch_size, FLAGS_max_latency_us, FLAGS_idle_release_ms);
+  if (FLAGS_warmup > 0) {
+    RunClients(&engine, FLAGS_warmup);
+    engine.ResetStats();
+  }
+
+  CPUTimer timer;
+  timer.Start();
+  RunClients(&engine, FLAGS_requests);
+  const float seconds = timer.MilliSeconds() / 1000;
+
+  const int64_t num_requests = engine.num_requests();
+  const int64_t num_batches = engine.num_batches();
+  LOG(INFO) << "Served " << num_requests << " requests in " << num_batches
+      << " batches (" << static_cast<float>(num_requests) / num_batches
+      << " requests per batch) in " << seconds << " s";
+  LOG(INFO) << "Throughput: " << num_requests / seconds << " requests/s, "
+      << num_requests * FLAGS_request_size / seconds << " items/s";
+  LOG(INFO) << "Latency: " << engine.latency().ToString();
+  return 0;
+}
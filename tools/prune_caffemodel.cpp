@@ -0,0 +1,120 @@
+// This program prunes the weights of the inner product and convolution layers
+// of a trained model, zeroing those of smallest magnitude. In the TEST phase
+// these layers multiply by pruned weights in sparse form (see their
+// sparse_threshold), and the pruned model is stored compressed.
+// Usage:
+//    prune_caffemodel [FLAGS] net.caffemodel pruned.caffemodel
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/blob_compression.hpp"
+#include "caffe/util/io.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_double(sparsity, 0.9,
+    "The fraction of the weights of each pruned layer to zero.");
+DEFINE_string(layers, "",
+    "Optional; the comma-separated names of the layers to prune. "
+    "By default every InnerProduct and Convolution layer is pruned.");
+DEFINE_bool(compress, true,
+    "Store the pruned weights in compressed sparse row form.");
+
+// Zeros the sparsity fraction of the values of smallest magnitude.
+template <typename Values>
+int Prune(Values* values) {
+  const int count = values->size();
+  const int num_pruned = std::min<int>(count, count * FLAGS_sparsity + 0.5);
+  if (num_pruned == 0) {
+    return 0;
+  }
+  std::vector<double> magnitudes(count);
+  for (int i = 0; i < count; ++i) {
+    magnitudes[i] = std::fabs(values->Get(i));
+  }
+  std::nth_element(magnitudes.begin(), magnitudes.begin() + num_pruned - 1,
+      magnitudes.end());
+  const double cutoff = magnitudes[num_pruned - 1];
+  // Values equal to the cutoff are pruned only as far as needed.
+  int pruned = 0;
+  for (int i = 0; i < count; ++i) {
+    const double magnitude = std::fabs(values->Get(i));
+    if (magnitude < cutoff) {
+      values->Set(i, 0);
+      ++pruned;
+    }
+  }
+  for (int i = 0; i < count && pruned < num_pruned; ++i) {
+    if (std::fabs(values->Get(i)) == cutoff) {
+      values->Set(i, 0);
+      ++pruned;
+    }
+  }
+  return pruned;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Prune the weights of a trained model.\n"
+        "Usage:\n"
+        "    prune_caffemodel [FLAGS] INPUT_MODEL OUTPUT_MODEL\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/prune_caffemodel");
+    return 1;
+  }
+  CHECK(FLAGS_sparsity >= 0 && FLAGS_sparsity <= 1)
+      << "sparsity must be between 0 and 1.";
+
+  std::set<string> layer_names;
+  if (!FLAGS_layers.empty()) {
+    std::vector<string> names;
+    boost::split(names, FLAGS_layers, boost::is_any_of(","));
+    layer_names.insert(names.begin(), names.end());
+  }
+
+  NetParameter net_param;
+  ReadNetParamsFromBinaryFileOrDie(argv[1], &net_param);
+  DecompressNetParameter(&net_param);
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    LayerParameter* layer = net_param.mutable_layer(i);
+    const bool selected = layer_names.empty() ?
+        (layer->type() == "InnerProduct" || layer->type() == "Convolution") :
+        layer_names.erase(layer->name()) > 0;
+    if (!selected || layer->blobs_size() == 0) {
+      continue;
+    }
+    BlobProto* weights = layer->mutable_blobs(0);
+    const int count = std::max(weights->data_size(),
+        weights->double_data_size());
+    const int pruned = weights->double_data_size() > 0 ?
+        Prune(weights->mutable_double_data()) :
+        Prune(weights->mutable_data());
+    LOG(INFO) << "Layer " << layer->name() << ": pruned " << pruned
+        << " of " << count << " weights";
+  }
+  CHECK(layer_names.empty()) << "Unknown layer " << *layer_names.begin();
+  if (FLAGS_compress) {
+    CompressNetParameter(CompressionParameter(), &net_param);
+  }
+  WriteProtoToBinaryFile(net_param, argv[2]);
+  LOG(INFO) << "Wrote " << argv[2] << ": " << net_param.ByteSize() << " bytes";
+  return 0;
+}